@@ -0,0 +1,62 @@
+#pragma once
+
+#include "gcal_api.hpp"
+#include "json_stream.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Decodes an events.list response into an EventPage while it downloads:
+// feed() takes the body in whatever chunks arrive and every item lands in
+// page.items as soon as its closing brace is seen. Only the fields ApiEvent
+// holds are kept, the rest of the document is skipped token by token.
+class EventsPageDecoder {
+public:
+  explicit EventsPageDecoder(EventPage &page) : _page(page), _parser(*this) {}
+  EventsPageDecoder(const EventsPageDecoder &) = delete;
+  EventsPageDecoder &operator=(const EventsPageDecoder &) = delete;
+
+  inline bool feed(std::string_view chunk) { return _parser.feed(chunk); }
+  // true if the body was a complete JSON document
+  inline bool finish() { return _parser.finish(); }
+
+private:
+  friend class JsonStreamParser<EventsPageDecoder>;
+
+  enum class Field : uint8_t {
+    None,
+    Items,
+    NextPageToken,
+    NextSyncToken,
+    Id,
+    Status,
+    Summary,
+    Description,
+    Start,
+    End,
+    DateTime,
+    Date,
+  };
+
+  // SAX callbacks. Depth 1 is the response object, 2 the items array, 3 an
+  // item and 4 its start/end objects.
+  bool start_object();
+  bool end_object();
+  bool start_array();
+  bool end_array();
+  bool key(std::string &name);
+  bool string(std::string &value);
+  inline bool number(std::string_view) { return true; }
+  inline bool boolean(bool) { return true; }
+  inline bool null() { return true; }
+
+  EventPage &_page;
+  JsonStreamParser<EventsPageDecoder> _parser;
+  ApiEvent _item;
+  uint32_t _depth = 0;
+  bool _in_items = false;
+  Field _top_key = Field::None;
+  Field _item_key = Field::None;
+  Field _time_object = Field::None; // Start or End while inside one
+  Field _time_key = Field::None;
+};
@@ -1,7 +1,12 @@
 #pragma once
 
 #include "nlohmann/json.hpp"
+#include "session_pool.hpp"
+#include <chrono>
+#include <cstddef>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
@@ -9,14 +14,54 @@
 // This avoids a dependency on your core Event class.
 struct ApiEvent {
   std::string id;
-  std::string summary;
-  std::string start_time;
-  std::string end_time;
+  std::string summary = "No Title";
+  std::string description;
+  // nullopt when missing (cancelled events) or not valid RFC 3339
+  std::optional<std::chrono::system_clock::time_point> start;
+  std::optional<std::chrono::system_clock::time_point> end;
+  bool all_day = false;
+  // deleted upstream, incremental syncs report these
+  bool cancelled = false;
 };
 
+// Where requests go. Defaults to Google, tests point it at a local server
+// replaying recorded responses.
+struct GoogleApiEndpoints {
+  std::string api_base = "https://www.googleapis.com/calendar/v3";
+  std::string token_url = "https://oauth2.googleapis.com/token";
+};
+
+// Retries of rate-limited (429), failed (5xx) and dropped requests
+struct RetryPolicy {
+  int max_attempts = 4; // 1 disables retries
+  std::chrono::milliseconds base_delay{250};
+  std::chrono::milliseconds max_delay{8000};
+};
+
+// One page of events.list
+struct EventPage {
+  std::vector<ApiEvent> items;
+  // more pages follow when set
+  std::string next_page_token;
+  // only on the last page, resumes the listing incrementally
+  std::string next_sync_token;
+};
+
+enum class PageStatus {
+  Ok,
+  Gone, // the sync token expired, a full sync is needed
+  Failed,
+};
+
+// Requests go through a pool of persistent sessions and may be issued from
+// several threads at once. A 401 triggers one token refresh no matter how
+// many requests ran into it, the others wait for it and retry.
 class GoogleCalendarAPI {
 public:
-  GoogleCalendarAPI(const std::string &secret_path);
+  GoogleCalendarAPI(const std::string &secret_path,
+                    GoogleApiEndpoints endpoints = {},
+                    RetryPolicy retry = {},
+                    std::string token_path = "gcal_token.json");
 
   // Initiates the authentication flow. Returns false if secrets can't be
   // loaded.
@@ -25,18 +70,41 @@ public:
   // Fetches a list of upcoming events.
   std::optional<std::vector<ApiEvent>> list_events(int max_results = 10);
 
+  // Fetches one page of a calendar. Without a sync token this lists every
+  // event, with one only what changed since it was issued (cancelled events
+  // included).
+  PageStatus list_events_page(const std::string &sync_token,
+                              const std::string &page_token, EventPage &page,
+                              int page_size = 250,
+                              const std::string &calendar_id = "primary");
+
+  // Lists every event of each calendar, up to `concurrency` of them at
+  // once. An entry is nullopt if its calendar failed.
+  std::vector<std::optional<std::vector<ApiEvent>>>
+  list_calendars_events(const std::vector<std::string> &calendar_ids,
+                        size_t concurrency = 4);
+
+  inline const std::string &token_file_path() const {
+    return _token_file_path;
+  }
+
 private:
   // Helper methods for the OAuth 2.0 flow
   bool load_secrets();
   bool load_tokens_from_file();
   void save_tokens_to_file();
-  bool refresh_access_token();
+  // Single-flight: `rejected` is the token the caller saw fail. If another
+  // thread replaced it in the meantime that refresh is reused.
+  bool refresh_access_token(const std::string &rejected);
+  std::string access_token() const;
   bool get_tokens_from_auth_code(const std::string &auth_code);
 
-  // A general-purpose helper to make authenticated GET requests
-  std::optional<nlohmann::json> make_authenticated_get_request(
+  // Authenticated GET of an events.list page, decoded into `page` while the
+  // body downloads
+  PageStatus get_events_page(
       const std::string &url,
-      const std::vector<std::pair<std::string, std::string>> &params);
+      const std::vector<std::pair<std::string, std::string>> &params,
+      EventPage &page);
 
   // Member variables
   std::string _client_id;
@@ -44,6 +112,12 @@ private:
   std::string _access_token;
   std::string _refresh_token;
 
+  GoogleApiEndpoints _endpoints;
+  RetryPolicy _retry;
+  SessionPool _sessions;
+  // guards the tokens; _refresh_mutex serializes refreshes
+  mutable std::shared_mutex _token_mutex;
+  std::mutex _refresh_mutex;
   std::string _secret_file_path;
-  const std::string _token_file_path = "gcal_token.json";
+  const std::string _token_file_path;
 };
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "calendar.hpp"
+#include "gcal_api.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct SyncStats {
+  bool full = false; // listed everything instead of the changes
+  size_t pages = 0;
+  size_t created = 0;
+  size_t updated = 0;
+  size_t removed = 0;
+  size_t skipped = 0; // unparsable items
+};
+
+// Mirrors the primary Google calendar into a task_manager::Calendar.
+//
+// The first sync pages through every event, later ones only fetch what
+// changed since the sync token of the previous run. When Google expires
+// the token (410 Gone) the next run falls back to a full sync, which also
+// removes mirrored events that no longer exist upstream. Changes land in
+// the calendar as batched creates, updates and removes.
+//
+// The sync token and the Google id -> calendar id mapping are kept in a
+// JSON file next to gcal_token.json, written only once a sync went
+// through, so an interrupted run is simply repeated.
+class GoogleCalendarSync {
+public:
+  GoogleCalendarSync(GoogleCalendarAPI &api, task_manager::Calendar &calendar,
+                     std::optional<std::string> state_path = std::nullopt);
+
+  // nullopt if the listing failed, nothing was applied then
+  std::optional<SyncStats> sync();
+  // Forgets the sync token, the next sync lists everything again.
+  void reset();
+
+  inline const std::string &sync_token() const { return _sync_token; }
+
+private:
+  bool load_state();
+  bool save_state() const;
+  PageStatus fetch(const std::string &sync_token, std::vector<ApiEvent> &items,
+                   std::string &next_sync_token, SyncStats &stats);
+  // false if some change couldn't be applied and has to be fetched again
+  bool reconcile(const std::vector<ApiEvent> &items, bool full,
+                 SyncStats &stats);
+
+  GoogleCalendarAPI &_api;
+  task_manager::Calendar &_calendar;
+  std::string _state_path;
+  std::string _sync_token;
+  // Google event id -> calendar event id
+  std::unordered_map<std::string, uint32_t> _ids;
+};
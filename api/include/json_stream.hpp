@@ -0,0 +1,306 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Push-style JSON tokenizer: bytes go in through feed() in chunks of any
+// size, as they come off the network, and come out as SAX events on the
+// handler. Nothing but the current token is buffered, so no document is
+// ever built.
+//
+// The handler provides (every call returns false to stop parsing):
+//   bool start_object(); bool end_object();
+//   bool start_array();  bool end_array();
+//   bool key(std::string &);    bool string(std::string &);
+//   bool number(std::string_view raw);
+//   bool boolean(bool);  bool null();
+// The strings are the parser's scratch buffer, the handler may move them
+// out.
+template <typename Handler> class JsonStreamParser {
+public:
+  static constexpr size_t max_depth = 512;
+
+  explicit JsonStreamParser(Handler &handler) : _handler(handler) {}
+
+  // false once the input is malformed or the handler stopped
+  bool feed(std::string_view chunk) {
+    size_t i = 0;
+    while (!_failed && i < chunk.size()) {
+      if (_lexeme == Lexeme::String && _escape == 0) {
+        // copy plain runs of a string in bulk
+        size_t stop = chunk.find_first_of("\"\\", i);
+        if (stop == std::string_view::npos)
+          stop = chunk.size();
+        _token.append(chunk.data() + i, stop - i);
+        i = stop;
+        if (i == chunk.size())
+          break;
+      }
+      _failed = !step(chunk[i++]);
+    }
+    return !_failed;
+  }
+
+  // true if exactly one complete document was fed
+  bool finish() {
+    if (!_failed && (_lexeme == Lexeme::Number || _lexeme == Lexeme::Literal))
+      _failed = !end_scalar();
+    return !_failed && _lexeme == Lexeme::None && _expect == Expect::Done;
+  }
+
+private:
+  enum class Expect : uint8_t {
+    Value,
+    FirstValueOrEnd, // right after '['
+    KeyOrEnd,        // right after '{'
+    Key,
+    Colon,
+    CommaOrEnd,
+    Done,
+  };
+  enum class Lexeme : uint8_t { None, String, Number, Literal };
+
+  static bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+  }
+
+  bool step(char c) {
+    switch (_lexeme) {
+    case Lexeme::String:
+      return string_char(c);
+    case Lexeme::Number:
+      if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+          c == '+' || c == '-') {
+        _token.push_back(c);
+        return true;
+      }
+      if (!end_scalar())
+        return false;
+      break; // c still needs handling
+    case Lexeme::Literal:
+      if (c >= 'a' && c <= 'z') {
+        _token.push_back(c);
+        return _token.size() <= 5;
+      }
+      if (!end_scalar())
+        return false;
+      break;
+    case Lexeme::None:
+      break;
+    }
+
+    if (is_space(c))
+      return true;
+
+    switch (_expect) {
+    case Expect::FirstValueOrEnd:
+      if (c == ']')
+        return end_container('[');
+      [[fallthrough]];
+    case Expect::Value:
+      return begin_value(c);
+    case Expect::KeyOrEnd:
+      if (c == '}')
+        return end_container('{');
+      [[fallthrough]];
+    case Expect::Key:
+      if (c != '"')
+        return false;
+      begin_token(Lexeme::String);
+      _in_key = true;
+      return true;
+    case Expect::Colon:
+      if (c != ':')
+        return false;
+      _expect = Expect::Value;
+      return true;
+    case Expect::CommaOrEnd:
+      if (c == ',') {
+        _expect = _stack.back() == '{' ? Expect::Key : Expect::Value;
+        return true;
+      }
+      if (c == '}' || c == ']')
+        return end_container(c == '}' ? '{' : '[');
+      return false;
+    case Expect::Done:
+      return false; // trailing garbage
+    }
+    return false;
+  }
+
+  bool begin_value(char c) {
+    switch (c) {
+    case '{':
+    case '[':
+      if (_stack.size() == max_depth)
+        return false;
+      _stack.push_back(c);
+      _expect = c == '{' ? Expect::KeyOrEnd : Expect::FirstValueOrEnd;
+      return c == '{' ? _handler.start_object() : _handler.start_array();
+    case '"':
+      begin_token(Lexeme::String);
+      _in_key = false;
+      return true;
+    case 't':
+    case 'f':
+    case 'n':
+      begin_token(Lexeme::Literal);
+      _token.push_back(c);
+      return true;
+    default:
+      if (c == '-' || (c >= '0' && c <= '9')) {
+        begin_token(Lexeme::Number);
+        _token.push_back(c);
+        return true;
+      }
+      return false;
+    }
+  }
+
+  void begin_token(Lexeme lexeme) {
+    _lexeme = lexeme;
+    _token.clear();
+    _high_surrogate = 0;
+  }
+
+  bool end_container(char open) {
+    if (_stack.empty() || _stack.back() != open)
+      return false;
+    _stack.pop_back();
+    value_done();
+    return open == '{' ? _handler.end_object() : _handler.end_array();
+  }
+
+  void value_done() {
+    _expect = _stack.empty() ? Expect::Done : Expect::CommaOrEnd;
+  }
+
+  bool end_scalar() {
+    Lexeme lexeme = _lexeme;
+    _lexeme = Lexeme::None;
+    value_done();
+    if (lexeme == Lexeme::Number)
+      return _handler.number(_token);
+    if (_token == "true")
+      return _handler.boolean(true);
+    if (_token == "false")
+      return _handler.boolean(false);
+    if (_token == "null")
+      return _handler.null();
+    return false;
+  }
+
+  bool string_char(char c) {
+    if (_escape == 0) {
+      if (c == '"') {
+        _lexeme = Lexeme::None;
+        if (_in_key) {
+          _expect = Expect::Colon;
+          return _handler.key(_token);
+        }
+        value_done();
+        return _handler.string(_token);
+      }
+      // only '\\' gets here, the plain runs are copied by feed()
+      _escape = 1;
+      return true;
+    }
+
+    if (_escape == 1) {
+      _escape = 0;
+      switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        _token.push_back(c);
+        return true;
+      case 'b':
+        _token.push_back('\b');
+        return true;
+      case 'f':
+        _token.push_back('\f');
+        return true;
+      case 'n':
+        _token.push_back('\n');
+        return true;
+      case 'r':
+        _token.push_back('\r');
+        return true;
+      case 't':
+        _token.push_back('\t');
+        return true;
+      case 'u':
+        _escape = 2;
+        _code_unit = 0;
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    // \uXXXX, _escape counts the hex digits read so far from 2
+    uint32_t digit;
+    if (c >= '0' && c <= '9')
+      digit = static_cast<uint32_t>(c - '0');
+    else if (c >= 'a' && c <= 'f')
+      digit = static_cast<uint32_t>(c - 'a' + 10);
+    else if (c >= 'A' && c <= 'F')
+      digit = static_cast<uint32_t>(c - 'A' + 10);
+    else
+      return false;
+    _code_unit = (_code_unit << 4) | digit;
+    if (++_escape < 6)
+      return true;
+    _escape = 0;
+
+    uint32_t code_point = _code_unit;
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+      // high surrogate, the low half follows as another \u escape
+      _high_surrogate = code_point;
+      return true;
+    }
+    if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+      if (_high_surrogate == 0)
+        return false;
+      code_point = 0x10000 + ((_high_surrogate - 0xD800) << 10) +
+                   (code_point - 0xDC00);
+    } else if (_high_surrogate != 0) {
+      return false;
+    }
+    _high_surrogate = 0;
+    append_utf8(code_point);
+    return true;
+  }
+
+  void append_utf8(uint32_t cp) {
+    if (cp < 0x80) {
+      _token.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+      _token.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+      _token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      _token.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+      _token.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      _token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+      _token.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+      _token.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+      _token.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      _token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+  }
+
+  Handler &_handler;
+  std::vector<char> _stack; // open containers, '{' or '['
+  std::string _token;
+  Expect _expect = Expect::Value;
+  Lexeme _lexeme = Lexeme::None;
+  bool _in_key = false;
+  bool _failed = false;
+  uint8_t _escape = 0;
+  uint32_t _code_unit = 0;
+  uint32_t _high_surrogate = 0;
+};
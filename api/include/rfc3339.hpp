@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Parses an RFC 3339 date-time ("2025-01-06T10:00:00+01:00",
+// "2025-01-06T09:00:00.250Z") or full-date ("2025-01-06", midnight UTC),
+// the two shapes Google uses for timed and all-day events. Fractions are
+// kept down to microseconds. No allocations, no locale, no exceptions.
+inline std::optional<std::chrono::system_clock::time_point>
+parse_rfc3339(std::string_view text) {
+  auto digits = [&](size_t pos, size_t len, int &out) {
+    if (pos + len > text.size())
+      return false;
+    int value = 0;
+    for (size_t i = pos; i < pos + len; ++i) {
+      if (text[i] < '0' || text[i] > '9')
+        return false;
+      value = value * 10 + (text[i] - '0');
+    }
+    out = value;
+    return true;
+  };
+
+  int y, mo, d;
+  if (!digits(0, 4, y) || !digits(5, 2, mo) || !digits(8, 2, d) ||
+      text[4] != '-' || text[7] != '-')
+    return std::nullopt;
+  std::chrono::year_month_day date{
+      std::chrono::year(y), std::chrono::month(static_cast<unsigned>(mo)),
+      std::chrono::day(static_cast<unsigned>(d))};
+  if (!date.ok())
+    return std::nullopt;
+  std::chrono::system_clock::time_point time_p = std::chrono::sys_days(date);
+  if (text.size() == 10)
+    return time_p;
+
+  int h, mi, s;
+  if (text[10] != 'T' && text[10] != 't' && text[10] != ' ')
+    return std::nullopt;
+  if (!digits(11, 2, h) || !digits(14, 2, mi) || !digits(17, 2, s) ||
+      text[13] != ':' || text[16] != ':')
+    return std::nullopt;
+  // 60 is a leap second, it rolls over like the clock does
+  if (h > 23 || mi > 59 || s > 60)
+    return std::nullopt;
+  time_p += std::chrono::hours(h) + std::chrono::minutes(mi) +
+            std::chrono::seconds(s);
+
+  size_t pos = 19;
+  if (pos < text.size() && text[pos] == '.') {
+    int64_t us = 0;
+    size_t count = 0;
+    while (++pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+      if (count++ < 6)
+        us = us * 10 + (text[pos] - '0');
+    }
+    if (count == 0)
+      return std::nullopt;
+    for (; count < 6; ++count)
+      us *= 10;
+    time_p += std::chrono::microseconds(us);
+  }
+
+  std::string_view zone = text.substr(pos);
+  if (zone == "Z" || zone == "z")
+    return time_p;
+  int oh, om;
+  if (zone.size() != 6 || (zone[0] != '+' && zone[0] != '-') ||
+      !digits(pos + 1, 2, oh) || zone[3] != ':' || !digits(pos + 4, 2, om) ||
+      oh > 23 || om > 59)
+    return std::nullopt;
+  // local time = UTC + offset
+  auto offset = std::chrono::hours(oh) + std::chrono::minutes(om);
+  return zone[0] == '+' ? time_p - offset : time_p + offset;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cpr {
+class Session;
+}
+
+// Idle cpr::Sessions kept for reuse. A session owns a curl handle, and with
+// it the handle's open keep-alive connections, so a reused one skips the
+// TCP and TLS handshakes. Safe to share between threads; a session itself
+// is only ever used by the thread holding its lease.
+class SessionPool {
+public:
+  class Lease {
+  public:
+    Lease(SessionPool &pool, std::unique_ptr<cpr::Session> session);
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+    ~Lease();
+
+    inline cpr::Session &operator*() const { return *_session; }
+    inline cpr::Session *operator->() const { return _session.get(); }
+
+  private:
+    SessionPool &_pool;
+    std::unique_ptr<cpr::Session> _session;
+  };
+
+  // At most `max_idle` sessions are kept between requests, more can be
+  // leased at once.
+  explicit SessionPool(size_t max_idle = 8);
+  ~SessionPool();
+
+  Lease acquire();
+
+private:
+  void release(std::unique_ptr<cpr::Session> session);
+
+  std::mutex _mutex;
+  std::vector<std::unique_ptr<cpr::Session>> _idle;
+  size_t _max_idle;
+};
@@ -0,0 +1,93 @@
+#include "events_decoder.hpp"
+#include "rfc3339.hpp"
+
+bool EventsPageDecoder::start_object() {
+  if (_in_items && _depth == 2) {
+    _item = ApiEvent{};
+  } else if (_in_items && _depth == 3 &&
+             (_item_key == Field::Start || _item_key == Field::End)) {
+    _time_object = _item_key;
+    _time_key = Field::None;
+  }
+  ++_depth;
+  return true;
+}
+
+bool EventsPageDecoder::end_object() {
+  --_depth;
+  if (_in_items && _depth == 2) {
+    _page.items.push_back(std::move(_item));
+  } else if (_depth == 3) {
+    _time_object = Field::None;
+  }
+  return true;
+}
+
+bool EventsPageDecoder::start_array() {
+  if (_depth == 1 && _top_key == Field::Items)
+    _in_items = true;
+  ++_depth;
+  return true;
+}
+
+bool EventsPageDecoder::end_array() {
+  if (--_depth == 1)
+    _in_items = false;
+  return true;
+}
+
+bool EventsPageDecoder::key(std::string &name) {
+  if (_depth == 1) {
+    _top_key = name == "items"           ? Field::Items
+               : name == "nextPageToken" ? Field::NextPageToken
+               : name == "nextSyncToken" ? Field::NextSyncToken
+                                         : Field::None;
+  } else if (_in_items && _depth == 3) {
+    _item_key = name == "id"            ? Field::Id
+                : name == "status"      ? Field::Status
+                : name == "summary"     ? Field::Summary
+                : name == "description" ? Field::Description
+                : name == "start"       ? Field::Start
+                : name == "end"         ? Field::End
+                                        : Field::None;
+  } else if (_depth == 4 && _time_object != Field::None) {
+    _time_key = name == "dateTime" ? Field::DateTime
+                : name == "date"   ? Field::Date
+                                   : Field::None;
+  }
+  return true;
+}
+
+bool EventsPageDecoder::string(std::string &value) {
+  if (_depth == 1) {
+    if (_top_key == Field::NextPageToken)
+      _page.next_page_token = std::move(value);
+    else if (_top_key == Field::NextSyncToken)
+      _page.next_sync_token = std::move(value);
+  } else if (_in_items && _depth == 3) {
+    switch (_item_key) {
+    case Field::Id:
+      _item.id = std::move(value);
+      break;
+    case Field::Status:
+      _item.cancelled = value == "cancelled";
+      break;
+    case Field::Summary:
+      _item.summary = std::move(value);
+      break;
+    case Field::Description:
+      _item.description = std::move(value);
+      break;
+    default:
+      break;
+    }
+  } else if (_depth == 4 && _time_object != Field::None &&
+             _time_key != Field::None) {
+    // parsed right off the scratch buffer, no string is kept
+    auto time_p = parse_rfc3339(value);
+    if (_time_key == Field::Date)
+      _item.all_day = true;
+    (_time_object == Field::Start ? _item.start : _item.end) = time_p;
+  }
+  return true;
+}
@@ -1,14 +1,74 @@
 #include "gcal_api.hpp"
+#include "events_decoder.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
 #include <chrono>
 #include <cpr/cpr.h>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <random>
+#include <thread>
 
 using json = nlohmann::json;
+namespace trace = task_manager::trace;
 
-GoogleCalendarAPI::GoogleCalendarAPI(const std::string &secret_path)
-    : _secret_file_path(secret_path) {
+namespace {
+
+bool is_retryable(const cpr::Response &r) {
+  // 0: the request never got an answer (refused, reset, timed out)
+  return r.status_code == 0 || r.status_code == 429 ||
+         r.status_code == 500 || r.status_code == 502 ||
+         r.status_code == 503 || r.status_code == 504;
+}
+
+// Exponential backoff with jitter, unless the server said how long to wait
+std::chrono::milliseconds retry_delay(const RetryPolicy &retry, int attempt,
+                                      const cpr::Response &r) {
+  auto it = r.header.find("Retry-After");
+  if (it != r.header.end()) {
+    long seconds = 0;
+    const std::string &value = it->second;
+    auto [ptr, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), seconds);
+    if (ec == std::errc() && seconds >= 0)
+      return std::min(std::chrono::milliseconds(std::chrono::seconds(seconds)),
+                      retry.max_delay);
+  }
+  auto delay = std::min(retry.base_delay * (1 << std::min(attempt - 1, 16)),
+                        retry.max_delay);
+  // somewhere in [delay / 2, delay], so parallel workers don't retry in step
+  thread_local std::minstd_rand rng(std::random_device{}());
+  std::uniform_int_distribution<long> jitter(0, delay.count() / 2);
+  return delay - std::chrono::milliseconds(jitter(rng));
+}
+
+std::string escape_path_segment(const std::string &segment) {
+  // calendar ids are e-mail like and may contain '#'
+  std::string escaped;
+  for (unsigned char c : segment) {
+    if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~' ||
+        c == '@') {
+      escaped.push_back(static_cast<char>(c));
+    } else {
+      escaped += std::format("%{:02X}", c);
+    }
+  }
+  return escaped;
+}
+
+} // namespace
+
+GoogleCalendarAPI::GoogleCalendarAPI(const std::string &secret_path,
+                                     GoogleApiEndpoints endpoints,
+                                     RetryPolicy retry,
+                                     std::string token_path)
+    : _endpoints(std::move(endpoints)), _retry(retry),
+      _secret_file_path(secret_path), _token_file_path(std::move(token_path)) {
   load_secrets();
   load_tokens_from_file();
 }
@@ -36,6 +96,12 @@ bool GoogleCalendarAPI::load_tokens_from_file() {
   return !_refresh_token.empty();
 }
 
+std::string GoogleCalendarAPI::access_token() const {
+  std::shared_lock lock(_token_mutex);
+  return _access_token;
+}
+
+// with _token_mutex held
 void GoogleCalendarAPI::save_tokens_to_file() {
   json tokens = {{"access_token", _access_token},
                  {"refresh_token", _refresh_token}};
@@ -46,7 +112,7 @@ void GoogleCalendarAPI::save_tokens_to_file() {
 bool GoogleCalendarAPI::get_tokens_from_auth_code(
     const std::string &auth_code) {
   cpr::Response r =
-      cpr::Post(cpr::Url{"https://oauth2.googleapis.com/token"},
+      cpr::Post(cpr::Url{_endpoints.token_url},
                 cpr::Payload{{"client_id", _client_id},
                              {"client_secret", _client_secret},
                              {"code", auth_code},
@@ -57,6 +123,7 @@ bool GoogleCalendarAPI::get_tokens_from_auth_code(
     return false;
   }
   json result = json::parse(r.text);
+  std::unique_lock lock(_token_mutex);
   _access_token = result["access_token"];
   _refresh_token = result["refresh_token"];
   save_tokens_to_file();
@@ -91,22 +158,34 @@ bool GoogleCalendarAPI::authenticate() {
   return false;
 }
 
-bool GoogleCalendarAPI::refresh_access_token() {
-  if (_refresh_token.empty()) {
+bool GoogleCalendarAPI::refresh_access_token(const std::string &rejected) {
+  trace::Span span("refresh token", "gcal");
+  // one refresh at a time, the threads queued behind it reuse its token
+  std::lock_guard refresh_lock(_refresh_mutex);
+  std::string refresh_token;
+  {
+    std::shared_lock lock(_token_mutex);
+    if (!_access_token.empty() && _access_token != rejected)
+      return true;
+    refresh_token = _refresh_token;
+  }
+
+  if (refresh_token.empty()) {
     std::cerr << "No refresh token available. Please authenticate again."
               << std::endl;
     return false;
   }
-  cpr::Response r = cpr::Post(cpr::Url{"https://oauth2.googleapis.com/token"},
+  cpr::Response r = cpr::Post(cpr::Url{_endpoints.token_url},
                               cpr::Payload{{"client_id", _client_id},
                                            {"client_secret", _client_secret},
-                                           {"refresh_token", _refresh_token},
+                                           {"refresh_token", refresh_token},
                                            {"grant_type", "refresh_token"}});
   if (r.status_code != 200) {
     std::cerr << "Error refreshing access token: " << r.text << std::endl;
     return false;
   }
   json result = json::parse(r.text);
+  std::unique_lock lock(_token_mutex);
   _access_token = result["access_token"];
   // Note: A new refresh token is sometimes returned, but often not.
   // It's good practice to save the new one if it exists.
@@ -118,38 +197,86 @@ bool GoogleCalendarAPI::refresh_access_token() {
   return true;
 }
 
-std::optional<json> GoogleCalendarAPI::make_authenticated_get_request(
+PageStatus GoogleCalendarAPI::get_events_page(
     const std::string &url,
-    const std::vector<std::pair<std::string, std::string>> &params) {
-  auto send_request = [&]() {
-    cpr::Parameters cpr_params;
-    for (const auto &p : params) {
-      cpr_params.Add({p.first, p.second});
-    }
-    return cpr::Get(cpr::Url{url}, cpr_params,
-                    cpr::Header{{"Authorization", "Bearer " + _access_token}});
+    const std::vector<std::pair<std::string, std::string>> &params,
+    EventPage &page) {
+  trace::Span span("events page", "gcal");
+  // the start of the body, for error messages
+  constexpr size_t error_excerpt = 4096;
+  std::string excerpt;
+  bool decoded = false;
+
+  cpr::Parameters cpr_params;
+  for (const auto &p : params) {
+    cpr_params.Add({p.first, p.second});
+  }
+
+  auto send_request = [&](const std::string &token) {
+    trace::Span request_span("GET", "http");
+    // a retry starts over, drop whatever the last attempt decoded
+    page.items.clear();
+    page.next_page_token.clear();
+    page.next_sync_token.clear();
+    excerpt.clear();
+    EventsPageDecoder decoder(page);
+    bool ok = true;
+
+    auto session = _sessions.acquire();
+    session->SetUrl(cpr::Url{url});
+    session->SetParameters(cpr_params);
+    session->SetHeader(cpr::Header{{"Authorization", "Bearer " + token}});
+    session->SetWriteCallback(
+        cpr::WriteCallback{[&](std::string_view data, intptr_t) {
+          if (excerpt.size() < error_excerpt)
+            excerpt.append(data.substr(
+                0, std::min(data.size(), error_excerpt - excerpt.size())));
+          // error bodies fail to decode too, keep reading for the excerpt
+          ok = ok && decoder.feed(data);
+          return true;
+        }});
+    auto r = session->Get();
+    decoded = ok && decoder.finish();
+    return r;
   };
 
-  auto r = send_request();
-  if (r.status_code == 401) { // 401 Unauthorized, token likely expired
-    std::cout << "Access token expired. Attempting to refresh..." << std::endl;
-    if (refresh_access_token()) {
-      r = send_request(); // Retry the request with the new token
+  cpr::Response r;
+  bool refreshed = false;
+  for (int attempt = 1;; ++attempt) {
+    std::string token = access_token();
+    r = send_request(token);
+    if (r.status_code == 401 && !refreshed) { // token likely expired
+      refreshed = true;
+      if (refresh_access_token(token))
+        continue; // doesn't count as an attempt
     }
+    if (!is_retryable(r) || attempt >= _retry.max_attempts)
+      break;
+    auto delay = retry_delay(_retry, attempt, r);
+    std::cerr << "Request failed with status " << r.status_code
+              << ", retrying in " << delay.count() << " ms" << std::endl;
+    trace::Span backoff_span("backoff", "gcal");
+    std::this_thread::sleep_for(delay);
   }
 
+  if (r.status_code == 410)
+    return PageStatus::Gone;
   if (r.status_code != 200) {
     std::cerr << "API request failed with status " << r.status_code << ": "
-              << r.text << std::endl;
-    return std::nullopt;
+              << (r.error ? r.error.message : excerpt) << std::endl;
+    return PageStatus::Failed;
   }
-
-  return json::parse(r.text);
+  if (!decoded) {
+    std::cerr << "Malformed events response: " << excerpt << std::endl;
+    return PageStatus::Failed;
+  }
+  span.set_arg(page.items.size());
+  return PageStatus::Ok;
 }
 
 std::optional<std::vector<ApiEvent>>
 GoogleCalendarAPI::list_events(int max_results) {
-  if (_access_token.empty() && !refresh_access_token()) {
+  if (access_token().empty() && !refresh_access_token("")) {
     std::cout << "Authentication required. Please run the 'gcal_login' command."
               << std::endl;
     return std::nullopt;
@@ -158,27 +285,83 @@ GoogleCalendarAPI::list_events(int max_results) {
   auto now = std::chrono::system_clock::now();
   auto time_str = std::format("{:%Y-%m-%dT%H:%M:%SZ}", now);
 
-  auto result_json = make_authenticated_get_request(
-      "https://www.googleapis.com/calendar/v3/calendars/primary/events",
-      {{"maxResults", std::to_string(max_results)},
-       {"orderBy", "startTime"},
-       {"singleEvents", "true"},
-       {"timeMin", time_str}});
-
-  if (!result_json) {
+  EventPage page;
+  auto status =
+      get_events_page(_endpoints.api_base + "/calendars/primary/events",
+                      {{"maxResults", std::to_string(max_results)},
+                       {"orderBy", "startTime"},
+                       {"singleEvents", "true"},
+                       {"timeMin", time_str}},
+                      page);
+  if (status != PageStatus::Ok) {
     return std::nullopt;
   }
+  return std::move(page.items);
+}
 
-  std::vector<ApiEvent> events;
-  for (const auto &item : (*result_json)["items"]) {
-    ApiEvent ev;
-    ev.id = item.value("id", "");
-    ev.summary = item.value("summary", "No Title");
-    ev.start_time =
-        item["start"].value("dateTime", item["start"].value("date", ""));
-    ev.end_time = item["end"].value("dateTime", item["end"].value("date", ""));
-    events.push_back(ev);
+PageStatus GoogleCalendarAPI::list_events_page(
+    const std::string &sync_token, const std::string &page_token,
+    EventPage &page, int page_size, const std::string &calendar_id) {
+  if (access_token().empty() && !refresh_access_token("")) {
+    std::cout << "Authentication required. Please run the 'gcal_login' command."
+              << std::endl;
+    return PageStatus::Failed;
   }
 
-  return events;
+  // expanded recurring events, the only shape the calendar can store.
+  // orderBy/timeMin can't be combined with sync tokens, so neither is used.
+  std::vector<std::pair<std::string, std::string>> params = {
+      {"maxResults", std::to_string(page_size)}, {"singleEvents", "true"}};
+  if (!sync_token.empty())
+    params.emplace_back("syncToken", sync_token);
+  if (!page_token.empty())
+    params.emplace_back("pageToken", page_token);
+
+  return get_events_page(_endpoints.api_base + "/calendars/" +
+                             escape_path_segment(calendar_id) + "/events",
+                         params, page);
+}
+
+std::vector<std::optional<std::vector<ApiEvent>>>
+GoogleCalendarAPI::list_calendars_events(
+    const std::vector<std::string> &calendar_ids, size_t concurrency) {
+  std::vector<std::optional<std::vector<ApiEvent>>> results(
+      calendar_ids.size());
+  if (calendar_ids.empty())
+    return results;
+  // workers pull calendars off a shared counter, each one pages through
+  // its calendar on its own pooled session
+  std::atomic<size_t> next{0};
+  auto work = [&]() {
+    EventPage page;
+    for (size_t i = next++; i < calendar_ids.size(); i = next++) {
+      std::vector<ApiEvent> events;
+      std::string page_token;
+      bool ok = true;
+      do {
+        if (list_events_page("", page_token, page, 250, calendar_ids[i]) !=
+            PageStatus::Ok) {
+          ok = false;
+          break;
+        }
+        std::move(page.items.begin(), page.items.end(),
+                  std::back_inserter(events));
+        page_token = page.next_page_token;
+      } while (!page_token.empty());
+      if (ok)
+        results[i] = std::move(events);
+    }
+  };
+
+  size_t workers = std::clamp<size_t>(concurrency, 1, calendar_ids.size());
+  std::vector<std::jthread> threads;
+  threads.reserve(workers - 1);
+  for (size_t i = 1; i < workers; ++i) {
+    threads.emplace_back([&work]() {
+      trace::name_thread("gcal worker");
+      work();
+    });
+  }
+  work(); // the caller is a worker too
+  return results;
 }
@@ -0,0 +1,243 @@
+#include "gcal_sync.hpp"
+#include "trace.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+
+using json = nlohmann::json;
+namespace trace = task_manager::trace;
+using task_manager::Event;
+using task_manager::OpStatus;
+
+namespace {
+
+std::optional<Event> to_event(const ApiEvent &item) {
+  if (!item.start || !item.end)
+    return std::nullopt;
+  Event event(item.summary, *item.start, *item.end);
+  event.set_description(item.description);
+  return event;
+}
+
+} // namespace
+
+GoogleCalendarSync::GoogleCalendarSync(GoogleCalendarAPI &api,
+                                       task_manager::Calendar &calendar,
+                                       std::optional<std::string> state_path)
+    : _api(api), _calendar(calendar) {
+  _state_path =
+      state_path
+          ? *state_path
+          : (std::filesystem::path(_api.token_file_path()).parent_path() /
+             "gcal_sync.json")
+                .string();
+  load_state();
+}
+
+bool GoogleCalendarSync::load_state() {
+  std::ifstream f(_state_path);
+  if (!f.is_open()) {
+    return false; // never synced, the first sync is a full one
+  }
+  try {
+    json state = json::parse(f);
+    _sync_token = state.value("sync_token", "");
+    _ids.clear();
+    json ids = state.value("ids", json::object());
+    for (const auto &[gcal_id, id] : ids.items())
+      _ids.emplace(gcal_id, id.get<uint32_t>());
+  } catch (const std::exception &e) {
+    std::cerr << "Ignoring broken sync state " << _state_path << ": "
+              << e.what() << std::endl;
+    _sync_token.clear();
+    _ids.clear();
+    return false;
+  }
+  return true;
+}
+
+bool GoogleCalendarSync::save_state() const {
+  json ids = json::object();
+  for (const auto &[gcal_id, id] : _ids)
+    ids[gcal_id] = id;
+  json state = {{"sync_token", _sync_token}, {"ids", std::move(ids)}};
+
+  // write and rename, a crash never leaves half a file behind
+  std::string tmp_path = _state_path + ".tmp";
+  {
+    std::ofstream o(tmp_path, std::ios::trunc);
+    if (!o.is_open()) {
+      std::cerr << "Error: Could not write " << tmp_path << std::endl;
+      return false;
+    }
+    o << state << std::endl;
+    if (!o)
+      return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, _state_path, ec);
+  if (ec) {
+    std::cerr << "Error saving sync state: " << ec.message() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void GoogleCalendarSync::reset() {
+  _sync_token.clear();
+  save_state();
+}
+
+PageStatus GoogleCalendarSync::fetch(const std::string &sync_token,
+                                     std::vector<ApiEvent> &items,
+                                     std::string &next_sync_token,
+                                     SyncStats &stats) {
+  trace::Span span("fetch pages", "gcal");
+  EventPage page;
+  std::string page_token;
+  do {
+    auto status = _api.list_events_page(sync_token, page_token, page);
+    if (status != PageStatus::Ok)
+      return status;
+    ++stats.pages;
+    items.insert(items.end(), std::make_move_iterator(page.items.begin()),
+                 std::make_move_iterator(page.items.end()));
+    page_token = page.next_page_token;
+    next_sync_token = page.next_sync_token;
+  } while (!page_token.empty());
+  return PageStatus::Ok;
+}
+
+std::optional<SyncStats> GoogleCalendarSync::sync() {
+  trace::Span span("gcal sync", "gcal");
+  SyncStats stats;
+  std::vector<ApiEvent> items;
+  std::string next_sync_token;
+
+  stats.full = _sync_token.empty();
+  auto status = fetch(_sync_token, items, next_sync_token, stats);
+  if (status == PageStatus::Gone) {
+    std::cout << "Sync token expired, listing every event again." << std::endl;
+    items.clear();
+    stats = SyncStats{};
+    stats.full = true;
+    status = fetch("", items, next_sync_token, stats);
+  }
+  if (status != PageStatus::Ok)
+    return std::nullopt;
+
+  // keep the old token when something failed, the next run fetches those
+  // changes again; the mapping is saved either way
+  if (reconcile(items, stats.full, stats))
+    _sync_token = next_sync_token;
+  save_state();
+  return stats;
+}
+
+bool GoogleCalendarSync::reconcile(const std::vector<ApiEvent> &items,
+                                   bool full, SyncStats &stats) {
+  trace::Span span("reconcile", "gcal");
+  span.set_arg(items.size());
+  // an event edited twice between pages shows up twice, the last one wins
+  std::unordered_map<std::string_view, size_t> latest;
+  latest.reserve(items.size());
+  for (size_t i = 0; i < items.size(); ++i)
+    latest[items[i].id] = i;
+
+  std::vector<uint32_t> removals;
+  std::vector<std::string> removal_keys;
+  std::vector<Event> updates;
+  std::vector<std::string> update_keys;
+  std::vector<Event> creations;
+  std::vector<std::string> creation_keys;
+
+  for (size_t i = 0; i < items.size(); ++i) {
+    const ApiEvent &item = items[i];
+    if (item.id.empty() || latest[item.id] != i)
+      continue;
+    auto mapped = _ids.find(item.id);
+    if (item.cancelled) {
+      if (mapped != _ids.end()) {
+        removals.push_back(mapped->second);
+        removal_keys.push_back(item.id);
+      }
+      continue;
+    }
+    auto event = to_event(item);
+    if (!event) {
+      std::cerr << "Skipping event " << item.id << ": unreadable times"
+                << std::endl;
+      ++stats.skipped;
+      continue;
+    }
+    if (mapped != _ids.end()) {
+      event->set_id(mapped->second);
+      updates.push_back(std::move(*event));
+      update_keys.push_back(item.id);
+    } else {
+      creations.push_back(std::move(*event));
+      creation_keys.push_back(item.id);
+    }
+  }
+
+  if (full) {
+    // a full listing is authoritative, whatever it lacks was deleted
+    std::unordered_set<std::string_view> listed;
+    listed.reserve(items.size());
+    for (const auto &item : items) {
+      if (!item.cancelled)
+        listed.insert(item.id);
+    }
+    for (const auto &[gcal_id, id] : _ids) {
+      if (!listed.contains(gcal_id)) {
+        removals.push_back(id);
+        removal_keys.push_back(gcal_id);
+      }
+    }
+  }
+
+  bool complete = true;
+  if (!removals.empty()) {
+    auto status = _calendar.remove_events(removals);
+    for (size_t i = 0; i < status.size(); ++i) {
+      if (status[i] == OpStatus::Failed) {
+        complete = false;
+        continue;
+      }
+      // NotFound: already removed locally, nothing left to mirror
+      stats.removed += status[i] == OpStatus::Ok;
+      _ids.erase(removal_keys[i]);
+    }
+  }
+
+  if (!updates.empty()) {
+    auto status = _calendar.update_events(updates);
+    for (size_t i = 0; i < status.size(); ++i) {
+      if (status[i] == OpStatus::Ok) {
+        ++stats.updated;
+      } else if (status[i] == OpStatus::NotFound) {
+        // removed locally, bring it back as the upstream copy
+        updates[i].set_id(0);
+        creations.push_back(std::move(updates[i]));
+        creation_keys.push_back(std::move(update_keys[i]));
+      } else {
+        complete = false;
+      }
+    }
+  }
+
+  if (!creations.empty()) {
+    auto status = _calendar.create_events(creations);
+    for (size_t i = 0; i < status.size(); ++i) {
+      if (status[i] != OpStatus::Ok) {
+        complete = false;
+        continue;
+      }
+      ++stats.created;
+      _ids[creation_keys[i]] = creations[i].get_id();
+    }
+  }
+  return complete;
+}
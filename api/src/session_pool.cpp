@@ -0,0 +1,31 @@
+#include "session_pool.hpp"
+#include <cpr/cpr.h>
+
+SessionPool::Lease::Lease(SessionPool &pool,
+                          std::unique_ptr<cpr::Session> session)
+    : _pool(pool), _session(std::move(session)) {}
+
+SessionPool::Lease::~Lease() { _pool.release(std::move(_session)); }
+
+SessionPool::SessionPool(size_t max_idle) : _max_idle(max_idle) {}
+
+SessionPool::~SessionPool() = default;
+
+SessionPool::Lease SessionPool::acquire() {
+  {
+    std::lock_guard lock(_mutex);
+    if (!_idle.empty()) {
+      auto session = std::move(_idle.back());
+      _idle.pop_back();
+      return Lease(*this, std::move(session));
+    }
+  }
+  return Lease(*this, std::make_unique<cpr::Session>());
+}
+
+void SessionPool::release(std::unique_ptr<cpr::Session> session) {
+  std::lock_guard lock(_mutex);
+  // most recently used first out, its connection is the likeliest alive
+  if (_idle.size() < _max_idle)
+    _idle.push_back(std::move(session));
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "event.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace task_manager::bench {
+
+// Deterministic synthetic calendar: `count` events over the two years
+// around `now`, 15 minutes to 4 hours long, so every benchmark sees a mix
+// of past, ongoing and future events. Ids are left to the DB.
+std::vector<Event> generate_events(size_t count, const time_point &now,
+                                   uint64_t seed = 42);
+
+// $TASK_MANAGER_BENCH_DIR (default ./bench_data), created if missing
+std::filesystem::path data_dir();
+
+// DB holding `count` generated events. Built on first use in data_dir()
+// and reused by later runs, generating millions of rows takes longer than
+// the benchmarks.
+std::string dataset_db(size_t count);
+
+// The same events as an iCalendar file, built on first use like the DBs.
+std::string dataset_ics(size_t count);
+
+// Private copy of dataset_db(count), for benchmarks that write.
+std::string scratch_db(size_t count);
+
+// Largest calendar the suite runs at, $TASK_MANAGER_BENCH_MAX_EVENTS
+// (default 1M; the sizes go from 1k up to 10M).
+size_t max_events();
+
+} // namespace task_manager::bench
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace task_manager::bench {
+
+// Minimal HTTP/1.1 server on 127.0.0.1 standing in for the Calendar API.
+// Every GET is answered with `body`, or by `handler` when replaying a
+// recorded exchange, every POST (token refresh) with a fresh access token,
+// after `latency` to play a remote host. Connections are kept alive, so the
+// number of accepted connections tells pooled and one-shot clients apart.
+class MockServer {
+public:
+  struct Reply {
+    int status = 200;
+    std::string body;
+    // sent in pieces of this many bytes with a pause in between, so the
+    // client reads them one by one; 0 sends it at once
+    size_t chunk = 0;
+  };
+  // GET target (path and query) -> reply, called from the worker threads
+  using Handler = std::function<Reply(std::string_view target)>;
+
+  MockServer(std::string body, std::chrono::microseconds latency = {});
+  explicit MockServer(Handler handler);
+  ~MockServer();
+  MockServer(const MockServer &) = delete;
+  MockServer &operator=(const MockServer &) = delete;
+
+  // false if the socket couldn't be set up
+  bool start();
+  inline uint16_t port() const { return this->_port; }
+  inline std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(this->_port);
+  }
+  inline uint64_t connections() const { return this->_connections.load(); }
+  inline uint64_t requests() const { return this->_requests.load(); }
+
+private:
+  void accept_loop();
+  void serve(int fd);
+
+  std::string _body;
+  Handler _handler;
+  std::chrono::microseconds _latency;
+  int _listen_fd = -1;
+  uint16_t _port = 0;
+  std::atomic<bool> _stopping{false};
+  std::atomic<uint64_t> _connections{0};
+  std::atomic<uint64_t> _requests{0};
+  std::thread _acceptor;
+  std::mutex _mutex; // guards _clients and _workers
+  std::vector<int> _clients;
+  std::vector<std::thread> _workers;
+};
+
+} // namespace task_manager::bench
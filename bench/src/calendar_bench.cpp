@@ -0,0 +1,239 @@
+#include "core.hpp"
+#include "dataset.hpp"
+#include "db.hpp"
+#include <benchmark/benchmark.h>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using namespace task_manager;
+
+namespace {
+
+// 1k, 10k, ... up to bench::max_events()
+void sizes(benchmark::internal::Benchmark *b) {
+  for (size_t n = 1000; n <= 10000000 && n <= bench::max_events(); n *= 10)
+    b->Arg(static_cast<int64_t>(n));
+}
+
+class NullBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return c; }
+  std::streamsize xsputn(const char *, std::streamsize n) override {
+    return n;
+  }
+};
+
+std::vector<uint32_t> resident_ids(const Calendar &calendar) {
+  return calendar.resident_ids();
+}
+
+void BM_LoadEventsFromDb(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  CalendarOptions options;
+  options.load_threads = 1;
+  for (auto _ : state) {
+    // the constructor is the load
+    Calendar calendar(storage, options);
+    benchmark::DoNotOptimize(calendar.resident_size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LoadEventsFromDb)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+// read-only connections over id ranges, 2nd arg is the thread count
+void BM_LoadEventsParallel(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  CalendarOptions options;
+  options.load_threads = static_cast<unsigned>(state.range(1));
+  for (auto _ : state) {
+    Calendar calendar(storage, options);
+    benchmark::DoNotOptimize(calendar.resident_size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LoadEventsParallel)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      for (size_t n = 100000; n <= 10000000 && n <= bench::max_events();
+           n *= 10) {
+        for (int64_t threads : {2, 4, 8})
+          b->Args({static_cast<int64_t>(n), threads});
+      }
+    })
+    ->Unit(benchmark::kMillisecond);
+
+// a clean shutdown's snapshot, mapped and copied column to column
+void BM_LoadEventsFromSnapshot(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  CalendarOptions options;
+  options.load_threads = 1;
+  options.snapshot_path =
+      (bench::data_dir() /
+       ("events_" + std::to_string(state.range(0)) + ".snapshot"))
+          .string();
+  if (!Calendar(storage, options).save_snapshot()) {
+    state.SkipWithError("snapshot not written");
+    return;
+  }
+  for (auto _ : state) {
+    Calendar calendar(storage, options);
+    benchmark::DoNotOptimize(calendar.resident_size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LoadEventsFromSnapshot)
+    ->Apply(sizes)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_UpdateOngoingIncremental(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  Calendar calendar(storage);
+  auto time_p = std::chrono::system_clock::now();
+  for (auto _ : state) {
+    // a tick a minute, only the events crossing a boundary are touched
+    time_p += std::chrono::minutes(1);
+    benchmark::DoNotOptimize(calendar.update_ongoing_events(false, time_p));
+  }
+}
+BENCHMARK(BM_UpdateOngoingIncremental)->Apply(sizes);
+
+void BM_UpdateOngoingClear(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  Calendar calendar(storage);
+  auto time_p = std::chrono::system_clock::now();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calendar.update_ongoing_events(true, time_p));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_UpdateOngoingClear)
+    ->Apply(sizes)
+    ->Unit(benchmark::kMillisecond);
+
+void create_events(benchmark::State &state, bool write_behind) {
+  auto storage = init_storage(bench::scratch_db(state.range(0)));
+  Calendar calendar(storage);
+  if (write_behind)
+    calendar.enable_write_behind();
+  auto now = std::chrono::system_clock::now();
+  for (auto _ : state) {
+    Event event("benchmark", now, now + std::chrono::hours(1));
+    benchmark::DoNotOptimize(calendar.create_event(event));
+  }
+  // the queue drains outside the timed loop, it isn't what's measured
+  calendar.flush();
+}
+
+void BM_CreateEvent(benchmark::State &state) { create_events(state, false); }
+BENCHMARK(BM_CreateEvent)->Apply(sizes);
+
+void BM_CreateEventWriteBehind(benchmark::State &state) {
+  create_events(state, true);
+}
+BENCHMARK(BM_CreateEventWriteBehind)->Apply(sizes);
+
+void BM_UpdateEventById(benchmark::State &state) {
+  auto storage = init_storage(bench::scratch_db(state.range(0)));
+  Calendar calendar(storage);
+  auto ids = resident_ids(calendar);
+  size_t i = 0;
+  for (auto _ : state) {
+    uint32_t id = ids[i++ % ids.size()];
+    benchmark::DoNotOptimize(
+        calendar.update_event_by_id(id, i % 2 ? "renamed" : "named", ""));
+  }
+}
+BENCHMARK(BM_UpdateEventById)->Apply(sizes);
+
+void BM_RemoveEventById(benchmark::State &state) {
+  auto storage = init_storage(bench::scratch_db(state.range(0)));
+  Calendar calendar(storage);
+  auto ids = resident_ids(calendar);
+  auto now = std::chrono::system_clock::now();
+  size_t i = 0;
+  for (auto _ : state) {
+    if (i == ids.size()) {
+      // ran out, put the calendar back to its size
+      state.PauseTiming();
+      std::vector<Event> events = bench::generate_events(ids.size(), now, i);
+      calendar.create_events(events);
+      for (size_t k = 0; k < events.size(); ++k)
+        ids[k] = events[k].get_id();
+      i = 0;
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(calendar.remove_event_by_id(ids[i++]));
+  }
+}
+BENCHMARK(BM_RemoveEventById)->Apply(sizes);
+
+void BM_PrintCalendar(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  Calendar calendar(storage);
+  NullBuffer null;
+  std::ostream out(&null);
+  for (auto _ : state) {
+    out << calendar;
+  }
+  state.SetItemsProcessed(state.iterations() * calendar.resident_size());
+}
+BENCHMARK(BM_PrintCalendar)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+// first search over a fresh calendar, builds the text index
+void BM_SearchBuildIndex(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  for (auto _ : state) {
+    state.PauseTiming();
+    Calendar calendar(storage);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(calendar.search("retro"));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SearchBuildIndex)
+    ->Apply(sizes)
+    ->Unit(benchmark::kMillisecond);
+
+// a single event ("Retro 4247"), then every eighth one ("Retro")
+void BM_SearchSelective(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  Calendar calendar(storage);
+  calendar.search("retro");
+  for (auto _ : state)
+    benchmark::DoNotOptimize(calendar.search("retro 4247"));
+}
+BENCHMARK(BM_SearchSelective)->Apply(sizes);
+
+void BM_SearchCommonWord(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  Calendar calendar(storage);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(calendar.search("synthetic retro"));
+}
+BENCHMARK(BM_SearchCommonWord)->Apply(sizes);
+
+// a week around now, the dataset spreads events over two years
+void BM_FindConflicts(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  Calendar calendar(storage);
+  auto now = std::chrono::system_clock::now();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        calendar.find_conflicts(now, now + std::chrono::days(7)));
+  }
+}
+BENCHMARK(BM_FindConflicts)->Apply(sizes)->Unit(benchmark::kMicrosecond);
+
+void BM_FreeSlots(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  Calendar calendar(storage);
+  auto now = std::chrono::system_clock::now();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calendar.free_slots(
+        now, now + std::chrono::days(7), std::chrono::minutes(30)));
+  }
+}
+BENCHMARK(BM_FreeSlots)->Apply(sizes)->Unit(benchmark::kMicrosecond);
+
+} // namespace
@@ -0,0 +1,121 @@
+#include "dataset.hpp"
+#include "db.hpp"
+#include "ics.hpp"
+#include <array>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+namespace task_manager::bench {
+
+std::filesystem::path data_dir() {
+  const char *dir = std::getenv("TASK_MANAGER_BENCH_DIR");
+  std::filesystem::path path = dir ? dir : "bench_data";
+  std::filesystem::create_directories(path);
+  return path;
+}
+
+std::vector<Event> generate_events(size_t count, const time_point &now,
+                                   uint64_t seed) {
+  static constexpr std::array<const char *, 8> words = {
+      "Standup", "Review", "Lunch", "Planning",
+      "Gym",     "Call",   "Focus", "Retro"};
+  std::mt19937_64 rng(seed);
+  // minutes relative to now, one year either way
+  std::uniform_int_distribution<int64_t> offset(-365 * 24 * 60,
+                                                365 * 24 * 60);
+  std::uniform_int_distribution<int64_t> length(15, 4 * 60);
+
+  std::vector<Event> events;
+  events.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    auto start = now + std::chrono::minutes(offset(rng));
+    auto end = start + std::chrono::minutes(length(rng));
+    Event event(std::string(words[i % words.size()]) + " " +
+                    std::to_string(i),
+                start, end);
+    event.set_description("synthetic event");
+    events.push_back(std::move(event));
+  }
+  return events;
+}
+
+std::string dataset_db(size_t count) {
+  auto path = data_dir() / ("events_" + std::to_string(count) + ".db");
+  if (std::filesystem::exists(path))
+    return path.string();
+
+  std::cerr << "Generating " << count << " events into " << path << "..."
+            << std::endl;
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  std::filesystem::remove(tmp_path);
+  {
+    auto storage = init_storage(tmp_path.string());
+    storage.sync_schema();
+    auto now = std::chrono::system_clock::now();
+    // in slices, 10M events don't need to sit in memory at once
+    constexpr size_t slice = 100000;
+    for (size_t done = 0; done < count; done += slice) {
+      auto events = generate_events(std::min(slice, count - done), now,
+                                    42 + done / slice);
+      storage.transaction([&]() {
+        auto statement = storage.prepare(insert(events.front()));
+        for (auto &event : events) {
+          get<0>(statement) = event;
+          storage.execute(statement);
+        }
+        return true;
+      });
+    }
+  }
+  // only complete datasets get the final name
+  std::filesystem::rename(tmp_path, path);
+  return path.string();
+}
+
+std::string dataset_ics(size_t count) {
+  auto path = data_dir() / ("events_" + std::to_string(count) + ".ics");
+  if (std::filesystem::exists(path))
+    return path.string();
+
+  std::cerr << "Generating " << count << " events into " << path << "..."
+            << std::endl;
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    IcsWriter writer(out);
+    auto now = std::chrono::system_clock::now();
+    constexpr size_t slice = 100000;
+    for (size_t done = 0; done < count; done += slice) {
+      auto events = generate_events(std::min(slice, count - done), now,
+                                    42 + done / slice);
+      for (size_t i = 0; i < events.size(); ++i) {
+        const Event &event = events[i];
+        writer.write(static_cast<uint32_t>(done + i + 1), event._start_db,
+                     event._end_db, event.get_name(),
+                     event.get_description());
+      }
+    }
+  }
+  std::filesystem::rename(tmp_path, path);
+  return path.string();
+}
+
+std::string scratch_db(size_t count) {
+  auto path = data_dir() / ("scratch_" + std::to_string(count) + ".db");
+  std::filesystem::copy_file(dataset_db(count), path,
+                             std::filesystem::copy_options::overwrite_existing);
+  return path.string();
+}
+
+size_t max_events() {
+  if (const char *max = std::getenv("TASK_MANAGER_BENCH_MAX_EVENTS"))
+    return std::stoull(max);
+  return 1000000;
+}
+
+} // namespace task_manager::bench
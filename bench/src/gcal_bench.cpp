@@ -0,0 +1,141 @@
+#include "dataset.hpp"
+#include "gcal_api.hpp"
+#include "mock_server.hpp"
+#include <benchmark/benchmark.h>
+#include <cpr/cpr.h>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <nlohmann/json.hpp>
+
+using namespace task_manager;
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr int page_size = 250;
+
+std::string events_page_body(int count) {
+  std::string body = "{\"kind\": \"calendar#events\", \"items\": [";
+  for (int i = 0; i < count; ++i) {
+    body += std::format(
+        "{}{{\"id\": \"evt{}\", \"status\": \"confirmed\", "
+        "\"summary\": \"Event {}\", \"description\": \"Synthetic\", "
+        "\"start\": {{\"dateTime\": \"2025-01-06T10:00:00+01:00\"}}, "
+        "\"end\": {{\"dateTime\": \"2025-01-06T11:30:00+01:00\"}}}}",
+        i == 0 ? "" : ", ", i, i);
+  }
+  body += "], \"nextSyncToken\": \"bench\"}";
+  return body;
+}
+
+// Credentials the mock accepts, kept away from the user's gcal_token.json
+struct BenchCredentials {
+  std::string secret_path;
+  std::string token_path;
+
+  BenchCredentials() {
+    fs::path dir = bench::data_dir();
+    secret_path = (dir / "gcal_secret.json").string();
+    token_path = (dir / "gcal_token.json").string();
+    std::ofstream(secret_path) << R"({"installed": {"client_id": "bench",)"
+                                  R"( "client_secret": "bench"}})";
+    std::ofstream(token_path)
+        << R"({"access_token": "bench", "refresh_token": "bench"})";
+  }
+};
+
+const BenchCredentials &credentials() {
+  static BenchCredentials credentials;
+  return credentials;
+}
+
+std::unique_ptr<GoogleCalendarAPI> api_for(const bench::MockServer &server) {
+  return std::make_unique<GoogleCalendarAPI>(
+      credentials().secret_path,
+      GoogleApiEndpoints{server.url(), server.url() + "/token"},
+      RetryPolicy{}, credentials().token_path);
+}
+
+void report(benchmark::State &state, const bench::MockServer &server) {
+  state.counters["connections"] = static_cast<double>(server.connections());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The way pages were fetched before the pool: a new cpr::Get, and so a new
+// connection, per request and the body parsed once it's complete.
+void BM_EventsPageOneShot(benchmark::State &state) {
+  bench::MockServer server(events_page_body(static_cast<int>(state.range(0))),
+                           std::chrono::microseconds(state.range(1)));
+  if (!server.start()) {
+    state.SkipWithError("mock server didn't start");
+    return;
+  }
+  std::string url = server.url() + "/calendars/primary/events";
+  for (auto _ : state) {
+    cpr::Response r = cpr::Get(cpr::Url{url},
+                               cpr::Header{{"Authorization", "Bearer bench"}},
+                               cpr::Parameters{{"singleEvents", "true"}});
+    auto result = nlohmann::json::parse(r.text);
+    benchmark::DoNotOptimize(result["items"].size());
+  }
+  report(state, server);
+}
+BENCHMARK(BM_EventsPageOneShot)
+    ->ArgsProduct({{10, page_size}, {0, 2000}})
+    ->ArgNames({"items", "latency_us"})
+    ->UseRealTime();
+
+void BM_EventsPagePooled(benchmark::State &state) {
+  bench::MockServer server(events_page_body(static_cast<int>(state.range(0))),
+                           std::chrono::microseconds(state.range(1)));
+  if (!server.start()) {
+    state.SkipWithError("mock server didn't start");
+    return;
+  }
+  auto api = api_for(server);
+  for (auto _ : state) {
+    EventPage page;
+    if (api->list_events_page("", "", page, page_size) != PageStatus::Ok) {
+      state.SkipWithError("events page request failed");
+      break;
+    }
+    benchmark::DoNotOptimize(page.items.size());
+  }
+  report(state, server);
+}
+BENCHMARK(BM_EventsPagePooled)
+    ->ArgsProduct({{10, page_size}, {0, 2000}})
+    ->ArgNames({"items", "latency_us"})
+    ->UseRealTime();
+
+// 16 calendars of one page each behind a 2 ms round trip, fetched with
+// 1 to 16 workers
+void BM_CalendarsEvents(benchmark::State &state) {
+  bench::MockServer server(events_page_body(page_size),
+                           std::chrono::milliseconds(2));
+  if (!server.start()) {
+    state.SkipWithError("mock server didn't start");
+    return;
+  }
+  auto api = api_for(server);
+  std::vector<std::string> ids;
+  for (int i = 0; i < 16; ++i)
+    ids.push_back(std::format("calendar{}@group.calendar.google.com", i));
+  for (auto _ : state) {
+    auto results =
+        api->list_calendars_events(ids, static_cast<size_t>(state.range(0)));
+    benchmark::DoNotOptimize(results.data());
+  }
+  state.counters["connections"] = static_cast<double>(server.connections());
+  state.SetItemsProcessed(state.iterations() * ids.size() * page_size);
+}
+BENCHMARK(BM_CalendarsEvents)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->ArgName("concurrency")
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
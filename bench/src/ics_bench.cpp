@@ -0,0 +1,61 @@
+#include "core.hpp"
+#include "dataset.hpp"
+#include "db.hpp"
+#include "ics.hpp"
+#include <benchmark/benchmark.h>
+#include <filesystem>
+
+using namespace task_manager;
+
+namespace {
+
+// 1k, 10k, ... up to bench::max_events()
+void sizes(benchmark::internal::Benchmark *b) {
+  for (size_t n = 1000; n <= 10000000 && n <= bench::max_events(); n *= 10)
+    b->Arg(static_cast<int64_t>(n));
+}
+
+// mapping, unfolding, unescaping and time parsing, nothing is stored
+void BM_IcsParse(benchmark::State &state) {
+  std::string path = bench::dataset_ics(state.range(0));
+  auto bytes = static_cast<int64_t>(std::filesystem::file_size(path));
+  for (auto _ : state) {
+    auto reader = IcsReader::open(path);
+    IcsEvent event;
+    while (reader->next(event))
+      benchmark::DoNotOptimize(event.start_us);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_IcsParse)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+// parse plus the batched inserts, into an empty calendar every time
+void BM_IcsImport(benchmark::State &state) {
+  std::string path = bench::dataset_ics(state.range(0));
+  auto db_path = bench::data_dir() / "import.db";
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::filesystem::remove(db_path);
+    auto storage = init_storage(db_path.string());
+    Calendar calendar(storage);
+    state.ResumeTiming();
+    auto result = import_ics(calendar, path);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IcsImport)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+void BM_IcsExport(benchmark::State &state) {
+  auto storage = init_storage(bench::dataset_db(state.range(0)));
+  Calendar calendar(storage);
+  auto path = bench::data_dir() / "export.ics";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(export_ics(calendar, path.string()));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IcsExport)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+} // namespace
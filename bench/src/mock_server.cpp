@@ -0,0 +1,183 @@
+#include "mock_server.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+namespace task_manager::bench {
+
+namespace {
+
+bool send_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data.remove_prefix(static_cast<size_t>(n));
+  }
+  return true;
+}
+
+size_t content_length(std::string_view head) {
+  // header names are case-insensitive, curl sends "Content-Length"
+  for (std::string_view name : {"Content-Length:", "content-length:"}) {
+    size_t pos = head.find(name);
+    if (pos != std::string_view::npos)
+      return std::strtoul(head.data() + pos + name.size(), nullptr, 10);
+  }
+  return 0;
+}
+
+std::string response(std::string_view body, int status = 200) {
+  std::string out = "HTTP/1.1 " + std::to_string(status) +
+                    (status == 200 ? " OK" : " Error") +
+                    "\r\n"
+                    "Content-Type: application/json; charset=UTF-8\r\n"
+                    "Connection: keep-alive\r\n"
+                    "Content-Length: ";
+  out += std::to_string(body.size());
+  out += "\r\n\r\n";
+  out += body;
+  return out;
+}
+
+} // namespace
+
+MockServer::MockServer(std::string body, std::chrono::microseconds latency)
+    : _body(response(body)), _latency(latency) {}
+
+MockServer::MockServer(Handler handler)
+    : _handler(std::move(handler)), _latency(0) {}
+
+MockServer::~MockServer() {
+  this->_stopping = true;
+  if (this->_listen_fd >= 0)
+    ::shutdown(this->_listen_fd, SHUT_RDWR);
+  if (this->_acceptor.joinable())
+    this->_acceptor.join();
+  {
+    std::lock_guard lock(this->_mutex);
+    for (int fd : this->_clients)
+      ::shutdown(fd, SHUT_RDWR);
+  }
+  // nothing is accepted anymore, _workers doesn't grow
+  for (auto &worker : this->_workers)
+    worker.join();
+  if (this->_listen_fd >= 0)
+    ::close(this->_listen_fd);
+}
+
+bool MockServer::start() {
+  this->_listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (this->_listen_fd < 0) {
+    std::cerr << "Mock server: socket() failed: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0; // any free port
+  socklen_t len = sizeof(addr);
+  if (::bind(this->_listen_fd, reinterpret_cast<sockaddr *>(&addr),
+             sizeof(addr)) < 0 ||
+      ::listen(this->_listen_fd, 128) < 0 ||
+      ::getsockname(this->_listen_fd, reinterpret_cast<sockaddr *>(&addr),
+                    &len) < 0) {
+    std::cerr << "Mock server: can't listen: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  this->_port = ntohs(addr.sin_port);
+  this->_acceptor = std::thread([this] { this->accept_loop(); });
+  return true;
+}
+
+void MockServer::accept_loop() {
+  while (!this->_stopping) {
+    int fd = ::accept4(this->_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      return; // shut down
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    this->_connections.fetch_add(1);
+    std::lock_guard lock(this->_mutex);
+    this->_clients.push_back(fd);
+    this->_workers.emplace_back([this, fd] { this->serve(fd); });
+  }
+}
+
+void MockServer::serve(int fd) {
+  std::string in;
+  char buf[16 * 1024];
+  while (!this->_stopping) {
+    size_t head_end = in.find("\r\n\r\n");
+    if (head_end == std::string::npos) {
+      ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      in.append(buf, static_cast<size_t>(n));
+      continue;
+    }
+    std::string_view head(in.data(), head_end);
+    size_t total = head_end + 4 + content_length(head);
+    if (in.size() < total) {
+      ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0)
+        break;
+      in.append(buf, static_cast<size_t>(n));
+      continue;
+    }
+
+    bool is_post = head.starts_with("POST");
+    // "GET <target> HTTP/1.1"
+    size_t target_start = head.find(' ') + 1;
+    std::string target(
+        head.substr(target_start, head.find(' ', target_start) - target_start));
+    in.erase(0, total);
+    this->_requests.fetch_add(1);
+    if (this->_latency.count() > 0)
+      std::this_thread::sleep_for(this->_latency);
+    bool sent = false;
+    if (is_post) {
+      sent = send_all(fd, response("{\"access_token\": \"bench\", "
+                                   "\"expires_in\": 3599}"));
+    } else if (this->_handler) {
+      Reply reply = this->_handler(target);
+      std::string out = response(reply.body, reply.status);
+      size_t chunk = reply.chunk ? reply.chunk : out.size();
+      sent = true;
+      for (size_t pos = 0; sent && pos < out.size(); pos += chunk) {
+        if (pos > 0)
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        sent = send_all(fd, std::string_view(out).substr(pos, chunk));
+      }
+    } else {
+      sent = send_all(fd, this->_body);
+    }
+    if (!sent)
+      break;
+  }
+
+  std::lock_guard lock(this->_mutex);
+  this->_clients.erase(
+      std::find(this->_clients.begin(), this->_clients.end(), fd));
+  ::close(fd);
+}
+
+} // namespace task_manager::bench
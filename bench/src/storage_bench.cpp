@@ -0,0 +1,83 @@
+#include "core.hpp"
+#include "dataset.hpp"
+#include "db.hpp"
+#include <benchmark/benchmark.h>
+
+using namespace task_manager;
+
+namespace {
+
+// the arg picks the profile: 0 SQLite's defaults, 1 the tuned one
+StorageProfile profile(const benchmark::State &state) {
+  return state.range(0) == 0 ? StorageProfile::legacy() : StorageProfile{};
+}
+
+void profiles(benchmark::internal::Benchmark *b) {
+  b->ArgName("tuned")->Arg(0)->Arg(1);
+}
+
+constexpr size_t calendar_size = 100000;
+
+// one synchronous transaction per event, where the journal mode and
+// synchronous setting show most
+void BM_StorageCreateEvent(benchmark::State &state) {
+  auto storage =
+      init_storage(bench::scratch_db(calendar_size), profile(state));
+  Calendar calendar(storage);
+  auto now = std::chrono::system_clock::now();
+  for (auto _ : state) {
+    Event event("benchmark", now, now + std::chrono::hours(1));
+    benchmark::DoNotOptimize(calendar.create_event(event));
+  }
+}
+BENCHMARK(BM_StorageCreateEvent)->Apply(profiles);
+
+void BM_StorageUpdateEvent(benchmark::State &state) {
+  auto storage =
+      init_storage(bench::scratch_db(calendar_size), profile(state));
+  Calendar calendar(storage);
+  std::vector<uint32_t> targets = calendar.resident_ids();
+  size_t i = 0;
+  for (auto _ : state) {
+    uint32_t id = targets[i++ % targets.size()];
+    benchmark::DoNotOptimize(
+        calendar.update_event_by_id(id, i % 2 ? "renamed" : "named", ""));
+  }
+}
+BENCHMARK(BM_StorageUpdateEvent)->Apply(profiles);
+
+// archive reads through the cached range statement, a different week each
+// time so the range cache never answers
+void BM_StorageArchivedRange(benchmark::State &state) {
+  auto storage =
+      init_storage(bench::dataset_db(calendar_size), profile(state));
+  CalendarOptions options;
+  options.resident_past = std::chrono::days(30);
+  Calendar calendar(storage, options);
+  auto from = std::chrono::system_clock::now() - std::chrono::days(360);
+  size_t found = 0;
+  for (auto _ : state) {
+    from += std::chrono::minutes(7);
+    auto events =
+        calendar.get_events_between(from, from + std::chrono::days(7));
+    found += events.size();
+  }
+  state.counters["events"] = benchmark::Counter(
+      static_cast<double>(found), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_StorageArchivedRange)->Apply(profiles);
+
+void BM_StorageLoad(benchmark::State &state) {
+  auto storage =
+      init_storage(bench::dataset_db(calendar_size), profile(state));
+  CalendarOptions options;
+  options.load_threads = 1;
+  for (auto _ : state) {
+    Calendar calendar(storage, options);
+    benchmark::DoNotOptimize(calendar.resident_size());
+  }
+  state.SetItemsProcessed(state.iterations() * calendar_size);
+}
+BENCHMARK(BM_StorageLoad)->Apply(profiles)->Unit(benchmark::kMillisecond);
+
+} // namespace
@@ -1,49 +1,450 @@
 #pragma once
+#include "change_feed.hpp"
 #include "db.hpp"
 #include "event.hpp"
+#include "event_format.hpp"
+#include "event_snapshot.hpp"
+#include "event_store.hpp"
+#include "flat_id_map.hpp"
+#include "interval_index.hpp"
+#include "lru_cache.hpp"
+#include "metrics.hpp"
+#include "scan_kernels.hpp"
+#include "snapshot.hpp"
+#include "text_index.hpp"
+#include "transition_queue.hpp"
+#include "write_behind.hpp"
+#include <charconv>
 #include <chrono>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace task_manager {
 using time_point = std::chrono::system_clock::time_point;
 
+struct CalendarOptions {
+  // Only events that ended less than this long before startup (plus every
+  // ongoing and future event) are loaded into memory. Older events stay in
+  // the DB and are fetched on demand by range queries. nullopt loads all.
+  std::optional<std::chrono::system_clock::duration> resident_past;
+  // Archived events kept around by id after an on-demand fetch
+  size_t archive_cache_events = 4096;
+  // Archived range query results kept around
+  size_t archive_cache_ranges = 64;
+  // Binary snapshot used for fast startup, written by save_snapshot()
+  std::optional<std::string> snapshot_path;
+  // Records kept by the change log, rounded up to a power of two
+  size_t change_log_capacity = 4096;
+  // Read-only connections the initial load reads the DB with, in parallel
+  // over id ranges. 0 uses every core, 1 loads through the storage alone.
+  unsigned load_threads = 0;
+  // Whether the CLI and the daemon call enable_write_behind(). Off unless
+  // asked for: a change is acknowledged before it is on disk.
+  bool write_behind = false;
+
+  // Setup shared by the CLI and the daemon: the user's snapshot file,
+  // TASK_MANAGER_RESIDENT_DAYS as the residency window,
+  // TASK_MANAGER_LOAD_THREADS and TASK_MANAGER_WRITE_BEHIND=1.
+  // A malformed or negative number is reported and left at the default.
+  static CalendarOptions from_env() {
+    CalendarOptions options;
+    if (auto days = env_count<uint32_t>("TASK_MANAGER_RESIDENT_DAYS")) {
+      options.resident_past = std::chrono::days(*days);
+    }
+    if (auto threads = env_count<unsigned>("TASK_MANAGER_LOAD_THREADS")) {
+      options.load_threads = *threads;
+    }
+    if (const char *write_behind = std::getenv("TASK_MANAGER_WRITE_BEHIND")) {
+      options.write_behind = std::string_view(write_behind) == "1";
+    }
+    options.snapshot_path = get_user_snapshot_path();
+    return options;
+  }
+
+private:
+  // Digits only, std::stoi and std::stoul take "-5", "7x" and " 3"
+  template <typename T> static std::optional<T> env_count(const char *name) {
+    const char *text = std::getenv(name);
+    if (!text)
+      return std::nullopt;
+    std::string_view value(text);
+    T parsed = 0;
+    auto [end, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), parsed);
+    if (ec != std::errc() || end != value.data() + value.size()) {
+      std::cerr << "Ignoring " << name << "='" << value
+                << "', expected a non-negative integer." << std::endl;
+      return std::nullopt;
+    }
+    return parsed;
+  }
+};
+
+enum class ListOrder : uint8_t { Start, End, Name, Id };
+
+// What Calendar::list() prints
+struct ListOptions {
+  // events overlapping [from, to], either end may be left open
+  std::optional<time_point> from, to;
+  size_t limit = std::numeric_limits<size_t>::max();
+  ListOrder order = ListOrder::Start;
+  bool descending = false;
+  ListFormat format = ListFormat::Text;
+};
+
+// What Calendar::search() returns
+struct SearchOptions {
+  // events overlapping [from, to], either end may be left open
+  std::optional<time_point> from, to;
+  size_t limit = 20;
+  // by start time instead of by relevance
+  bool by_start = false;
+};
+
+struct SearchHit {
+  Event event;
+  double score;
+};
+
+struct SearchResult {
+  // matches before the limit was applied
+  size_t total = 0;
+  std::vector<SearchHit> hits;
+};
+
+// Two events overlapping each other, see Calendar::find_conflicts()
+struct Conflict {
+  Event first, second; // `first` starts first
+  time_point start, end; // when they overlap
+};
+
+// A stretch of time without any event, see Calendar::free_slots()
+struct TimeSlot {
+  time_point start, end;
+};
+
+// Per-item result of the batched mutations
+enum class OpStatus : uint8_t {
+  Ok,
+  NotFound,
+  Failed,
+};
+
+// Thread safety: any number of readers alongside one writer at a time.
+// Mutations take _mutex exclusively. Queries on the resident events never
+// queue behind a write: they read the store with _mutex held shared when
+// it is free, and the last published snapshot while it isn't, so a reader
+// sees the state from before a write in flight. Everything returned is a
+// copy or a snapshot, never a view into the live store. Queries reaching
+// the DB take _mutex shared and do wait.
 class Calendar {
 public:
   using Storage = decltype(init_storage());
 
-  Calendar(Storage &storage) : _storage(storage) { load_events_from_db(); }
+  Calendar(Storage &storage, CalendarOptions options = {})
+      : _storage(storage), _options(options),
+        _archived_events(options.archive_cache_events),
+        _archived_ranges(options.archive_cache_ranges),
+        _changes(options.change_log_capacity) {
+    load_events_from_db();
+  }
   ~Calendar() = default;
 
+  // In write-behind mode mutations apply to the in-memory model right away
+  // and are committed in groups by a background thread. Ids of new events
+  // are then taken from blocks reserved in the DB (reserve_event_ids()), so
+  // other processes writing to it never get the same ones. A change that
+  // fails to commit is undone in memory by the next flush() or tick().
+  void enable_write_behind(WriteBehindOptions options = {});
+  void disable_write_behind();
+  inline bool write_behind_enabled() const {
+    std::shared_lock lock(this->_mutex);
+    return this->_write_behind != nullptr;
+  }
+  // Blocks until every queued mutation is committed, no-op otherwise.
+  // Returns false when some of them failed, those events are then reloaded
+  // from the DB.
+  bool flush();
+  // Writes the resident events to CalendarOptions::snapshot_path. Meant for
+  // clean shutdown: the next startup maps it instead of querying SQLite as
+  // long as the DB hasn't changed in between.
+  bool save_snapshot();
+
+  // Applies the start/end transitions that became due since the last tick
+  // and returns how many events changed state.
   int tick();
+  // Time of the next scheduled start/end boundary. Entries of moved or
+  // removed events are dropped lazily, so this may fire early but never late.
+  inline std::optional<time_point> next_transition() const {
+    std::shared_lock lock(this->_mutex);
+    return this->_transitions.next();
+  }
+  inline std::chrono::nanoseconds time_until_next_transition(
+      const time_point &time_p = std::chrono::system_clock::now()) const {
+    auto next = this->next_transition();
+    if (!next)
+      return std::chrono::nanoseconds::max();
+    if (*next <= time_p)
+      return std::chrono::nanoseconds::zero();
+    return *next - time_p;
+  }
   bool update_ongoing_events(
       bool clear = false,
       const time_point &time_p = std::chrono::system_clock::now());
-  inline const std::vector<std::shared_ptr<Event>> get_events() const {
-    return this->_all_events;
+  // Resident events only, see CalendarOptions::resident_past
+  size_t resident_size() const;
+  std::vector<uint32_t> resident_ids() const;
+  // Immutable copy of the resident events as of now. It stays valid across
+  // mutations, and taking one after a few changes only copies the pages
+  // they touched. Never waits for a writer, the previous snapshot is
+  // returned while one is busy.
+  std::shared_ptr<const EventSnapshot> snapshot() const;
+  // The resident queries below return copies. They use the index with
+  // _mutex held shared when that doesn't wait; while a write is in flight
+  // they scan the last published snapshot instead, see read().
+  //
+  // Ongoing events as of the last tick()/update_ongoing_events()
+  std::vector<Event> get_ongoing_events() const;
+  std::vector<Event> get_ongoing_events(const time_point &time_p) const;
+  // Resident events only
+  std::vector<Event> get_overlapping_events(const time_point &from,
+                                            const time_point &to) const;
+  // Like get_overlapping_events() but also reaches archived events when the
+  // range starts before the residency window, so the result is materialized.
+  std::vector<Event> get_events_between(const time_point &from,
+                                        const time_point &to) const;
+  // Brute-force scans over the time columns, see scan_kernels.hpp. They cost
+  // the same however many events match, so they beat the index for wide
+  // ranges ("how many events this week") over large calendars. Times are
+  // compared at microsecond resolution, the unit of the store.
+  //
+  // Also counts archived events when the range starts before the residency
+  // window, so unlike the others it always takes _mutex shared.
+  size_t count_overlapping(const time_point &from, const time_point &to) const;
+  // Resident events only, in storage order
+  std::vector<Event> select_overlapping(const time_point &from,
+                                        const time_point &to) const;
+  // Resident events only
+  scan::StateCounts classify(const time_point &time_p) const;
+  // Resident events only
+  std::vector<Event> get_past_events(const time_point &time_p) const;
+  std::vector<Event> get_future_events(
+      const time_point &time_p,
+      size_t limit = std::numeric_limits<size_t>::max()) const;
+  // Resident events only
+  std::optional<Event> find_event(uint32_t id) const;
+  // Falls back to the DB for events outside the residency window
+  std::optional<Event> get_event_by_id(uint32_t id) const;
+  // Every event that ended before the residency window, read from the DB in
+  // id order `page_size` rows at a time. Bypasses the archive caches, meant
+  // for full exports. Returns false on DB errors.
+  bool for_each_archived(const std::function<void(const Event &)> &fn,
+                         size_t page_size = 10000) const;
+  // Change log of every mutation and start/end transition since startup,
+  // see ChangeFeed. A consumer remembers the last seq it applied and polls
+  // changes_since() with it. When that returns false it missed changes: it
+  // reads last_change() first, then reloads through the queries or
+  // snapshot() and goes on from the seq it read.
+  // Replaying a change that is already reflected is harmless.
+  inline uint64_t last_change() const {
+    std::shared_lock lock(this->_mutex);
+    return this->_changes.last_seq();
+  }
+  inline bool
+  changes_since(uint64_t after, std::vector<Change> &out,
+                size_t limit = std::numeric_limits<size_t>::max()) const {
+    std::shared_lock lock(this->_mutex);
+    return this->_changes.read(after, out, limit);
+  }
+  inline std::optional<time_point> get_window_start() const {
+    std::shared_lock lock(this->_mutex);
+    return this->_window_start;
   }
   inline Storage &get_storage() { return this->_storage; }
   inline const Storage &get_storage() const { return this->_storage; }
   bool
   create_event(Event &event,
                const time_point &time_p = std::chrono::system_clock::now());
+  // Inserts every event in a single transaction and writes the assigned ids
+  // back into `events`.
+  std::vector<OpStatus>
+  create_events(std::span<Event> events,
+                const time_point &time_p = std::chrono::system_clock::now());
   bool update_event_by_id(uint32_t id, const std::string &name,
-                          const std::string &desc);
+                          const std::string &desc,
+                          const std::optional<time_point> &start = {},
+                          const std::optional<time_point> &end = {});
+  // Replaces name, description and interval of every event matched by id,
+  // in a single transaction.
+  std::vector<OpStatus> update_events(std::span<const Event> events);
   bool remove_event_by_id(u_int32_t id);
+  std::vector<OpStatus> remove_events(std::span<const uint32_t> ids);
+  std::vector<OpStatus> remove_events(std::span<const Event> events);
+  // Removes every listed event in a single transaction, returns how many
+  // were removed. Unknown ids are skipped.
+  size_t remove_events_by_ids(std::span<const uint32_t> ids);
+  // Streams the resident events selected by `options` to `out`, in chunks
+  // of OutputBuffer::chunk_size. Listing by ascending start walks the index
+  // and stops at the limit, the other orders sort the matching slots.
+  // Returns how many events were written.
+  size_t list(std::ostream &out, const ListOptions &options = {}) const;
+  // Every pair of events overlapping each other inside [from, to], in order
+  // of the start of the overlap. Events are taken as [start, end) here, one
+  // ending when the next starts is not a conflict. A sweep over the sorted
+  // start/end boundaries of the events in the range, O(n log n + pairs).
+  // Reaches archived events like get_events_between().
+  std::vector<Conflict> find_conflicts(const time_point &from,
+                                       const time_point &to) const;
+  // The gaps between the events inside [from, to) lasting at least
+  // `min_duration`, in order. Same sweep as find_conflicts().
+  std::vector<TimeSlot>
+  free_slots(const time_point &from, const time_point &to,
+             std::chrono::nanoseconds min_duration = {}) const;
+  // Resident events whose name or description contains every word of
+  // `query`, see TextIndex, best BM25 score first. The index is built on
+  // the first search and then kept current from the change log.
+  SearchResult search(std::string_view query,
+                      const SearchOptions &options = {}) const;
   friend std::ostream &operator<<(std::ostream &os, const Calendar &calendar);
 
 private:
+  // Unlocked bodies of the public calls, for use with _mutex already held
+  bool refresh_ongoing_events(bool clear, const time_point &time_p);
+  std::optional<Event> find_event_anywhere(uint32_t id) const;
+  std::vector<OpStatus> remove_events_locked(std::span<const uint32_t> ids);
+  // _mutex held exclusively for a mutation. Publishes a snapshot first when
+  // the store moved since the last one, so readers falling back to it
+  // during the write see the state right before it.
+  std::unique_lock<std::shared_mutex> write_lock();
+  std::shared_ptr<const EventSnapshot>
+  publish_snapshot(const std::shared_ptr<const EventSnapshot> &previous) const;
   bool load_event(Event &event,
                   const time_point &time_p = std::chrono::system_clock::now());
   void load_events_from_db();
-  bool save_event_in_db(std::shared_ptr<Event> &event_ptr);
-  bool update_event_in_db(std::shared_ptr<Event> &event_ptr);
-  bool remove_event_from_db(std::shared_ptr<Event> &event_ptr);
-  std::vector<std::shared_ptr<Event>> _past_events, _ongoing_events,
-      _future_events, _all_events;
+  bool load_events_parallel(const time_point &load_time_p);
+  bool load_events_from_snapshot(const time_point &load_time_p);
+  void clear_events(size_t expected);
+  void track_event(uint32_t slot, const time_point &time_p);
+  void schedule_transitions(uint32_t slot, const time_point &time_p);
+  void move_event(uint32_t slot, const time_point &start,
+                  const time_point &end);
+  bool set_ongoing(uint32_t slot, bool ongoing);
+  inline void record_transition(uint32_t slot, bool ongoing) {
+    metrics::add(metrics::Counter::Transitions);
+    this->_changes.append(ongoing ? ChangeKind::Started : ChangeKind::Ended,
+                          this->_store.id(slot));
+  }
+  std::vector<Event> to_events(const std::vector<uint32_t> &ids) const;
+  // Runs locked() with _mutex held shared, or published(snapshot) on the
+  // last published snapshot if that would wait for a writer.
+  template <typename Locked, typename Published>
+  auto read(Locked &&locked, Published &&published) const {
+    std::shared_lock lock(this->_mutex, std::try_to_lock);
+    if (lock.owns_lock())
+      return locked();
+    return published(*this->snapshot());
+  }
+  bool save_event_in_db(Event &event);
+  bool update_event_in_db(const Event &event);
+  bool remove_event_from_db(uint32_t id);
+  void save_events_in_db(std::span<Event> events,
+                         std::vector<OpStatus> &status);
+  void update_events_in_db(std::span<const Event> events,
+                           const std::vector<bool> &targets,
+                           std::vector<OpStatus> &status);
+  void remove_events_from_db(std::span<const uint32_t> ids,
+                             const std::vector<bool> &targets,
+                             std::vector<OpStatus> &status);
+  void rebuild_index();
+  size_t apply_transitions(const time_point &time_p);
+  void unload_event(uint32_t id);
+  inline bool is_archived(const time_point &end) const {
+    return this->_window_start && end < *this->_window_start;
+  }
+  void adopt_archived_event(const Event &event);
+  // write-behind mode, see enable_write_behind()
+  std::optional<uint32_t> reserve_ids(uint32_t count);
+  size_t revert_failed_writes();
+  std::vector<Event> load_archived_range(const time_point &from,
+                                         const time_point &to) const;
+  void catch_up_text_index() const;
+
+  // Prepared on first use and reused by every later call instead of being
+  // compiled again each time. They hold on to the storage's connection,
+  // which init_storage() keeps open anyway.
+  using InsertStatement = decltype(std::declval<Storage &>().prepare(
+      insert(std::declval<const Event &>())));
+  using UpdateStatement = decltype(std::declval<Storage &>().prepare(
+      update(std::declval<const Event &>())));
+  using RemoveStatement = decltype(std::declval<Storage &>().prepare(
+      remove<Event>(uint32_t{})));
+  // archived events overlapping [?1, ?0], ending before the window (?2)
+  using RangeStatement = decltype(std::declval<Storage &>().prepare(
+      get_all<Event>(where(c(&Event::_start_db) <= int64_t{} and
+                           c(&Event::_end_db) >= int64_t{} and
+                           c(&Event::_end_db) < int64_t{}))));
+  InsertStatement &insert_statement();
+  UpdateStatement &update_statement();
+  RemoveStatement &remove_statement();
+  RangeStatement &range_statement() const;
+
+  EventStore _store;
+  // ids of the ongoing events, _ongoing_slots maps id -> position
+  std::vector<uint32_t> _ongoing_events;
+  FlatIdMap _ongoing_slots;
+  IntervalIndex _index;
+  TransitionQueue _transitions;
   Storage &_storage;
+  CalendarOptions _options;
+  std::optional<time_point> _window_start;
+  struct RangeHash {
+    size_t operator()(const std::pair<int64_t, int64_t> &range) const {
+      return std::hash<int64_t>()(range.first) * 31 +
+             std::hash<int64_t>()(range.second);
+    }
+  };
+  // on-demand fetches of events outside the residency window
+  mutable LruCache<uint32_t, Event> _archived_events;
+  mutable LruCache<std::pair<int64_t, int64_t>, std::vector<Event>, RangeHash>
+      _archived_ranges;
+  // last published snapshot, its untouched pages are reused by the next one.
+  // _snapshot_mutex only covers copying the pointer, writers never hold it.
+  mutable std::shared_ptr<const EventSnapshot> _snapshot;
+  mutable std::mutex _snapshot_mutex;
+  // shared by queries, exclusive for mutations
+  mutable std::shared_mutex _mutex;
+  // concurrent queries share the archive caches and the DB reads behind them
+  mutable std::mutex _archive_mutex;
+  ChangeFeed _changes;
   time_point _now = std::chrono::system_clock::now();
+  // next id handed out in write-behind mode, up to the end of the block
+  // reserved in the DB
+  uint32_t _next_id = 1;
+  uint32_t _reserved_end = 0;
+  static constexpr uint32_t id_block = 1024;
+  std::unique_ptr<WriteBehind> _write_behind;
+  // under _mutex held exclusively, the range one under _archive_mutex
+  std::optional<InsertStatement> _insert_statement;
+  std::optional<UpdateStatement> _update_statement;
+  std::optional<RemoveStatement> _remove_statement;
+  mutable std::optional<RangeStatement> _range_statement;
+  // built by the first search, then brought up to _changes by each search
+  // under _mutex held shared and _text_mutex
+  mutable TextIndex _text_index;
+  mutable uint64_t _text_index_seq = 0;
+  mutable bool _text_index_built = false;
+  mutable std::mutex _text_mutex;
 };
 
 } // namespace task_manager
@@ -0,0 +1,74 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace task_manager {
+
+enum class ChangeKind : uint8_t {
+  Created,
+  Updated, // name, description or interval
+  Removed,
+  Started, // became ongoing
+  Ended,   // stopped being ongoing, by time or by a move
+};
+
+// One entry of the change log. Only says what happened to which event, the
+// consumer looks the event up (or drops it) when it applies the change.
+struct Change {
+  uint64_t seq;
+  uint32_t id;
+  ChangeKind kind;
+};
+
+// Bounded, monotonically sequenced log of changes.
+//
+// Sequence numbers start at 1 and never repeat. The records live in a
+// power-of-two ring, once it is full every append overwrites the oldest
+// one; a consumer that fell further behind than the capacity learns so from
+// read() and has to reload instead of replaying. Not synchronized, the
+// calendar guards it with its own lock.
+class ChangeFeed {
+public:
+  explicit ChangeFeed(size_t capacity = 4096)
+      : _ring(std::bit_ceil(capacity < 2 ? size_t{2} : capacity)),
+        _mask(_ring.size() - 1) {}
+
+  inline size_t capacity() const { return this->_ring.size(); }
+  // 0 while nothing was recorded
+  inline uint64_t last_seq() const { return this->_next - 1; }
+  // Oldest seq still held, last_seq() + 1 while empty
+  inline uint64_t first_seq() const {
+    return this->_next > this->_ring.size() ? this->_next - this->_ring.size()
+                                            : 1;
+  }
+
+  inline uint64_t append(ChangeKind kind, uint32_t id) {
+    uint64_t seq = this->_next++;
+    this->_ring[seq & this->_mask] = Change{seq, id, kind};
+    return seq;
+  }
+
+  // Appends the records after `after` to `out`, oldest first and at most
+  // `limit` of them. Returns false, appending nothing, if some of those
+  // records were already overwritten.
+  inline bool read(uint64_t after, std::vector<Change> &out,
+                   size_t limit = std::numeric_limits<size_t>::max()) const {
+    if (after + 1 < this->first_seq())
+      return false;
+    for (uint64_t seq = after + 1; seq < this->_next && limit > 0;
+         ++seq, --limit) {
+      out.push_back(this->_ring[seq & this->_mask]);
+    }
+    return true;
+  }
+
+private:
+  std::vector<Change> _ring;
+  uint64_t _mask;
+  uint64_t _next = 1;
+};
+
+} // namespace task_manager
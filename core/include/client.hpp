@@ -0,0 +1,31 @@
+#pragma once
+#include "protocol.hpp"
+#include <optional>
+#include <string>
+
+namespace task_manager {
+
+// Blocking connection to a running task_managerd.
+class DaemonClient {
+public:
+  // nullopt if nothing listens on `socket_path`
+  static std::optional<DaemonClient> connect(const std::string &socket_path);
+
+  DaemonClient(const DaemonClient &) = delete;
+  DaemonClient &operator=(const DaemonClient &) = delete;
+  DaemonClient(DaemonClient &&other) noexcept;
+  DaemonClient &operator=(DaemonClient &&other) noexcept;
+  ~DaemonClient();
+
+  // Sends one command line and waits for its reply. nullopt once the
+  // connection is gone. The path of import/export is made absolute first.
+  std::optional<protocol::Reply> request(const std::string &line);
+
+private:
+  explicit DaemonClient(int fd) : _fd(fd) {}
+
+  int _fd = -1;
+  std::string _in;
+};
+
+} // namespace task_manager
@@ -0,0 +1,25 @@
+#pragma once
+#include "calendar.hpp"
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace task_manager {
+
+enum class CommandStatus : uint8_t {
+  Ok,
+  Failed,
+  Exit, // the session should end
+};
+
+// Command name -> help text, for "help" and the REPL completion.
+const std::map<std::string, std::string> &command_descriptions();
+
+// Runs one command line against the calendar and writes its output to
+// `out`. Shared by the local CLI and the daemon, so it never prompts:
+// missing arguments are reported instead.
+CommandStatus run_command(Calendar &calendar, const std::string &line,
+                          std::ostream &out);
+
+} // namespace task_manager
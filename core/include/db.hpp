@@ -1,9 +1,14 @@
 #pragma once
 #include "event.hpp"
 #include "sqlite_orm/sqlite_orm.h"
+#include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <format>
+#include <iostream>
+#include <optional>
 #include <string>
+#include <string_view>
 
 namespace task_manager {
 
@@ -18,9 +23,149 @@ inline std::string get_user_db_path() {
   return (base / "task_manager" / "task_manager.db").string();
 }
 
-inline auto init_storage(const std::string &db_path = get_user_db_path()) {
-  return make_storage(
+// Lives next to the DB, see Calendar::save_snapshot()
+inline std::string get_user_snapshot_path() {
+  return (std::filesystem::path(get_user_db_path()).parent_path() /
+          "task_manager.snapshot")
+      .string();
+}
+
+// Where task_managerd listens. The runtime dir is private to the user and
+// cleared on logout, the data dir is the fallback.
+inline std::string get_user_socket_path() {
+  if (const char *runtime = std::getenv("XDG_RUNTIME_DIR")) {
+    return (std::filesystem::path(runtime) / "task_manager.sock").string();
+  }
+  return (std::filesystem::path(get_user_db_path()).parent_path() /
+          "task_manager.sock")
+      .string();
+}
+
+// SQLite settings applied to every connection the storage opens. The
+// defaults are tuned for a single local writer; legacy() is what SQLite
+// does out of the box.
+struct StorageProfile {
+  // readers never block the writer and commits append to the log instead
+  // of rewriting pages in place
+  bool wal = true;
+  // 0 OFF, 1 NORMAL, 2 FULL. Under WAL, NORMAL survives application
+  // crashes and only loses the last commits on power loss.
+  int synchronous = 1;
+  // bytes of the DB file read through mmap instead of read(), 0 disables
+  int64_t mmap_size = int64_t{256} << 20;
+  // page cache per connection, in KiB when negative like SQLite's own
+  int cache_size = -64 * 1024;
+  // sorts and temporary indexes stay in memory
+  bool temp_store_memory = true;
+
+  static StorageProfile legacy() {
+    return {.wal = false,
+            .synchronous = 2,
+            .mmap_size = 0,
+            .cache_size = -2000,
+            .temp_store_memory = false};
+  }
+  // TASK_MANAGER_STORAGE_PROFILE=legacy falls back to SQLite's defaults
+  static StorageProfile from_env() {
+    const char *name = std::getenv("TASK_MANAGER_STORAGE_PROFILE");
+    if (name != nullptr && std::string_view(name) == "legacy")
+      return legacy();
+    return {};
+  }
+};
+
+inline void apply_storage_profile(sqlite3 *db, const StorageProfile &profile) {
+  std::string pragmas = std::format(
+      "PRAGMA journal_mode={};PRAGMA synchronous={};PRAGMA mmap_size={};"
+      "PRAGMA cache_size={};PRAGMA temp_store={};",
+      profile.wal ? "WAL" : "DELETE", profile.synchronous, profile.mmap_size,
+      profile.cache_size, profile.temp_store_memory ? "MEMORY" : "DEFAULT");
+  char *error = nullptr;
+  if (sqlite3_exec(db, pragmas.c_str(), nullptr, nullptr, &error) !=
+      SQLITE_OK) {
+    std::cerr << "Error applying the storage profile: "
+              << (error ? error : "unknown") << std::endl;
+    sqlite3_free(error);
+  }
+}
+
+// Moves the write-ahead log into the DB file and empties it, so the files
+// stop changing once the last connection closes. No-op outside WAL mode.
+inline bool checkpoint_wal(const std::string &db_path) {
+  sqlite3 *db = nullptr;
+  bool ok = sqlite3_open_v2(db_path.c_str(), &db, SQLITE_OPEN_READWRITE,
+                            nullptr) == SQLITE_OK &&
+            sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_TRUNCATE,
+                                      nullptr, nullptr) == SQLITE_OK;
+  if (!ok)
+    std::cerr << "Error checkpointing " << db_path << ": "
+              << (db ? sqlite3_errmsg(db) : "out of memory") << std::endl;
+  sqlite3_close(db);
+  return ok;
+}
+
+// Claims `count` consecutive event ids for rows inserted with an explicit
+// id, see WriteBehind. The AUTOINCREMENT counter of `events` is moved past
+// them in an IMMEDIATE transaction on a connection of its own, so neither
+// SQLite's own inserts nor another process reserving ids will hand them
+// out again. Returns the first id, nullopt on errors.
+inline std::optional<uint32_t> reserve_event_ids(const std::string &db_path,
+                                                 uint32_t count) {
+  sqlite3 *db = nullptr;
+  sqlite3_stmt *statement = nullptr;
+  std::optional<uint32_t> first;
+  auto exec = [&](const std::string &sql) {
+    return sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr) ==
+           SQLITE_OK;
+  };
+  if (sqlite3_open_v2(db_path.c_str(), &db, SQLITE_OPEN_READWRITE,
+                      nullptr) == SQLITE_OK &&
+      // waits out a commit in flight instead of failing right away
+      sqlite3_busy_timeout(db, 5000) == SQLITE_OK &&
+      exec("BEGIN IMMEDIATE") &&
+      sqlite3_prepare_v2(
+          db,
+          "SELECT max(coalesce((SELECT seq FROM sqlite_sequence WHERE name "
+          "= 'events'), 0), coalesce((SELECT max(id) FROM events), 0))",
+          -1, &statement, nullptr) == SQLITE_OK &&
+      sqlite3_step(statement) == SQLITE_ROW) {
+    int64_t last = sqlite3_column_int64(statement, 0);
+    int64_t seq = last + count;
+    sqlite3_finalize(statement);
+    statement = nullptr;
+    // the row only exists once something was inserted
+    if (seq <= int64_t{UINT32_MAX} &&
+        exec(std::format("UPDATE sqlite_sequence SET seq = {} WHERE name = "
+                         "'events'",
+                         seq)) &&
+        (sqlite3_changes(db) > 0 ||
+         exec(std::format("INSERT INTO sqlite_sequence (name, seq) VALUES "
+                          "('events', {})",
+                          seq))) &&
+        exec("COMMIT"))
+      first = static_cast<uint32_t>(last + 1);
+  }
+  if (!first) {
+    std::cerr << "Error reserving event ids in " << db_path << ": "
+              << (db ? sqlite3_errmsg(db) : "out of memory") << std::endl;
+    if (db)
+      exec("ROLLBACK");
+  }
+  sqlite3_finalize(statement);
+  sqlite3_close(db);
+  return first;
+}
+
+inline auto init_storage(const std::string &db_path = get_user_db_path(),
+                         const StorageProfile &profile = {}) {
+  auto storage = make_storage(
       db_path,
+      // range queries on the residency window and on-demand archive loads
+      make_index("events_start_idx", &Event::_start_db),
+      make_index("events_end_idx", &Event::_end_db),
+      // "what is ongoing / up next" without touching finished events
+      make_index("events_ongoing_start_idx", &Event::_ongoing,
+                 &Event::_start_db),
       make_table("events",
                  make_column("id", &Event::_id, primary_key().autoincrement()),
                  make_column("name", &Event::_name),
@@ -28,6 +173,13 @@ inline auto init_storage(const std::string &db_path = get_user_db_path()) {
                  make_column("start", &Event::_start_db),
                  make_column("end", &Event::_end_db),
                  make_column("ongoing", &Event::_ongoing)));
+  storage.on_open = [profile](sqlite3 *db) {
+    apply_storage_profile(db, profile);
+  };
+  // one connection for the lifetime of the storage: the pragmas above are
+  // per connection, and so are the statements Calendar keeps prepared
+  storage.open_forever();
+  return storage;
 }
 
 } // namespace task_manager
@@ -13,7 +13,7 @@ class Event {
 public:
   Event(const std::string &name = "", const time_point &start = {},
         const time_point &end = {}, const uint32_t id = 0)
-      : _name(name), _id(id) {
+      : _id(id), _name(name) {
     set_start(start);
     set_end(end);
     _ongoing = false;
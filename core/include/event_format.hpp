@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace task_manager {
+
+enum class ListFormat : uint8_t {
+  Text,   // the "Id: ..." blocks of the REPL
+  Ndjson, // one JSON object per line, times in RFC 3339 UTC
+};
+
+// Appends one event to `out`. Dates are rendered by hand and the rest goes
+// through a single std::format_to, there are no temporaries per field.
+void format_event(std::string &out, uint32_t id, int64_t start_us,
+                  int64_t end_us, bool ongoing, std::string_view name,
+                  std::string_view description, ListFormat format);
+// Appends a time the way the text listing prints it, "2025.01.06 10:00"
+void format_time(std::string &out, int64_t us);
+
+// Collects formatted output and hands it to the stream in large chunks,
+// one write per chunk instead of several per event.
+class OutputBuffer {
+public:
+  static constexpr size_t chunk_size = 256 * 1024;
+
+  explicit OutputBuffer(std::ostream &out) : _out(out) {
+    this->_buffer.reserve(chunk_size + 4096);
+  }
+  ~OutputBuffer() { this->flush(); }
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+  inline std::string &buffer() { return this->_buffer; }
+  // call after each record, records are never split across chunks
+  inline void maybe_flush() {
+    if (this->_buffer.size() >= chunk_size)
+      this->flush();
+  }
+  inline void flush() {
+    this->_out.write(this->_buffer.data(),
+                     static_cast<std::streamsize>(this->_buffer.size()));
+    this->_buffer.clear();
+  }
+
+private:
+  std::ostream &_out;
+  std::string _buffer;
+};
+
+} // namespace task_manager
@@ -0,0 +1,180 @@
+#pragma once
+#include "event_store.hpp"
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace task_manager {
+
+// One event as seen through an EventSnapshot. The strings point into the
+// snapshot, which has to outlive the view.
+class EventView {
+public:
+  EventView(uint32_t id, int64_t start_us, int64_t end_us, uint8_t flags,
+            std::string_view name, std::string_view description)
+      : _id(id), _start_us(start_us), _end_us(end_us), _flags(flags),
+        _name(name), _description(description) {}
+
+  inline uint32_t get_id() const { return this->_id; }
+  inline time_point get_start() const {
+    return EventStore::from_us(this->_start_us);
+  }
+  inline time_point get_end() const {
+    return EventStore::from_us(this->_end_us);
+  }
+  inline std::string_view get_name() const { return this->_name; }
+  inline std::string_view get_description() const {
+    return this->_description;
+  }
+  inline bool is_ongoing() const {
+    return this->_flags & EventStore::Ongoing;
+  }
+  Event to_event() const;
+
+  friend std::ostream &operator<<(std::ostream &os, const EventView &event);
+
+private:
+  uint32_t _id;
+  int64_t _start_us, _end_us;
+  uint8_t _flags;
+  std::string_view _name, _description;
+};
+
+// Immutable, versioned copy of an EventStore.
+//
+// The events are split into pages of EventStore::page_size, each shared
+// through a shared_ptr. make() only rebuilds the pages the store touched
+// since the previous snapshot and shares the rest, so taking a snapshot
+// after a few mutations costs a few pages plus the page table. A held
+// snapshot never changes: readers iterate it without copies or locks while
+// the writer goes on mutating the store.
+class EventSnapshot {
+public:
+  static constexpr size_t page_size = EventStore::page_size;
+
+  // Reuses every page of `previous` the store hasn't touched since.
+  static std::shared_ptr<const EventSnapshot>
+  make(const EventStore &store,
+       const std::shared_ptr<const EventSnapshot> &previous = nullptr);
+
+  inline uint64_t version() const { return this->_version; }
+  inline size_t size() const { return this->_size; }
+  inline bool empty() const { return this->_size == 0; }
+  EventView operator[](size_t i) const;
+
+  class iterator;
+  iterator begin() const;
+  iterator end() const;
+
+  // Lazily filtered views, nothing is materialized. Same closed intervals
+  // as the calendar: ongoing at t means start <= t && end >= t.
+  auto past(const time_point &time_p) const;
+  auto ongoing(const time_point &time_p) const;
+  auto future(const time_point &time_p) const;
+
+  // Calls fn(first, starts, ends) for every page, `first` being the index of
+  // its first event, so the scan kernels run over a snapshot too.
+  template <typename Fn> void for_each_page(Fn &&fn) const;
+
+private:
+  struct Page {
+    uint64_t version = 0; // EventStore::page_version() it was copied at
+    uint32_t count = 0;
+    std::array<int64_t, page_size> starts, ends;
+    std::array<uint32_t, page_size> ids;
+    std::array<uint8_t, page_size> flags;
+    std::array<uint32_t, page_size> name_off, name_len, desc_off, desc_len;
+    std::string text;
+
+    EventView view(size_t i) const;
+  };
+
+  static std::shared_ptr<const Page> make_page(const EventStore &store,
+                                               size_t page);
+
+  uint64_t _version = 0;
+  size_t _size = 0;
+  std::vector<std::shared_ptr<const Page>> _pages;
+};
+
+class EventSnapshot::iterator {
+public:
+  using iterator_concept = std::forward_iterator_tag;
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = EventView;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = EventView;
+
+  iterator() = default;
+  iterator(const EventSnapshot *snapshot, size_t page, size_t i)
+      : _snapshot(snapshot), _page(page), _i(i) {}
+
+  inline EventView operator*() const {
+    return this->_snapshot->_pages[this->_page]->view(this->_i);
+  }
+  inline iterator &operator++() {
+    // pages are full except for the last one
+    if (++this->_i == page_size) {
+      ++this->_page;
+      this->_i = 0;
+    }
+    return *this;
+  }
+  inline iterator operator++(int) {
+    iterator copy = *this;
+    ++*this;
+    return copy;
+  }
+  inline bool operator==(const iterator &other) const {
+    return this->_page == other._page && this->_i == other._i;
+  }
+
+private:
+  const EventSnapshot *_snapshot = nullptr;
+  size_t _page = 0;
+  size_t _i = 0;
+};
+
+inline EventSnapshot::iterator EventSnapshot::begin() const {
+  return iterator(this, 0, 0);
+}
+
+inline EventSnapshot::iterator EventSnapshot::end() const {
+  return iterator(this, this->_size / page_size, this->_size % page_size);
+}
+
+template <typename Fn> void EventSnapshot::for_each_page(Fn &&fn) const {
+  for (size_t page = 0; page < this->_pages.size(); ++page) {
+    const Page &p = *this->_pages[page];
+    fn(page * page_size, std::span<const int64_t>(p.starts.data(), p.count),
+       std::span<const int64_t>(p.ends.data(), p.count));
+  }
+}
+
+inline auto EventSnapshot::past(const time_point &time_p) const {
+  return *this | std::views::filter([time_p](const EventView &event) {
+           return event.get_end() < time_p;
+         });
+}
+
+inline auto EventSnapshot::ongoing(const time_point &time_p) const {
+  return *this | std::views::filter([time_p](const EventView &event) {
+           return event.get_start() <= time_p && event.get_end() >= time_p;
+         });
+}
+
+inline auto EventSnapshot::future(const time_point &time_p) const {
+  return *this | std::views::filter([time_p](const EventView &event) {
+           return event.get_start() > time_p;
+         });
+}
+
+} // namespace task_manager
@@ -0,0 +1,222 @@
+#pragma once
+#include "event.hpp"
+#include "flat_id_map.hpp"
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace task_manager {
+
+class EventRef;
+
+// Columnar storage for the resident events.
+//
+// Every field lives in its own contiguous column indexed by a dense slot:
+// start/end as int64 microseconds (the same unit as the DB), ids, flag bits
+// and (offset, length) pairs into one string arena holding every name and
+// description. Scans over the time columns touch nothing else, and an event
+// costs a few dozen bytes instead of a heap-allocated Event behind a
+// shared_ptr.
+//
+// Removal is swap-and-pop, so slots are not stable across mutations; ids
+// are, and find() maps them back to a slot in O(1).
+//
+// Every mutation bumps version() and stamps the page (page_size slots) it
+// touched, which lets EventSnapshot rebuild only the pages that changed.
+class EventStore {
+public:
+  static constexpr uint32_t npos = FlatIdMap::npos;
+  static constexpr size_t page_size = 512;
+
+  enum Flag : uint8_t {
+    Ongoing = 1 << 0, // mirrors Event::_ongoing
+  };
+
+  EventStore() = default;
+  ~EventStore() = default;
+
+  inline size_t size() const { return this->_ids.size(); }
+  inline bool empty() const { return this->_ids.empty(); }
+  void reserve(size_t n, size_t text_bytes = 0);
+  void clear();
+
+  // Slot of the event with this id, or npos.
+  inline uint32_t find(uint32_t id) const { return this->_slots.find(id); }
+  inline bool contains(uint32_t id) const { return this->_slots.contains(id); }
+
+  uint32_t push(uint32_t id, int64_t start_us, int64_t end_us, uint8_t flags,
+                std::string_view name, std::string_view description);
+  uint32_t push(const Event &event);
+  // Swap-and-pop, the last event takes over the slot.
+  void erase(uint32_t slot);
+
+  void set_name(uint32_t slot, std::string_view name);
+  void set_description(uint32_t slot, std::string_view description);
+  inline void set_interval(uint32_t slot, int64_t start_us, int64_t end_us) {
+    this->_starts[slot] = start_us;
+    this->_ends[slot] = end_us;
+    this->touch(slot);
+  }
+  inline void set_flags(uint32_t slot, uint8_t flags) {
+    if (this->_flags[slot] == flags)
+      return;
+    this->_flags[slot] = flags;
+    this->touch(slot);
+  }
+
+  inline uint64_t version() const { return this->_version; }
+  // Version of the last mutation within page `page`, 0 if never touched.
+  inline uint64_t page_version(size_t page) const {
+    return page < this->_page_versions.size() ? this->_page_versions[page] : 0;
+  }
+
+  inline uint32_t id(uint32_t slot) const { return this->_ids[slot]; }
+  inline int64_t start_us(uint32_t slot) const { return this->_starts[slot]; }
+  inline int64_t end_us(uint32_t slot) const { return this->_ends[slot]; }
+  inline time_point start(uint32_t slot) const {
+    return from_us(this->_starts[slot]);
+  }
+  inline time_point end(uint32_t slot) const {
+    return from_us(this->_ends[slot]);
+  }
+  inline uint8_t flags(uint32_t slot) const { return this->_flags[slot]; }
+  inline std::string_view name(uint32_t slot) const {
+    return this->text(this->_names[slot]);
+  }
+  inline std::string_view description(uint32_t slot) const {
+    return this->text(this->_descriptions[slot]);
+  }
+
+  inline std::span<const int64_t> starts() const { return this->_starts; }
+  inline std::span<const int64_t> ends() const { return this->_ends; }
+  inline std::span<const uint32_t> ids() const { return this->_ids; }
+  inline std::span<const uint8_t> flag_column() const { return this->_flags; }
+
+  // Materializes a full Event, for the DB layer.
+  Event to_event(uint32_t slot) const;
+  EventRef ref(uint32_t slot) const;
+
+  // Bytes held by the columns and the arena, for diagnostics.
+  size_t memory_usage() const;
+
+  static inline int64_t to_us(const time_point &time_p) {
+    return std::chrono::time_point_cast<std::chrono::microseconds>(time_p)
+        .time_since_epoch()
+        .count();
+  }
+  static inline time_point from_us(int64_t us) {
+    return time_point(std::chrono::microseconds(us));
+  }
+
+  class iterator;
+  iterator begin() const;
+  iterator end() const;
+
+private:
+  struct TextRef {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+  };
+
+  inline std::string_view text(const TextRef &ref) const {
+    return std::string_view(this->_arena).substr(ref.offset, ref.length);
+  }
+  TextRef append_text(std::string_view text);
+  void maybe_compact();
+  inline void touch(uint32_t slot) {
+    size_t page = slot / page_size;
+    if (page >= this->_page_versions.size())
+      this->_page_versions.resize(page + 1, 0);
+    this->_page_versions[page] = ++this->_version;
+  }
+
+  std::vector<int64_t> _starts, _ends;
+  std::vector<uint32_t> _ids;
+  std::vector<uint8_t> _flags;
+  std::vector<TextRef> _names, _descriptions;
+  std::string _arena;
+  size_t _garbage = 0; // arena bytes no longer referenced
+  FlatIdMap _slots;    // id -> slot
+  uint64_t _version = 0;
+  std::vector<uint64_t> _page_versions;
+};
+
+// Handle to one event inside an EventStore. Cheap to copy, but only valid
+// until the store is next mutated.
+class EventRef {
+public:
+  EventRef(const EventStore &store, uint32_t slot)
+      : _store(&store), _slot(slot) {}
+
+  inline uint32_t slot() const { return this->_slot; }
+  inline uint32_t get_id() const { return this->_store->id(this->_slot); }
+  inline time_point get_start() const {
+    return this->_store->start(this->_slot);
+  }
+  inline time_point get_end() const { return this->_store->end(this->_slot); }
+  inline std::string_view get_name() const {
+    return this->_store->name(this->_slot);
+  }
+  inline std::string_view get_description() const {
+    return this->_store->description(this->_slot);
+  }
+  inline bool is_ongoing() const {
+    return this->_store->flags(this->_slot) & EventStore::Ongoing;
+  }
+  inline Event to_event() const { return this->_store->to_event(this->_slot); }
+
+  friend std::ostream &operator<<(std::ostream &os, const EventRef &event);
+
+private:
+  const EventStore *_store;
+  uint32_t _slot;
+};
+
+class EventStore::iterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = EventRef;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = EventRef;
+
+  iterator() = default;
+  iterator(const EventStore *store, uint32_t slot)
+      : _store(store), _slot(slot) {}
+
+  inline EventRef operator*() const { return EventRef(*this->_store, _slot); }
+  inline iterator &operator++() {
+    ++this->_slot;
+    return *this;
+  }
+  inline iterator operator++(int) {
+    iterator copy = *this;
+    ++this->_slot;
+    return copy;
+  }
+  inline bool operator==(const iterator &other) const {
+    return this->_slot == other._slot;
+  }
+
+private:
+  const EventStore *_store = nullptr;
+  uint32_t _slot = 0;
+};
+
+inline EventRef EventStore::ref(uint32_t slot) const {
+  return EventRef(*this, slot);
+}
+
+inline EventStore::iterator EventStore::begin() const {
+  return iterator(this, 0);
+}
+
+inline EventStore::iterator EventStore::end() const {
+  return iterator(this, static_cast<uint32_t>(this->size()));
+}
+
+} // namespace task_manager
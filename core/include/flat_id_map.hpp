@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace task_manager {
+
+// Open-addressing hash map from event id to a slot/position.
+//
+// Linear probing over a power-of-two table of (key, value) pairs with
+// backward-shift deletion, so there are no tombstones and lookups stay short
+// after many removals. Id 0 is never assigned by SQLite's autoincrement and
+// marks an empty cell; it is never found and can't be stored.
+class FlatIdMap {
+public:
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  FlatIdMap() { this->rehash(16); }
+  ~FlatIdMap() = default;
+
+  inline size_t size() const { return this->_size; }
+  inline bool empty() const { return this->_size == 0; }
+
+  inline uint32_t find(uint32_t key) const {
+    if (key == 0)
+      return npos;
+    for (size_t i = this->home(key);; i = (i + 1) & this->_mask) {
+      const Cell &cell = this->_cells[i];
+      if (cell.key == key)
+        return cell.value;
+      if (cell.key == 0)
+        return npos;
+    }
+  }
+
+  inline bool contains(uint32_t key) const { return this->find(key) != npos; }
+
+  // Inserts or overwrites.
+  inline void set(uint32_t key, uint32_t value) {
+    if (key == 0)
+      return;
+    if ((this->_size + 1) * 4 > this->_cells.size() * 3)
+      this->rehash(this->_cells.size() * 2);
+    for (size_t i = this->home(key);; i = (i + 1) & this->_mask) {
+      Cell &cell = this->_cells[i];
+      if (cell.key == key) {
+        cell.value = value;
+        return;
+      }
+      if (cell.key == 0) {
+        cell = {key, value};
+        ++this->_size;
+        return;
+      }
+    }
+  }
+
+  inline bool erase(uint32_t key) {
+    if (key == 0)
+      return false;
+    size_t i = this->home(key);
+    for (;; i = (i + 1) & this->_mask) {
+      if (this->_cells[i].key == key)
+        break;
+      if (this->_cells[i].key == 0)
+        return false;
+    }
+
+    // shift back every following entry that would become unreachable
+    size_t hole = i;
+    for (size_t j = (i + 1) & this->_mask; this->_cells[j].key != 0;
+         j = (j + 1) & this->_mask) {
+      size_t h = this->home(this->_cells[j].key);
+      // move j into the hole unless its home lies cyclically in (hole, j]
+      bool reachable = hole <= j ? (h > hole && h <= j) : (h > hole || h <= j);
+      if (!reachable) {
+        this->_cells[hole] = this->_cells[j];
+        hole = j;
+      }
+    }
+    this->_cells[hole] = {};
+    --this->_size;
+    return true;
+  }
+
+  inline void clear() {
+    this->_cells.assign(this->_cells.size(), Cell{});
+    this->_size = 0;
+  }
+
+  inline void reserve(size_t n) {
+    size_t capacity = 16;
+    while (capacity * 3 < n * 4)
+      capacity *= 2;
+    if (capacity > this->_cells.size())
+      this->rehash(capacity);
+  }
+
+private:
+  struct Cell {
+    uint32_t key = 0;
+    uint32_t value = 0;
+  };
+
+  inline size_t home(uint32_t key) const {
+    // fibonacci hashing, ids are sequential so spread them out
+    return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> this->_shift) &
+           this->_mask;
+  }
+
+  inline void rehash(size_t capacity) {
+    std::vector<Cell> old = std::move(this->_cells);
+    this->_cells.assign(capacity, Cell{});
+    this->_mask = capacity - 1;
+    this->_shift = 64;
+    for (size_t c = capacity; c > 1; c >>= 1)
+      --this->_shift;
+    this->_size = 0;
+    for (const Cell &cell : old) {
+      if (cell.key != 0)
+        this->set(cell.key, cell.value);
+    }
+  }
+
+  std::vector<Cell> _cells;
+  size_t _mask = 0;
+  unsigned _shift = 64;
+  size_t _size = 0;
+};
+
+} // namespace task_manager
@@ -0,0 +1,98 @@
+#pragma once
+#include "calendar.hpp"
+#include "event_format.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// iCalendar (RFC 5545) import and export, VEVENTs only.
+namespace task_manager {
+
+// One VEVENT as the reader sees it. The views point into the reader and
+// stay valid until its next call to next().
+struct IcsEvent {
+  std::string_view summary;
+  std::string_view description;
+  int64_t start_us = 0;
+  int64_t end_us = 0;
+};
+
+// Streams the VEVENTs of an .ics file mapped read-only. Folded lines and
+// escaped text are decoded into buffers that are reused from one event to
+// the next, so nothing is allocated per line once they have grown.
+//
+// Times with a TZID or without a zone are read as UTC, there is no time
+// zone database here. Recurrence rules aren't expanded, only the first
+// occurrence is imported.
+class IcsReader {
+public:
+  // Reads `text` in place, it has to outlive the reader
+  explicit IcsReader(std::string_view text) : _text(text) {}
+  ~IcsReader();
+  IcsReader(IcsReader &&other) noexcept;
+  IcsReader &operator=(IcsReader &&other) noexcept;
+  IcsReader(const IcsReader &) = delete;
+  IcsReader &operator=(const IcsReader &) = delete;
+
+  // nullopt when the file can't be opened or mapped
+  static std::optional<IcsReader> open(const std::string &path);
+
+  // Fills `event` with the next VEVENT that has a usable DTSTART. Returns
+  // false at the end of the input.
+  bool next(IcsEvent &event);
+  // VEVENTs dropped so far, without a DTSTART or with a malformed time
+  inline size_t skipped() const { return this->_skipped; }
+
+private:
+  IcsReader(void *data, size_t length);
+  bool next_line(std::string_view &line);
+
+  void *_data = nullptr; // owned mapping, when opened from a file
+  size_t _length = 0;
+  std::string_view _text;
+  size_t _pos = 0;
+  size_t _skipped = 0;
+  std::string _unfolded, _summary, _description;
+};
+
+// Writes a VCALENDAR, one VEVENT per write() call. Lines are CRLF
+// terminated and folded at 75 octets as the RFC asks. The footer is written
+// by the destructor.
+class IcsWriter {
+public:
+  explicit IcsWriter(std::ostream &out);
+  ~IcsWriter();
+  IcsWriter(const IcsWriter &) = delete;
+  IcsWriter &operator=(const IcsWriter &) = delete;
+
+  void write(uint32_t id, int64_t start_us, int64_t end_us,
+             std::string_view name, std::string_view description);
+  inline size_t written() const { return this->_written; }
+
+private:
+  OutputBuffer _buffer;
+  std::string _stamp; // DTSTAMP, the same for the whole export
+  size_t _written = 0;
+};
+
+struct IcsImportResult {
+  size_t imported = 0;
+  size_t failed = 0;  // rejected by the DB
+  size_t skipped = 0; // see IcsReader::skipped()
+};
+
+// Adds every VEVENT of `path` through Calendar::create_events(), in
+// transactions of `batch_size` events. nullopt if the file can't be read.
+std::optional<IcsImportResult> import_ics(Calendar &calendar,
+                                          const std::string &path,
+                                          size_t batch_size = 50000);
+
+// Writes every event, archived ones included, to `path` (through a
+// temporary file). nullopt on I/O errors.
+std::optional<size_t> export_ics(const Calendar &calendar,
+                                 const std::string &path);
+
+} // namespace task_manager
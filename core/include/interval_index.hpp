@@ -0,0 +1,163 @@
+#pragma once
+#include "event.hpp"
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace task_manager {
+
+// Time index over the calendar events.
+//
+// Augmented treap keyed by (start, id). Each node also keeps the min and max
+// end of its subtree, so "what overlaps [from, to]", "what is ongoing at t",
+// "what ended before t" and "next N events after t" only visit the matching
+// nodes plus O(log n) others. Nodes live in a pooled vector, so inserts and
+// erases don't allocate once the pool has grown. Queries yield event ids.
+//
+// Intervals are closed, matching the calendar classification: an event is
+// ongoing at t when start <= t && end >= t.
+class IntervalIndex {
+public:
+  using value_type = uint32_t; // event id
+
+  struct Entry {
+    time_point start, end;
+    uint32_t id;
+  };
+
+  IntervalIndex() = default;
+  ~IntervalIndex() = default;
+
+  void insert(const time_point &start, const time_point &end, uint32_t id);
+  bool erase(const time_point &start, uint32_t id);
+  void clear();
+  void reserve(size_t n);
+  // Replaces the contents with `entries`, which must be in (start, id)
+  // order. One pass over them instead of a split and merge per insert.
+  void assign_sorted(std::span<const Entry> entries);
+
+  inline size_t size() const { return this->_size; }
+  inline bool empty() const { return this->_size == 0; }
+
+  // Events with start <= to && end >= from, in start order.
+  std::vector<value_type> overlapping(const time_point &from,
+                                      const time_point &to) const;
+  inline std::vector<value_type> ongoing(const time_point &time_p) const {
+    return this->overlapping(time_p, time_p);
+  }
+  // Events with end < time_p, in start order.
+  std::vector<value_type> ended_before(const time_point &time_p) const;
+  // First `limit` events with start > time_p, in start order.
+  std::vector<value_type>
+  starting_after(const time_point &time_p,
+                 size_t limit = std::numeric_limits<size_t>::max()) const;
+
+  template <typename Fn>
+  void for_each_overlapping(const time_point &from, const time_point &to,
+                            Fn &&fn) const {
+    this->visit_overlapping(this->_root, from, to, fn);
+  }
+
+  // Like for_each_overlapping(), stops as soon as `fn` returns false.
+  template <typename Fn>
+  void for_each_overlapping_until(const time_point &from, const time_point &to,
+                                  Fn &&fn) const {
+    this->visit_overlapping_until(this->_root, from, to, fn);
+  }
+
+  // In-order (start, id) traversal of every event.
+  template <typename Fn> void for_each(Fn &&fn) const {
+    this->for_each_until([&](uint32_t id) {
+      fn(id);
+      return true;
+    });
+  }
+
+  // Like for_each(), stops as soon as `fn` returns false.
+  template <typename Fn> void for_each_until(Fn &&fn) const {
+    std::vector<int32_t> stack;
+    int32_t n = this->_root;
+    while (n >= 0 || !stack.empty()) {
+      while (n >= 0) {
+        stack.push_back(n);
+        n = this->_nodes[n].left;
+      }
+      n = stack.back();
+      stack.pop_back();
+      if (!fn(this->_nodes[n].id))
+        return;
+      n = this->_nodes[n].right;
+    }
+  }
+
+private:
+  struct Node {
+    time_point start, end;
+    time_point min_end, max_end; // over the whole subtree
+    uint32_t id = 0;
+    uint32_t priority = 0;
+    int32_t left = -1, right = -1;
+  };
+
+  inline bool less(const time_point &start, uint32_t id, const Node &n) const {
+    return start < n.start || (start == n.start && id < n.id);
+  }
+
+  int32_t allocate_node(const time_point &start, const time_point &end,
+                        uint32_t id);
+  void free_node(int32_t n);
+  void pull(int32_t n);
+  void split(int32_t n, const time_point &start, uint32_t id, int32_t &l,
+             int32_t &r);
+  int32_t merge(int32_t l, int32_t r);
+  int32_t erase_node(int32_t n, const time_point &start, uint32_t id,
+                     bool &found);
+  uint32_t next_priority();
+
+  template <typename Fn>
+  void visit_overlapping(int32_t n, const time_point &from,
+                         const time_point &to, Fn &fn) const {
+    if (n < 0)
+      return;
+    const Node &node = this->_nodes[n];
+    if (node.max_end < from)
+      return;
+    this->visit_overlapping(node.left, from, to, fn);
+    // right subtree only holds later starts
+    if (node.start > to)
+      return;
+    if (node.end >= from)
+      fn(node.id);
+    this->visit_overlapping(node.right, from, to, fn);
+  }
+
+  // false once fn asked to stop
+  template <typename Fn>
+  bool visit_overlapping_until(int32_t n, const time_point &from,
+                               const time_point &to, Fn &fn) const {
+    if (n < 0)
+      return true;
+    const Node &node = this->_nodes[n];
+    if (node.max_end < from)
+      return true;
+    if (!this->visit_overlapping_until(node.left, from, to, fn))
+      return false;
+    if (node.start > to)
+      return true;
+    if (node.end >= from && !fn(node.id))
+      return false;
+    return this->visit_overlapping_until(node.right, from, to, fn);
+  }
+
+  void visit_ended_before(int32_t n, const time_point &time_p,
+                          std::vector<value_type> &out) const;
+
+  std::vector<Node> _nodes;
+  std::vector<int32_t> _free_nodes;
+  int32_t _root = -1;
+  size_t _size = 0;
+  uint32_t _rng_state = 0x9e3779b9u;
+};
+
+} // namespace task_manager
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace task_manager {
+
+// Fixed-capacity least-recently-used cache. get() and put() are O(1) and
+// both count as a use.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+  explicit LruCache(size_t capacity = 0) : _capacity(capacity) {}
+  ~LruCache() = default;
+
+  inline size_t size() const { return this->_map.size(); }
+  inline size_t capacity() const { return this->_capacity; }
+
+  inline void set_capacity(size_t capacity) {
+    this->_capacity = capacity;
+    this->evict();
+  }
+
+  // Pointer to the cached value, valid until the next put()/erase()/clear().
+  inline Value *get(const Key &key) {
+    auto it = this->_map.find(key);
+    if (it == this->_map.end())
+      return nullptr;
+    this->_order.splice(this->_order.begin(), this->_order, it->second);
+    return &it->second->second;
+  }
+
+  inline void put(const Key &key, Value value) {
+    auto it = this->_map.find(key);
+    if (it != this->_map.end()) {
+      it->second->second = std::move(value);
+      this->_order.splice(this->_order.begin(), this->_order, it->second);
+      return;
+    }
+    this->_order.emplace_front(key, std::move(value));
+    this->_map.emplace(key, this->_order.begin());
+    this->evict();
+  }
+
+  inline bool erase(const Key &key) {
+    auto it = this->_map.find(key);
+    if (it == this->_map.end())
+      return false;
+    this->_order.erase(it->second);
+    this->_map.erase(it);
+    return true;
+  }
+
+  inline void clear() {
+    this->_map.clear();
+    this->_order.clear();
+  }
+
+private:
+  using Entry = std::pair<Key, Value>;
+
+  inline void evict() {
+    while (this->_map.size() > this->_capacity) {
+      this->_map.erase(this->_order.back().first);
+      this->_order.pop_back();
+    }
+  }
+
+  size_t _capacity;
+  std::list<Entry> _order; // most recent first
+  std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> _map;
+};
+
+} // namespace task_manager
@@ -0,0 +1,209 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Process-wide counters and latency histograms for the hot paths.
+//
+// Every thread writes to its own shard, so recording is a couple of relaxed
+// loads and stores on memory no other thread writes to: no locked
+// instructions, no shared cache lines. Readers sum the shards. Building with
+// TASK_MANAGER_NO_METRICS (cmake -DTASK_MANAGER_METRICS=OFF) turns the
+// recording calls into empty inlines.
+namespace task_manager::metrics {
+
+enum class Counter : uint8_t {
+  DbErrors,       // failed DB operations, also reported on stderr
+  EventsLoaded,   // events read into memory at startup
+  Transitions,    // events that started or ended
+  WriteBehindOps, // queued operations committed by the writer thread
+  CommandErrors,  // commands that failed or were unknown
+  Count_,
+};
+
+enum class Timer : uint8_t {
+  DbTransaction,     // synchronous transactions of the calendar
+  WriteBehindCommit, // one batch of the writer thread
+  Tick,
+  RefreshOngoing, // full classification of the ongoing events
+  Classify,       // past/ongoing/future counts
+  Load,           // loading the calendar at startup
+  CommandList,
+  CommandQuery,
+  CommandAdd,
+  CommandRemove,
+  CommandUpdate,
+  CommandChanges,
+  CommandStats,
+  CommandSearch,
+  CommandOther, // help, trace, exit and unknown commands
+  Count_,
+};
+
+inline constexpr size_t counter_count = static_cast<size_t>(Counter::Count_);
+inline constexpr size_t timer_count = static_cast<size_t>(Timer::Count_);
+
+// Log-linear buckets over nanoseconds, HDR histogram style: every power of
+// two is split into 8 linear sub-buckets, so a bucket is at most 12.5%
+// wide and any duration up to 2^64 ns fits.
+inline constexpr unsigned sub_bucket_bits = 3;
+inline constexpr size_t sub_buckets = size_t{1} << sub_bucket_bits;
+inline constexpr size_t bucket_count =
+    (64 - sub_bucket_bits + 1) * sub_buckets;
+
+inline constexpr size_t bucket_of(uint64_t ns) {
+  if (ns < sub_buckets)
+    return static_cast<size_t>(ns);
+  unsigned shift = std::bit_width(ns) - 1 - sub_bucket_bits;
+  return (shift + 1) * sub_buckets +
+         static_cast<size_t>((ns >> shift) & (sub_buckets - 1));
+}
+
+// Largest value falling into `bucket`
+inline constexpr uint64_t bucket_max(size_t bucket) {
+  if (bucket < sub_buckets)
+    return bucket;
+  unsigned shift = static_cast<unsigned>(bucket / sub_buckets) - 1;
+  uint64_t low = (sub_buckets + bucket % sub_buckets) << shift;
+  return low + ((uint64_t{1} << shift) - 1);
+}
+
+// Totals across all threads
+struct Histogram {
+  std::array<uint64_t, bucket_count> buckets{};
+  uint64_t count = 0;
+  uint64_t sum_ns = 0;
+  uint64_t max_ns = 0;
+
+  // Upper bound of the bucket holding quantile q (0..1), capped at the
+  // maximum; 0 while empty
+  uint64_t quantile_ns(double q) const;
+};
+
+struct Report {
+  std::array<uint64_t, counter_count> counters{};
+  std::vector<Histogram> timers = std::vector<Histogram>(timer_count);
+};
+
+Report collect();
+
+// Counters and non-empty timers as a table, for the stats command
+void write_summary(std::ostream &out, const Report &report);
+// Prometheus text exposition format
+void write_prometheus(std::ostream &out, const Report &report);
+// Writes collect() to `path` through a temporary file, scrapers never see
+// half a file
+bool dump_prometheus(const std::string &path);
+
+#ifndef TASK_MANAGER_NO_METRICS
+
+inline constexpr bool enabled = true;
+
+namespace detail {
+
+// Written only by the thread holding it. Threads that exit hand their shard
+// to the next one, values keep accumulating.
+struct Shard {
+  struct TimerCells {
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    std::atomic<uint64_t> sum_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+  };
+  std::array<std::atomic<uint64_t>, counter_count> counters{};
+  std::array<TimerCells, timer_count> timers{};
+};
+
+Shard &local_shard();
+
+// single writer, a plain add without a locked instruction
+inline void bump(std::atomic<uint64_t> &value, uint64_t n) {
+  value.store(value.load(std::memory_order_relaxed) + n,
+              std::memory_order_relaxed);
+}
+
+} // namespace detail
+
+inline void add(Counter counter, uint64_t n = 1) {
+  detail::bump(
+      detail::local_shard().counters[static_cast<size_t>(counter)], n);
+}
+
+inline void record(Timer timer, std::chrono::nanoseconds elapsed) {
+  uint64_t ns = elapsed.count() > 0 ? static_cast<uint64_t>(elapsed.count())
+                                    : 0;
+  auto &shard = detail::local_shard().timers[static_cast<size_t>(timer)];
+  detail::bump(shard.buckets[bucket_of(ns)], 1);
+  detail::bump(shard.sum_ns, ns);
+  if (ns > shard.max_ns.load(std::memory_order_relaxed))
+    shard.max_ns.store(ns, std::memory_order_relaxed);
+}
+
+// Records the time until the end of the scope
+class ScopedTimer {
+public:
+  explicit ScopedTimer(Timer timer)
+      : _timer(timer), _start(std::chrono::steady_clock::now()) {}
+  ~ScopedTimer() {
+    record(this->_timer, std::chrono::steady_clock::now() - this->_start);
+  }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+  Timer _timer;
+  std::chrono::steady_clock::time_point _start;
+};
+
+#else
+
+inline constexpr bool enabled = false;
+
+inline void add(Counter, uint64_t = 1) {}
+inline void record(Timer, std::chrono::nanoseconds) {}
+
+class ScopedTimer {
+public:
+  explicit ScopedTimer(Timer) {}
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+#endif
+
+// Rewrites a Prometheus text file every `interval` from a thread of its
+// own, for node_exporter's textfile collector or anything else polling it.
+// The last dump happens on destruction.
+class PrometheusFileExporter {
+public:
+  PrometheusFileExporter(std::string path, std::chrono::seconds interval);
+  ~PrometheusFileExporter();
+  PrometheusFileExporter(const PrometheusFileExporter &) = delete;
+  PrometheusFileExporter &operator=(const PrometheusFileExporter &) = delete;
+
+  // Set up from TASK_MANAGER_METRICS_FILE and TASK_MANAGER_METRICS_INTERVAL
+  // (seconds, default 15). nullptr when no file was asked for or the
+  // metrics are compiled out.
+  static std::unique_ptr<PrometheusFileExporter> from_env();
+
+private:
+  void run();
+
+  std::string _path;
+  std::chrono::seconds _interval;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  bool _stop = false;
+  std::thread _thread;
+};
+
+} // namespace task_manager::metrics
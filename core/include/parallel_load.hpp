@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace task_manager {
+
+// The rows of one rowid range, decoded straight from the statement into
+// columns. No Event is built, the text of every row goes into one buffer.
+struct EventChunk {
+  std::vector<uint32_t> ids;
+  std::vector<int64_t> starts, ends;
+  std::vector<uint8_t> ongoing;
+  // end of each name and description in `text`, they alternate
+  std::vector<uint32_t> text_ends;
+  std::string text;
+
+  inline size_t size() const { return this->ids.size(); }
+  inline std::string_view name(size_t i) const {
+    return this->slice(2 * i);
+  }
+  inline std::string_view description(size_t i) const {
+    return this->slice(2 * i + 1);
+  }
+
+private:
+  inline std::string_view slice(size_t k) const {
+    uint32_t begin = k == 0 ? 0 : this->text_ends[k - 1];
+    return std::string_view(this->text).substr(begin,
+                                               this->text_ends[k] - begin);
+  }
+};
+
+// Reads every row of `events` ending at or after `min_end_us`. The id
+// range is split into `threads` slices read concurrently, each on its own
+// read-only connection; the chunks come back in id order. Meant for the
+// startup load, while nothing else writes to the DB. Returns nullopt on
+// any SQLite error.
+std::optional<std::vector<EventChunk>>
+read_events_parallel(const std::string &db_path, int64_t min_end_us,
+                     unsigned threads);
+
+} // namespace task_manager
@@ -0,0 +1,83 @@
+#pragma once
+#include "commands.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+// Wire format between task_managerd and its clients.
+//
+// Every message is a frame: a little-endian u32 payload length followed by
+// the payload. A request payload is one command line, exactly as typed. A
+// reply payload is one CommandStatus byte followed by the command output.
+// Outputs too big for one frame are split over several, every frame but
+// the last having the `continued` bit set on its status byte. The output
+// is framed while the command writes it, so only the last frame carries
+// the command's status. Frames are pipelined, a client may send several
+// requests before reading and gets the replies back in order.
+namespace task_manager::protocol {
+
+constexpr size_t header_size = 4;
+// anything bigger is a broken or hostile peer
+constexpr uint32_t max_payload = 16u << 20;
+// on the status byte, more frames of the same reply follow
+constexpr uint8_t continued = 0x80;
+
+enum class FrameStatus : uint8_t {
+  Complete,
+  Incomplete, // need more bytes
+  Invalid,    // oversized, the connection should be dropped
+};
+
+void append_frame(std::string &buffer, std::string_view payload);
+
+// Parses the frame at the front of `input`. On Complete `payload` points
+// into `input` and `consumed` is the size of the whole frame.
+FrameStatus next_frame(std::string_view input, std::string_view &payload,
+                       size_t &consumed);
+
+struct Reply {
+  CommandStatus status;
+  std::string output;
+};
+
+// One frame of a reply, `output` points into the payload
+struct ReplyFrame {
+  CommandStatus status;
+  bool last;
+  std::string_view output;
+};
+
+// Frames a command's output straight into `buffer` as it is written, with
+// no copy of the whole output on the side. A frame is sealed as continued
+// once it holds `frame_size` bytes, finish() seals the last one with the
+// status. Continued frames say Ok, the status is only known at the end.
+class ReplyWriter : public std::streambuf {
+public:
+  explicit ReplyWriter(std::string &buffer,
+                       size_t frame_size = max_payload - 1);
+  ReplyWriter(const ReplyWriter &) = delete;
+  ReplyWriter &operator=(const ReplyWriter &) = delete;
+
+  void finish(CommandStatus status);
+
+protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(const char *data, std::streamsize size) override;
+
+private:
+  static constexpr size_t no_frame = std::string::npos;
+
+  void open_frame();
+  void seal(uint8_t status_byte);
+
+  std::string &_buffer;
+  size_t _frame_size;
+  size_t _frame_start = no_frame; // header offset of the open frame
+};
+
+std::optional<ReplyFrame> decode_reply(std::string_view payload);
+
+} // namespace task_manager::protocol
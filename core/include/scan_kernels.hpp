@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace task_manager {
+
+// Brute-force scans over the EventStore time columns (int64 microseconds).
+//
+// Each kernel has a scalar, an AVX2 and an AVX-512 version; the widest one
+// the CPU supports is picked on first use, the build itself needs no -m
+// flags. Intervals are closed like everywhere else in the calendar: an
+// event overlaps [from, to] when start <= to && end >= from.
+namespace scan {
+
+enum class EventState : uint8_t {
+  Past,    // end < now
+  Ongoing, // start <= now <= end
+  Future,  // start > now
+};
+
+struct StateCounts {
+  size_t past = 0;
+  size_t ongoing = 0;
+  size_t future = 0;
+};
+
+size_t count_overlapping(std::span<const int64_t> starts,
+                         std::span<const int64_t> ends, int64_t from,
+                         int64_t to);
+// Appends the slots of the overlapping events to `out`, in slot order.
+void select_overlapping(std::span<const int64_t> starts,
+                        std::span<const int64_t> ends, int64_t from,
+                        int64_t to, std::vector<uint32_t> &out);
+// Writes the state of every slot into `states` (sized like the columns)
+// and returns the totals. `states` may be empty when only totals matter.
+StateCounts classify(std::span<const int64_t> starts,
+                     std::span<const int64_t> ends, int64_t now,
+                     std::span<EventState> states = {});
+
+// "avx512", "avx2" or "scalar", for diagnostics.
+const char *kernel_name();
+
+} // namespace scan
+} // namespace task_manager
@@ -0,0 +1,85 @@
+#pragma once
+#include "event_store.hpp"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace task_manager {
+
+// Identifies the DB state a snapshot was taken from. SQLite's data_version
+// only means something within a single connection, so the size and mtime of
+// the main and WAL files stand in for it across processes.
+// Checkpoint the log first (checkpoint_wal()), a clean shutdown moves it
+// into the main file otherwise.
+struct SnapshotStamp {
+  uint32_t user_version = 0;
+  int64_t db_size = 0;
+  int64_t db_mtime_ns = 0;
+  int64_t wal_size = 0;
+  int64_t wal_mtime_ns = 0;
+
+  bool operator==(const SnapshotStamp &) const = default;
+};
+
+SnapshotStamp make_snapshot_stamp(const std::string &db_path,
+                                  uint32_t user_version);
+
+// Compact binary image of the resident calendar, mmapped read-only.
+//
+// Layout: header, then fixed-width columns (start, end as int64; id, name
+// offset/length, description offset/length as uint32; EventStore flags as
+// uint8) and finally one blob holding every name and description. The
+// columns are read in place, nothing is parsed.
+class Snapshot {
+public:
+  static constexpr uint32_t version = 1;
+
+  ~Snapshot();
+  Snapshot(Snapshot &&other) noexcept;
+  Snapshot &operator=(Snapshot &&other) noexcept;
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+
+  // Maps the file and checks magic, version and bounds. Returns nullopt on
+  // any mismatch, the caller then falls back to a full load.
+  static std::optional<Snapshot> open(const std::string &path);
+
+  // Written to a temporary file and renamed over `path`, so a crash never
+  // leaves a torn snapshot behind.
+  static bool write(const std::string &path, const SnapshotStamp &stamp,
+                    std::optional<int64_t> window_start_us, uint32_t next_id,
+                    const EventStore &events);
+
+  SnapshotStamp stamp() const;
+  std::optional<int64_t> window_start_us() const;
+  uint32_t next_id() const;
+  size_t size() const;
+
+  std::span<const int64_t> starts() const;
+  std::span<const int64_t> ends() const;
+  std::span<const uint32_t> ids() const;
+  std::span<const uint8_t> flags() const;
+  std::string_view name(size_t i) const;
+  std::string_view description(size_t i) const;
+
+private:
+  struct Header;
+  struct Columns {
+    const int64_t *starts, *ends;
+    const uint32_t *ids, *name_off, *name_len, *desc_off, *desc_len;
+    const uint8_t *flags;
+    const char *blob;
+  };
+
+  Snapshot(void *data, size_t length);
+  const Header &header() const;
+
+  void *_data = nullptr;
+  size_t _length = 0;
+  Columns _columns{};
+};
+
+} // namespace task_manager
@@ -0,0 +1,71 @@
+#pragma once
+#include "flat_id_map.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace task_manager {
+
+// Inverted index over the words of event names and descriptions.
+//
+// A word is a run of ASCII letters and digits, lowercased, or of non-ASCII
+// bytes (UTF-8 is kept as written, without case folding). Each word has a
+// posting list sorted by event id; a query intersects the lists from the
+// shortest one, galloping through the longer ones. Matches are scored with
+// BM25, a word in the name counting as name_weight words of description.
+//
+// Not synchronized, the calendar guards it with its own lock.
+class TextIndex {
+public:
+  static constexpr uint32_t name_weight = 3;
+
+  struct Match {
+    uint32_t id;
+    double score;
+  };
+
+  inline size_t size() const { return this->_doc_ids.size(); }
+  inline size_t word_count() const { return this->_postings.size(); }
+
+  // Indexes the event, replacing what was indexed for `id` before.
+  void add(uint32_t id, std::string_view name, std::string_view description);
+  void remove(uint32_t id);
+  void clear();
+
+  // Events containing every word of `query`, in id order. Empty when the
+  // query has no words or one of them appears nowhere.
+  std::vector<Match> search(std::string_view query) const;
+
+private:
+  // the event's length rides along so scoring never leaves the lists,
+  // all three saturate
+  struct Posting {
+    uint32_t id;
+    uint8_t name_tf;
+    uint8_t description_tf;
+    uint16_t length;
+  };
+  struct WordHash {
+    using is_transparent = void;
+    inline size_t operator()(std::string_view word) const {
+      return std::hash<std::string_view>()(word);
+    }
+  };
+
+  uint32_t intern(std::string_view word);
+
+  std::unordered_map<std::string, uint32_t, WordHash, std::equal_to<>>
+      _words;
+  std::vector<std::vector<Posting>> _postings; // by word id
+  // per indexed event, swap-and-pop like EventStore
+  FlatIdMap _doc_slots;
+  std::vector<uint32_t> _doc_ids;
+  std::vector<uint32_t> _doc_lengths; // weighted word count
+  std::vector<std::vector<uint32_t>> _doc_words;
+  uint64_t _total_length = 0;
+};
+
+} // namespace task_manager
@@ -1,6 +1,51 @@
 #pragma once
 #include "defines.hpp"
+#include <charconv>
 #include <chrono>
 #include <format>
+#include <optional>
+#include <string_view>
+#include <system_error>
 
 using namespace std::literals;
+
+namespace task_manager {
+
+// Parses "YYYY-MM-DD", "YYYY-MM-DDTHH:MM" or "YYYY-MM-DDTHH:MM:SS" as UTC,
+// the zone events are printed in. The date may also be written with dots,
+// like the event listing prints it.
+inline std::optional<std::chrono::system_clock::time_point>
+parse_time(std::string_view text) {
+  auto number = [&](size_t pos, size_t len, unsigned &out) {
+    if (pos + len > text.size())
+      return false;
+    const char *first = text.data() + pos;
+    auto [ptr, ec] = std::from_chars(first, first + len, out);
+    return ec == std::errc() && ptr == first + len;
+  };
+
+  unsigned y, mo, d, h = 0, mi = 0, s = 0;
+  if (!number(0, 4, y) || !number(5, 2, mo) || !number(8, 2, d))
+    return std::nullopt;
+  if ((text[4] != '-' && text[4] != '.') || text[7] != text[4])
+    return std::nullopt;
+  if (text.size() > 10) {
+    // the length first, the separators below are read without a check
+    if (text.size() != 16 && text.size() != 19)
+      return std::nullopt;
+    if ((text[10] != 'T' && text[10] != ' ') || !number(11, 2, h) ||
+        text[13] != ':' || !number(14, 2, mi))
+      return std::nullopt;
+    if (text.size() == 19 && (text[16] != ':' || !number(17, 2, s)))
+      return std::nullopt;
+  }
+
+  std::chrono::year_month_day date{std::chrono::year(static_cast<int>(y)),
+                                   std::chrono::month(mo), std::chrono::day(d)};
+  if (!date.ok() || h > 23 || mi > 59 || s > 59)
+    return std::nullopt;
+  return std::chrono::sys_days(date) + std::chrono::hours(h) +
+         std::chrono::minutes(mi) + std::chrono::seconds(s);
+}
+
+} // namespace task_manager
@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+
+// Timeline tracing, exported as Chrome trace-event JSON (chrome://tracing,
+// ui.perfetto.dev).
+//
+// Each thread appends finished spans to a ring of its own, the oldest ones
+// are overwritten once it is full. Nothing is shared on the recording path:
+// a relaxed store per field and a release store of the head. While tracing
+// is off a span costs one relaxed load. Span names and categories must be
+// string literals, only the pointers are kept.
+namespace task_manager::trace {
+
+// spans kept per thread
+inline constexpr size_t ring_capacity = size_t{1} << 15;
+
+namespace detail {
+inline std::atomic<bool> enabled{false};
+
+inline int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void record(const char *name, const char *category, int64_t start_ns,
+            int64_t dur_ns, uint64_t arg);
+} // namespace detail
+
+inline bool enabled() {
+  return detail::enabled.load(std::memory_order_relaxed);
+}
+inline void set_enabled(bool on) {
+  detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+// Shown instead of the thread id in the viewers
+void name_thread(const char *name);
+
+// Writes every span still held to `path` (through a temporary file).
+// Recording may go on meanwhile, spans finishing during the dump may be
+// missing from it.
+bool dump(const std::string &path);
+
+// $TASK_MANAGER_TRACE, or task_manager_trace.json in the working directory
+// when it isn't set
+std::string default_path();
+
+// Scoped span, recorded when it ends. `arg` shows up as args.n, e.g. the
+// number of events a load or a batch handled.
+class Span {
+public:
+  static constexpr uint64_t no_arg = std::numeric_limits<uint64_t>::max();
+
+  explicit Span(const char *name, const char *category = "calendar")
+      : _name(enabled() ? name : nullptr), _category(category),
+        _start_ns(_name ? detail::now_ns() : 0) {}
+  ~Span() {
+    if (this->_name)
+      detail::record(this->_name, this->_category, this->_start_ns,
+                     detail::now_ns() - this->_start_ns, this->_arg);
+  }
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  inline void set_arg(uint64_t arg) { this->_arg = arg; }
+
+private:
+  const char *_name; // nullptr while tracing was off at the start
+  const char *_category;
+  int64_t _start_ns;
+  uint64_t _arg = no_arg;
+};
+
+// Tracing for the lifetime of a process: from_env() turns it on when
+// TASK_MANAGER_TRACE names an output file, the destructor writes it.
+class Session {
+public:
+  explicit Session(std::string path);
+  ~Session();
+  Session(const Session &) = delete;
+  Session &operator=(const Session &) = delete;
+
+  // nullptr when TASK_MANAGER_TRACE isn't set
+  static std::unique_ptr<Session> from_env();
+
+private:
+  std::string _path;
+};
+
+} // namespace task_manager::trace
@@ -0,0 +1,95 @@
+#pragma once
+#include "event_store.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace task_manager {
+
+enum class TransitionKind : uint8_t {
+  Start, // future -> ongoing, fires at start
+  End,   // ongoing -> past, fires right after end
+};
+
+struct Transition {
+  time_point at;
+  time_point start, end; // interval of the event when it was scheduled
+  uint32_t id;
+  TransitionKind kind;
+};
+
+// Min-heap of upcoming start/end boundaries.
+//
+// Entries are never removed eagerly: when an event is moved or deleted its
+// old entries stay in the heap and the consumer drops them when they pop by
+// checking the (start, end, id) snapshot against the live event.
+class TransitionQueue {
+public:
+  TransitionQueue() = default;
+  ~TransitionQueue() = default;
+
+  // Schedule the boundaries of the event that are still ahead of time_p.
+  inline void schedule(const time_point &start, const time_point &end,
+                       uint32_t id, const time_point &time_p) {
+    if (start > time_p) {
+      this->push({start, start, end, id, TransitionKind::Start});
+    }
+    if (end >= time_p) {
+      // an event is ongoing while end >= now, it flips one tick later
+      this->push({end + time_point::duration(1), start, end, id,
+                  TransitionKind::End});
+    }
+  }
+
+  // Collect entries first and heapify once, O(n) instead of O(n log n).
+  inline void rebuild(const EventStore &store, const time_point &time_p) {
+    this->_heap.clear();
+    this->_bulk = true;
+    for (uint32_t slot = 0; slot < store.size(); ++slot) {
+      this->schedule(store.start(slot), store.end(slot), store.id(slot),
+                     time_p);
+    }
+    this->_bulk = false;
+    std::make_heap(this->_heap.begin(), this->_heap.end(), later);
+  }
+
+  // Pop every entry due at or before time_p, in time order.
+  template <typename Fn> size_t pop_due(const time_point &time_p, Fn &&fn) {
+    size_t popped = 0;
+    while (!this->_heap.empty() && this->_heap.front().at <= time_p) {
+      std::pop_heap(this->_heap.begin(), this->_heap.end(), later);
+      Transition transition = this->_heap.back();
+      this->_heap.pop_back();
+      fn(transition);
+      ++popped;
+    }
+    return popped;
+  }
+
+  inline std::optional<time_point> next() const {
+    if (this->_heap.empty())
+      return std::nullopt;
+    return this->_heap.front().at;
+  }
+
+  inline size_t size() const { return this->_heap.size(); }
+  inline bool empty() const { return this->_heap.empty(); }
+  inline void clear() { this->_heap.clear(); }
+
+private:
+  static bool later(const Transition &a, const Transition &b) {
+    return a.at > b.at;
+  }
+
+  inline void push(const Transition &transition) {
+    this->_heap.push_back(transition);
+    if (!this->_bulk)
+      std::push_heap(this->_heap.begin(), this->_heap.end(), later);
+  }
+
+  std::vector<Transition> _heap;
+  bool _bulk = false;
+};
+
+} // namespace task_manager
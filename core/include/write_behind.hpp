@@ -0,0 +1,126 @@
+#pragma once
+#include "db.hpp"
+#include "event.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace task_manager {
+
+// Unbounded lock-free multi-producer single-consumer queue (Vyukov).
+// push() is wait-free for producers, pop() must only be called from the
+// consumer thread.
+template <typename T> class MpscQueue {
+public:
+  MpscQueue() : _head(new Node), _tail(_head.load()) {}
+  ~MpscQueue() {
+    T discard;
+    while (this->pop(discard)) {
+    }
+    delete this->_tail;
+  }
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  void push(T value) {
+    Node *node = new Node;
+    node->value = std::move(value);
+    Node *prev = this->_head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  bool pop(T &out) {
+    Node *tail = this->_tail;
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr)
+      return false;
+    out = std::move(next->value);
+    this->_tail = next;
+    delete tail;
+    return true;
+  }
+
+private:
+  struct Node {
+    std::atomic<Node *> next{nullptr};
+    T value;
+  };
+
+  std::atomic<Node *> _head; // producers
+  Node *_tail;               // consumer, always a stub node
+};
+
+struct WriteBehindOptions {
+  // commit at least this often while there are pending operations
+  std::chrono::milliseconds max_delay{50};
+  // or as soon as this many operations are queued
+  size_t max_batch = 1024;
+};
+
+// Background persistence for Calendar mutations.
+//
+// Operations are queued without blocking the caller and a worker thread
+// commits them in groups, one transaction per group. A group that fails is
+// retried one operation at a time and the ids of the operations failing on
+// their own are kept for take_failures(). The destructor drains whatever is
+// still queued before returning.
+class WriteBehind {
+public:
+  using Storage = decltype(init_storage());
+
+  WriteBehind(Storage &storage, WriteBehindOptions options = {});
+  ~WriteBehind();
+  WriteBehind(const WriteBehind &) = delete;
+  WriteBehind &operator=(const WriteBehind &) = delete;
+
+  // Inserts use the id already set on the event, reserved beforehand with
+  // reserve_event_ids(). A plain INSERT: a taken id fails, it never
+  // overwrites the row.
+  void insert(const Event &event);
+  void update(const Event &event);
+  void remove(uint32_t id);
+  // Blocks until every operation queued before the call is committed.
+  void flush();
+
+  inline uint64_t failed_operations() const {
+    return this->_failed.load(std::memory_order_relaxed);
+  }
+  // Ids of the events whose operation failed since the last call
+  std::vector<uint32_t> take_failures();
+
+private:
+  enum class OpKind : uint8_t { Insert, Update, Remove, Flush };
+
+  struct Op {
+    OpKind kind = OpKind::Flush;
+    Event event;
+    uint32_t id = 0;
+    std::shared_ptr<std::promise<void>> barrier;
+  };
+
+  void enqueue(Op op, bool urgent);
+  void run();
+  void commit(std::vector<Op> &batch);
+  void apply(const Op &op);
+
+  Storage &_storage;
+  WriteBehindOptions _options;
+  MpscQueue<Op> _queue;
+  std::atomic<size_t> _pending{0};
+  std::atomic<uint64_t> _failed{0};
+  std::mutex _failures_mutex;
+  std::vector<uint32_t> _failures;
+  std::atomic<bool> _urgent{false};
+  std::atomic<bool> _stop{false};
+  std::mutex _wake_mutex;
+  std::condition_variable _wake;
+  std::thread _thread;
+};
+
+} // namespace task_manager
@@ -1,80 +1,172 @@
 #include "calendar.hpp"
 #include "db.hpp"
+#include "metrics.hpp"
+#include "parallel_load.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <sys/types.h>
+#include <system_error>
+#include <thread>
 
 namespace task_manager {
 
+namespace {
+// ids of the events in one state, slots maps id -> position
+using Bucket = std::vector<uint32_t>;
+
+void bucket_push(Bucket &bucket, FlatIdMap &slots, uint32_t id) {
+  slots.set(id, static_cast<uint32_t>(bucket.size()));
+  bucket.push_back(id);
+}
+
+// swap-and-pop, the slot map tells where the event sits in the bucket
+bool bucket_erase(Bucket &bucket, FlatIdMap &slots, uint32_t id) {
+  uint32_t slot = slots.find(id);
+  if (slot == FlatIdMap::npos)
+    return false;
+  if (slot + 1 != bucket.size()) {
+    bucket[slot] = bucket.back();
+    slots.set(bucket[slot], slot);
+  }
+  bucket.pop_back();
+  slots.erase(id);
+  return true;
+}
+} // namespace
+
+void Calendar::enable_write_behind(WriteBehindOptions options) {
+  auto lock = this->write_lock();
+  if (!this->_write_behind)
+    this->_write_behind = std::make_unique<WriteBehind>(_storage, options);
+}
+
+void Calendar::disable_write_behind() {
+  auto lock = this->write_lock();
+  if (!this->_write_behind)
+    return;
+  this->_write_behind->flush();
+  this->revert_failed_writes();
+  this->_write_behind.reset();
+}
+
+bool Calendar::flush() {
+  {
+    // the queue itself is thread-safe, the lock only keeps the worker alive
+    std::shared_lock lock(this->_mutex);
+    if (!this->_write_behind)
+      return true;
+    this->_write_behind->flush();
+  }
+  auto lock = this->write_lock();
+  return this->revert_failed_writes() == 0;
+}
+
+std::optional<uint32_t> Calendar::reserve_ids(uint32_t count) {
+  if (uint64_t{this->_next_id} + count > this->_reserved_end) {
+    uint32_t block = std::max(count, id_block);
+    std::string db_path = this->_storage.filename();
+    if (db_path.empty() || db_path == ":memory:") {
+      // no other connection can reach it, the ids past max(id) are ours
+      this->_reserved_end = this->_next_id + block;
+    } else {
+      auto first = reserve_event_ids(db_path, block);
+      if (!first) {
+        metrics::add(metrics::Counter::DbErrors);
+        return std::nullopt;
+      }
+      this->_next_id = *first;
+      this->_reserved_end = *first + block;
+    }
+  }
+  uint32_t first = this->_next_id;
+  this->_next_id += count;
+  return first;
+}
+
+size_t Calendar::revert_failed_writes() {
+  if (!this->_write_behind)
+    return 0;
+  auto ids = this->_write_behind->take_failures();
+  if (ids.empty())
+    return 0;
+  // the rows read back below have to reflect everything queued so far
+  this->_write_behind->flush();
+  auto later = this->_write_behind->take_failures();
+  ids.insert(ids.end(), later.begin(), later.end());
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+  // the DB is right, bring the in-memory model back in line with it
+  for (uint32_t id : ids) {
+    try {
+      auto row = this->_storage.get_pointer<Event>(id);
+      this->unload_event(id);
+      if (!row)
+        continue;
+      row->update_members_from_db();
+      if (!this->is_archived(row->get_end()))
+        this->_changes.append(ChangeKind::Created, id);
+      this->adopt_archived_event(*row);
+    } catch (const std::exception &e) {
+      metrics::add(metrics::Counter::DbErrors);
+      std::cerr << "Error reloading event " << id << ": " << e.what()
+                << std::endl;
+    }
+  }
+  std::cerr << ids.size() << " queued change(s) could not be saved and "
+            << "were undone" << std::endl;
+  return ids.size();
+}
+
 int Calendar::tick() {
-  this->_now = std::chrono::system_clock::now();
-  this->update_ongoing_events(false, this->_now);
-  return 0;
+  metrics::ScopedTimer timer(metrics::Timer::Tick);
+  trace::Span span("tick");
+  auto lock = this->write_lock();
+  this->revert_failed_writes();
+  auto now = std::chrono::system_clock::now();
+  if (now < this->_now) {
+    // wall clock went backwards, resync everything
+    this->refresh_ongoing_events(false, now);
+    return 0;
+  }
+  this->_now = now;
+  return static_cast<int>(this->apply_transitions(now));
 }
 
 bool Calendar::update_ongoing_events(bool clear, const time_point &time_p) {
-  try {
-    auto reclassify = [&](auto &src, auto &dst, auto pred) {
-      for (auto it = src.begin(); it != src.end();) {
-        if (pred(*it)) {
-          dst.push_back(std::move(*it));
-          it = src.erase(it);
-        } else {
-          ++it;
-        }
-      }
-    };
+  auto lock = this->write_lock();
+  return this->refresh_ongoing_events(clear, time_p);
+}
 
-    if (clear) {
-      // full rebuild
-      this->_past_events.clear();
+bool Calendar::refresh_ongoing_events(bool clear, const time_point &time_p) {
+  try {
+    if (clear || time_p < this->_now) {
+      // full rebuild, also needed when going back in time since the
+      // transition heap only holds boundaries ahead of _now
+      metrics::ScopedTimer timer(metrics::Timer::RefreshOngoing);
+      trace::Span span("reclassify");
+      span.set_arg(this->_store.size());
+      if (clear)
+        this->rebuild_index();
       this->_ongoing_events.clear();
-      this->_future_events.clear();
-
-      this->_past_events.reserve(this->_all_events.size());
-      this->_ongoing_events.reserve(
-          5); // arbitrary number, only a few will be ongoing at a given time
-      this->_future_events.reserve(this->_all_events.size());
-
-      for (auto &event_ptr : this->_all_events) {
-        if (event_ptr->get_end() < time_p) {
-          this->_past_events.push_back(event_ptr);
-        } else if (event_ptr->get_start() > time_p) {
-          this->_future_events.push_back(event_ptr);
-        } else {
-          this->_ongoing_events.push_back(event_ptr);
-        }
+      this->_ongoing_slots.clear();
+      // straight scan over the time columns
+      // the buckets were just emptied, the flag column still holds the
+      // previous state
+      for (uint32_t slot = 0; slot < this->_store.size(); ++slot) {
+        bool was = this->_store.flags(slot) & EventStore::Ongoing;
+        bool ongoing = this->_store.start(slot) <= time_p &&
+                       this->_store.end(slot) >= time_p;
+        this->set_ongoing(slot, ongoing);
+        if (ongoing != was)
+          this->record_transition(slot, ongoing);
       }
+      this->_transitions.rebuild(this->_store, time_p);
     } else {
-      // incremental update
-      reclassify(this->_past_events, this->_future_events,
-                 [&](const auto &event_ptr) {
-                   return event_ptr->get_start() > time_p;
-                 });
-
-      reclassify(this->_past_events, this->_ongoing_events,
-                 [&](const auto &event_ptr) {
-                   return event_ptr->get_start() <= time_p &&
-                          event_ptr->get_end() >= time_p;
-                 });
-
-      reclassify(
-          this->_ongoing_events, this->_past_events,
-          [&](const auto &event_ptr) { return event_ptr->get_end() < time_p; });
-
-      reclassify(this->_ongoing_events, this->_future_events,
-                 [&](const auto &event_ptr) {
-                   return event_ptr->get_start() > time_p;
-                 });
-
-      reclassify(
-          this->_future_events, this->_past_events,
-          [&](const auto &event_ptr) { return event_ptr->get_end() < time_p; });
-
-      reclassify(this->_future_events, this->_ongoing_events,
-                 [&](const auto &event_ptr) {
-                   return event_ptr->get_start() <= time_p &&
-                          event_ptr->get_end() >= time_p;
-                 });
+      // incremental update, only touches events whose state flips
+      this->apply_transitions(time_p);
     }
+    this->_now = time_p;
   } catch (const std::exception &e) {
     std::cerr << "Error updating events: " << e.what() << std::endl;
     return false;
@@ -86,26 +178,340 @@ bool Calendar::update_ongoing_events(bool clear, const time_point &time_p) {
   return true;
 }
 
-bool Calendar::load_event(Event &event, const time_point &time_p) {
-  auto event_ptr = std::make_shared<Event>(event);
+void Calendar::rebuild_index() {
+  this->_index.clear();
+  this->_index.reserve(this->_store.size());
+  for (uint32_t slot = 0; slot < this->_store.size(); ++slot) {
+    this->_index.insert(this->_store.start(slot), this->_store.end(slot),
+                        this->_store.id(slot));
+  }
+}
 
-  this->_all_events.push_back(event_ptr);
+size_t Calendar::apply_transitions(const time_point &time_p) {
+  size_t flipped = 0;
+  this->_transitions.pop_due(time_p, [&](const Transition &transition) {
+    uint32_t slot = this->_store.find(transition.id);
+    // stale entry, the event was moved or removed after it was scheduled
+    if (slot == EventStore::npos ||
+        this->_store.start(slot) != transition.start ||
+        this->_store.end(slot) != transition.end)
+      return;
 
-  if (event_ptr->get_end() < time_p) {
-    this->_past_events.push_back(event_ptr);
-  } else if (event_ptr->get_start() > time_p) {
-    this->_future_events.push_back(event_ptr);
+    bool ongoing = transition.kind == TransitionKind::Start;
+    if (this->set_ongoing(slot, ongoing)) {
+      this->record_transition(slot, ongoing);
+      ++flipped;
+    }
+  });
+
+  // stale entries pile up with updates and removals, compact once they
+  // dominate the heap
+  if (this->_transitions.size() > 4 * this->_store.size() + 64) {
+    this->_transitions.rebuild(this->_store, time_p);
+  }
+  return flipped;
+}
+
+bool Calendar::set_ongoing(uint32_t slot, bool ongoing) {
+  // keeps the bucket and the store's flag column in step, returns whether
+  // the event changed state
+  uint32_t id = this->_store.id(slot);
+  uint8_t flags = this->_store.flags(slot);
+  bool changed;
+  if (ongoing) {
+    changed = !this->_ongoing_slots.contains(id);
+    if (changed)
+      bucket_push(this->_ongoing_events, this->_ongoing_slots, id);
+    flags |= EventStore::Ongoing;
   } else {
-    this->_ongoing_events.push_back(event_ptr);
+    changed = bucket_erase(this->_ongoing_events, this->_ongoing_slots, id);
+    flags &= ~EventStore::Ongoing;
+  }
+  this->_store.set_flags(slot, flags);
+  return changed;
+}
+
+void Calendar::track_event(uint32_t slot, const time_point &time_p) {
+  this->_index.insert(this->_store.start(slot), this->_store.end(slot),
+                      this->_store.id(slot));
+  this->set_ongoing(slot, this->_store.start(slot) <= time_p &&
+                              this->_store.end(slot) >= time_p);
+}
+
+void Calendar::schedule_transitions(uint32_t slot, const time_point &time_p) {
+  // read back from the store, its microsecond times are what
+  // apply_transitions() compares against
+  this->_transitions.schedule(this->_store.start(slot), this->_store.end(slot),
+                              this->_store.id(slot), time_p);
+}
+
+void Calendar::move_event(uint32_t slot, const time_point &start,
+                          const time_point &end) {
+  int64_t start_us = EventStore::to_us(start);
+  int64_t end_us = EventStore::to_us(end);
+  if (this->_store.start_us(slot) == start_us &&
+      this->_store.end_us(slot) == end_us)
+    return;
+
+  // cached archive queries may hold it, or miss it, after the move
+  if (this->is_archived(this->_store.end(slot)) || this->is_archived(end))
+    this->_archived_ranges.clear();
+
+  // the index is keyed by start, re-insert the event with its new interval
+  uint32_t id = this->_store.id(slot);
+  this->_index.erase(this->_store.start(slot), id);
+  this->_store.set_interval(slot, start_us, end_us);
+  this->_index.insert(this->_store.start(slot), this->_store.end(slot), id);
+  this->schedule_transitions(slot, this->_now);
+  bool ongoing = this->_store.start(slot) <= this->_now &&
+                 this->_store.end(slot) >= this->_now;
+  if (this->set_ongoing(slot, ongoing))
+    this->record_transition(slot, ongoing);
+}
+
+std::vector<Event>
+Calendar::to_events(const std::vector<uint32_t> &ids) const {
+  std::vector<Event> events;
+  events.reserve(ids.size());
+  for (uint32_t id : ids) {
+    events.push_back(this->_store.to_event(this->_store.find(id)));
+  }
+  return events;
+}
+
+namespace {
+// Copies of the snapshot events matching `keep`, the first `limit` of them
+// in the (start, id) order of the index.
+template <typename Keep>
+std::vector<Event>
+collect(const EventSnapshot &snapshot, Keep &&keep,
+        size_t limit = std::numeric_limits<size_t>::max()) {
+  std::vector<EventView> views;
+  for (EventView view : snapshot) {
+    if (keep(view))
+      views.push_back(view);
+  }
+  limit = std::min(limit, views.size());
+  std::partial_sort(views.begin(),
+                    views.begin() + static_cast<ptrdiff_t>(limit),
+                    views.end(), [](const EventView &a, const EventView &b) {
+                      return std::pair(a.get_start(), a.get_id()) <
+                             std::pair(b.get_start(), b.get_id());
+                    });
+  std::vector<Event> events;
+  events.reserve(limit);
+  for (size_t i = 0; i < limit; ++i) {
+    events.push_back(views[i].to_event());
+  }
+  return events;
+}
+} // namespace
+
+size_t Calendar::resident_size() const {
+  return this->read([&] { return this->_store.size(); },
+                    [](const EventSnapshot &snapshot) {
+                      return snapshot.size();
+                    });
+}
+
+std::vector<uint32_t> Calendar::resident_ids() const {
+  return this->read(
+      [&] {
+        auto ids = this->_store.ids();
+        return std::vector<uint32_t>(ids.begin(), ids.end());
+      },
+      [](const EventSnapshot &snapshot) {
+        std::vector<uint32_t> ids;
+        ids.reserve(snapshot.size());
+        for (EventView view : snapshot) {
+          ids.push_back(view.get_id());
+        }
+        return ids;
+      });
+}
+
+std::shared_ptr<const EventSnapshot> Calendar::snapshot() const {
+  std::shared_ptr<const EventSnapshot> current;
+  {
+    std::lock_guard snapshot_lock(this->_snapshot_mutex);
+    current = this->_snapshot;
   }
+  std::shared_lock lock(this->_mutex, std::defer_lock);
+  if (!current) {
+    // nothing published yet, this one has to wait for the writer
+    lock.lock();
+  } else if (!lock.try_lock()) {
+    // a write is in flight, the last published state will do
+    return current;
+  }
+  if (current && current->version() == this->_store.version())
+    return current;
+  return this->publish_snapshot(current);
+}
+
+std::unique_lock<std::shared_mutex> Calendar::write_lock() {
+  std::unique_lock lock(this->_mutex);
+  std::shared_ptr<const EventSnapshot> current;
+  {
+    std::lock_guard snapshot_lock(this->_snapshot_mutex);
+    current = this->_snapshot;
+  }
+  if (!current || current->version() != this->_store.version())
+    this->publish_snapshot(current);
+  return lock;
+}
+
+std::shared_ptr<const EventSnapshot> Calendar::publish_snapshot(
+    const std::shared_ptr<const EventSnapshot> &previous) const {
+  // with _mutex held the store can't change under make(); readers racing
+  // here build the same version, whichever lands is fine
+  auto next = EventSnapshot::make(this->_store, previous);
+  std::lock_guard snapshot_lock(this->_snapshot_mutex);
+  this->_snapshot = next;
+  return next;
+}
+
+std::vector<Event> Calendar::get_ongoing_events() const {
+  return this->read(
+      [&] { return this->to_events(this->_ongoing_events); },
+      [](const EventSnapshot &snapshot) {
+        return collect(snapshot,
+                       [](const EventView &view) { return view.is_ongoing(); });
+      });
+}
+
+std::vector<Event>
+Calendar::get_ongoing_events(const time_point &time_p) const {
+  return this->read(
+      [&] { return this->to_events(this->_index.ongoing(time_p)); },
+      [&](const EventSnapshot &snapshot) {
+        return collect(snapshot, [&](const EventView &view) {
+          return view.get_start() <= time_p && view.get_end() >= time_p;
+        });
+      });
+}
+
+std::vector<Event>
+Calendar::get_overlapping_events(const time_point &from,
+                                 const time_point &to) const {
+  return this->read(
+      [&] { return this->to_events(this->_index.overlapping(from, to)); },
+      [&](const EventSnapshot &snapshot) {
+        return collect(snapshot, [&](const EventView &view) {
+          return view.get_start() <= to && view.get_end() >= from;
+        });
+      });
+}
+
+std::vector<Event> Calendar::get_past_events(const time_point &time_p) const {
+  return this->read(
+      [&] { return this->to_events(this->_index.ended_before(time_p)); },
+      [&](const EventSnapshot &snapshot) {
+        return collect(snapshot, [&](const EventView &view) {
+          return view.get_end() < time_p;
+        });
+      });
+}
+
+std::vector<Event> Calendar::get_future_events(const time_point &time_p,
+                                               size_t limit) const {
+  return this->read(
+      [&] {
+        return this->to_events(this->_index.starting_after(time_p, limit));
+      },
+      [&](const EventSnapshot &snapshot) {
+        return collect(
+            snapshot,
+            [&](const EventView &view) { return view.get_start() > time_p; },
+            limit);
+      });
+}
+
+std::optional<Event> Calendar::find_event(uint32_t id) const {
+  return this->read(
+      [&]() -> std::optional<Event> {
+        uint32_t slot = this->_store.find(id);
+        if (slot == EventStore::npos)
+          return std::nullopt;
+        return this->_store.to_event(slot);
+      },
+      [&](const EventSnapshot &snapshot) -> std::optional<Event> {
+        // no id map in a snapshot, this only runs while a write is in flight
+        for (EventView view : snapshot) {
+          if (view.get_id() == id)
+            return view.to_event();
+        }
+        return std::nullopt;
+      });
+}
+
+bool Calendar::load_event(Event &event, const time_point &time_p) {
+  this->track_event(this->_store.push(event), time_p);
   return true;
 }
 
+void Calendar::clear_events(size_t expected) {
+  this->_store.clear();
+  this->_store.reserve(expected);
+  this->_ongoing_events.clear();
+  this->_ongoing_slots.clear();
+  this->_index.clear();
+  this->_index.reserve(expected);
+}
+
 void Calendar::load_events_from_db() {
+  metrics::ScopedTimer timer(metrics::Timer::Load);
+  trace::Span span("load");
   auto load_time_p = std::chrono::system_clock::now();
-  auto storage = this->get_storage();
-  storage.sync_schema();
-  auto db_events = storage.get_all<Event>();
+  // a copy would open a connection of its own
+  auto &storage = this->get_storage();
+  {
+    trace::Span sync_span("sync_schema", "sqlite");
+    storage.sync_schema();
+  }
+  // everything that ended before the window stays in the DB
+  this->_window_start.reset();
+  if (this->_options.resident_past)
+    this->_window_start = load_time_p - *this->_options.resident_past;
+  this->_archived_events.clear();
+  this->_archived_ranges.clear();
+  this->_now = load_time_p;
+
+  if (this->_options.snapshot_path &&
+      this->load_events_from_snapshot(load_time_p)) {
+    this->_transitions.rebuild(this->_store, load_time_p);
+    metrics::add(metrics::Counter::EventsLoaded, this->_store.size());
+    span.set_arg(this->_store.size());
+    return;
+  }
+
+  // past every row, archived ones included: the windowed loads below only
+  // see the resident rows, and an old-dated event can have a recent id
+  if (auto max_id = storage.max(&Event::_id))
+    this->_next_id = static_cast<uint32_t>(*max_id) + 1;
+
+  if (this->_options.load_threads != 1 &&
+      this->load_events_parallel(load_time_p)) {
+    this->_transitions.rebuild(this->_store, load_time_p);
+    metrics::add(metrics::Counter::EventsLoaded, this->_store.size());
+    span.set_arg(this->_store.size());
+    return;
+  }
+
+  std::vector<Event> db_events;
+  {
+    trace::Span get_span("get_all events", "sqlite");
+    db_events =
+        this->_window_start
+            ? storage.get_all<Event>(where(
+                  c(&Event::_end_db) >=
+                  std::chrono::time_point_cast<std::chrono::microseconds>(
+                      *this->_window_start)
+                      .time_since_epoch()
+                      .count()))
+            : storage.get_all<Event>();
+    get_span.set_arg(db_events.size());
+  }
 
   // TODO: use log library
   // std::cout << "Stored Events: " << std::endl;
@@ -113,130 +519,1097 @@ void Calendar::load_events_from_db() {
   //   std::cout << event;
   // }
 
-  this->_all_events.clear();
-  this->_all_events.reserve(db_events.size());
+  this->clear_events(db_events.size());
 
   for (auto &ev : db_events) {
     ev.update_members_from_db();
     this->load_event(ev, load_time_p);
   }
+
+  this->_transitions.rebuild(this->_store, load_time_p);
+  metrics::add(metrics::Counter::EventsLoaded, this->_store.size());
+  span.set_arg(this->_store.size());
 }
 
-bool Calendar::save_event_in_db(std::shared_ptr<Event> &event_ptr) {
+bool Calendar::load_events_parallel(const time_point &load_time_p) {
+  std::string db_path = this->_storage.filename();
+  // an in-memory DB can't be opened a second time
+  if (db_path.empty() || db_path == ":memory:")
+    return false;
+
+  unsigned threads = this->_options.load_threads;
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  int64_t min_end_us = this->_window_start
+                           ? EventStore::to_us(*this->_window_start)
+                           : std::numeric_limits<int64_t>::min();
+  std::optional<std::vector<EventChunk>> chunks;
+  {
+    trace::Span read_span("read events", "sqlite");
+    chunks = read_events_parallel(db_path, min_end_us, threads);
+  }
+  if (!chunks) {
+    metrics::add(metrics::Counter::DbErrors);
+    return false;
+  }
+
+  // the one merge: chunks are in id order, copied once into the store
+  trace::Span merge_span("merge chunks");
+  size_t count = 0, text_bytes = 0;
+  for (const EventChunk &chunk : *chunks) {
+    count += chunk.size();
+    text_bytes += chunk.text.size();
+  }
+  this->clear_events(count);
+  this->_store.reserve(count, text_bytes);
+  for (EventChunk &chunk : *chunks) {
+    for (size_t i = 0; i < chunk.size(); ++i) {
+      uint32_t slot = this->_store.push(
+          chunk.ids[i], chunk.starts[i], chunk.ends[i],
+          chunk.ongoing[i] ? uint8_t{EventStore::Ongoing} : uint8_t{0},
+          chunk.name(i), chunk.description(i));
+      this->track_event(slot, load_time_p);
+    }
+    // give the memory back as we go
+    chunk = EventChunk();
+  }
+  merge_span.set_arg(count);
+  return true;
+}
+
+bool Calendar::load_events_from_snapshot(const time_point &load_time_p) {
+  trace::Span span("load snapshot");
+  auto snapshot = Snapshot::open(*this->_options.snapshot_path);
+  if (!snapshot)
+    return false;
+
+  // any write since the snapshot was taken changes the DB files
+  auto stamp = make_snapshot_stamp(this->_storage.filename(),
+                                   this->_storage.pragma.user_version());
+  if (snapshot->stamp() != stamp)
+    return false;
+
+  // the snapshot has to hold at least the window we want resident
+  auto window_us = snapshot->window_start_us();
+  if (window_us) {
+    auto window = time_point(std::chrono::microseconds(*window_us));
+    if (!this->_window_start || window > *this->_window_start)
+      return false;
+    this->_window_start = window;
+  } else {
+    // saved with every event resident, nothing is archived: a window kept
+    // here would count the old events twice, in the store and in the DB
+    this->_window_start.reset();
+  }
+
+  auto starts = snapshot->starts();
+  auto ends = snapshot->ends();
+  auto ids = snapshot->ids();
+  auto flags = snapshot->flags();
+  this->clear_events(snapshot->size());
+  // column to column, no Event is ever built
+  std::vector<IntervalIndex::Entry> entries;
+  entries.reserve(snapshot->size());
+  for (size_t i = 0; i < snapshot->size(); ++i) {
+    uint32_t slot =
+        this->_store.push(ids[i], starts[i], ends[i], flags[i],
+                          snapshot->name(i), snapshot->description(i));
+    auto start = this->_store.start(slot);
+    auto end = this->_store.end(slot);
+    this->set_ongoing(slot, start <= load_time_p && end >= load_time_p);
+    entries.push_back({start, end, ids[i]});
+  }
+  // sorted once and built bottom-up, far cheaper than an insert per event
+  std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+    return a.start < b.start || (a.start == b.start && a.id < b.id);
+  });
+  this->_index.assign_sorted(entries);
+  // the DB hasn't changed since, so it's still past every id in it
+  this->_next_id = std::max(snapshot->next_id(), 1u);
+  return true;
+}
+
+bool Calendar::save_snapshot() {
+  if (!this->_options.snapshot_path)
+    return false;
+  std::shared_lock lock(this->_mutex);
+  // the stamp must describe the DB with every queued write applied
+  if (this->_write_behind)
+    this->_write_behind->flush();
+
+  trace::Span span("save snapshot");
+  std::optional<int64_t> window_us;
+  if (this->_window_start) {
+    window_us = std::chrono::time_point_cast<std::chrono::microseconds>(
+                    *this->_window_start)
+                    .time_since_epoch()
+                    .count();
+  }
+  try {
+    // under WAL the last connection to close would change the files
+    checkpoint_wal(this->_storage.filename());
+    auto stamp = make_snapshot_stamp(this->_storage.filename(),
+                                     this->_storage.pragma.user_version());
+    return Snapshot::write(*this->_options.snapshot_path, stamp, window_us,
+                           this->_next_id, this->_store);
+  } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
+    std::cerr << "Error saving snapshot: " << e.what() << std::endl;
+    return false;
+  }
+}
+
+Calendar::InsertStatement &Calendar::insert_statement() {
+  if (!this->_insert_statement)
+    this->_insert_statement.emplace(this->_storage.prepare(insert(Event())));
+  return *this->_insert_statement;
+}
+
+Calendar::UpdateStatement &Calendar::update_statement() {
+  if (!this->_update_statement)
+    this->_update_statement.emplace(this->_storage.prepare(update(Event())));
+  return *this->_update_statement;
+}
+
+Calendar::RemoveStatement &Calendar::remove_statement() {
+  if (!this->_remove_statement) {
+    this->_remove_statement.emplace(
+        this->_storage.prepare(remove<Event>(uint32_t{})));
+  }
+  return *this->_remove_statement;
+}
+
+Calendar::RangeStatement &Calendar::range_statement() const {
+  if (!this->_range_statement) {
+    this->_range_statement.emplace(this->_storage.prepare(
+        get_all<Event>(where(c(&Event::_start_db) <= int64_t{} and
+                             c(&Event::_end_db) >= int64_t{} and
+                             c(&Event::_end_db) < int64_t{}))));
+  }
+  return *this->_range_statement;
+}
+
+bool Calendar::save_event_in_db(Event &event) {
+  trace::Span span("save event");
+  if (this->_write_behind) {
+    auto id = this->reserve_ids(1);
+    if (!id)
+      return false;
+    event.set_id(*id);
+    this->_write_behind->insert(event);
+    return true;
+  }
+
   try {
+    metrics::ScopedTimer timer(metrics::Timer::DbTransaction);
+    trace::Span span("transaction", "sqlite");
+    auto &statement = this->insert_statement();
     _storage.transaction([&]() {
-      auto updated_id = _storage.insert(*event_ptr);
-      event_ptr->set_id(static_cast<uint32_t>(updated_id));
+      get<0>(statement) = event;
+      auto updated_id = _storage.execute(statement);
+      event.set_id(static_cast<uint32_t>(updated_id));
       return true;
     });
+    this->_next_id = std::max(this->_next_id, event.get_id() + 1);
     return true;
   } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
     std::cerr << "Error saving event: " << e.what() << std::endl;
     return false;
   }
 }
 
 bool Calendar::create_event(Event &event, const time_point &time_p) {
-  auto event_ptr = std::make_shared<Event>(event);
-  this->save_event_in_db(event_ptr);
+  auto lock = this->write_lock();
+  if (!this->save_event_in_db(event))
+    return false;
 
-  this->_all_events.push_back(event_ptr);
+  uint32_t slot = this->_store.push(event);
+  this->track_event(slot, time_p);
+  this->schedule_transitions(slot, time_p);
+  this->_changes.append(ChangeKind::Created, event.get_id());
+  return true;
+}
 
-  if (event_ptr->get_end() < time_p) {
-    this->_past_events.push_back(event_ptr);
-  } else if (event_ptr->get_start() > time_p) {
-    this->_future_events.push_back(event_ptr);
-  } else {
-    this->_ongoing_events.push_back(event_ptr);
+void Calendar::save_events_in_db(std::span<Event> events,
+                                 std::vector<OpStatus> &status) {
+  trace::Span span("save events");
+  span.set_arg(events.size());
+  if (this->_write_behind) {
+    auto first = this->reserve_ids(static_cast<uint32_t>(events.size()));
+    if (!first)
+      return;
+    for (size_t i = 0; i < events.size(); ++i) {
+      events[i].set_id(*first + static_cast<uint32_t>(i));
+      this->_write_behind->insert(events[i]);
+      status[i] = OpStatus::Ok;
+    }
+    return;
+  }
+
+  try {
+    metrics::ScopedTimer timer(metrics::Timer::DbTransaction);
+    trace::Span span("transaction", "sqlite");
+    // one transaction for the whole batch
+    auto &statement = this->insert_statement();
+    _storage.transaction([&]() {
+      for (size_t i = 0; i < events.size(); ++i) {
+        try {
+          get<0>(statement) = events[i];
+          auto inserted_id = _storage.execute(statement);
+          events[i].set_id(static_cast<uint32_t>(inserted_id));
+          this->_next_id = std::max(this->_next_id, events[i].get_id() + 1);
+          status[i] = OpStatus::Ok;
+        } catch (const std::system_error &e) {
+          metrics::add(metrics::Counter::DbErrors);
+          std::cerr << "Error saving event '" << events[i].get_name()
+                    << "': " << e.what() << std::endl;
+        }
+      }
+      return true;
+    });
+  } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
+    std::cerr << "Error saving events: " << e.what() << std::endl;
+    std::fill(status.begin(), status.end(), OpStatus::Failed);
   }
-  return true;
 }
 
-bool Calendar::update_event_in_db(std::shared_ptr<Event> &event_ptr) {
+std::vector<OpStatus> Calendar::create_events(std::span<Event> events,
+                                              const time_point &time_p) {
+  std::vector<OpStatus> status(events.size(), OpStatus::Failed);
+  if (events.empty())
+    return status;
+
+  auto lock = this->write_lock();
+  this->save_events_in_db(events, status);
+
+  this->_store.reserve(this->_store.size() + events.size());
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (status[i] != OpStatus::Ok)
+      continue;
+    uint32_t slot = this->_store.push(events[i]);
+    this->track_event(slot, time_p);
+    this->schedule_transitions(slot, time_p);
+    this->_changes.append(ChangeKind::Created, events[i].get_id());
+  }
+  return status;
+}
+
+bool Calendar::update_event_in_db(const Event &event) {
+  trace::Span span("update event");
+  if (this->_write_behind) {
+    this->_write_behind->update(event);
+    return true;
+  }
+
   try {
+    metrics::ScopedTimer timer(metrics::Timer::DbTransaction);
+    trace::Span span("transaction", "sqlite");
+    auto &statement = this->update_statement();
     _storage.transaction([&]() {
-      _storage.update(*event_ptr);
+      get<0>(statement) = event;
+      _storage.execute(statement);
       return true;
     });
     return true;
   } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
     std::cerr << "Error updating event: " << e.what() << std::endl;
     return false;
   } catch (...) {
+    metrics::add(metrics::Counter::DbErrors);
     std::cerr << "Unknown error updating event" << std::endl;
     return false;
   }
 }
 
 bool Calendar::update_event_by_id(uint32_t id, const std::string &name,
-                                  const std::string &desc) {
-  auto it = std::find_if(_all_events.begin(), _all_events.end(),
-                         [id](const auto &e) { return e->get_id() == id; });
-  if (it == _all_events.end())
+                                  const std::string &desc,
+                                  const std::optional<time_point> &start,
+                                  const std::optional<time_point> &end) {
+  auto lock = this->write_lock();
+  uint32_t slot = this->_store.find(id);
+  if (slot != EventStore::npos) {
+    this->_changes.append(ChangeKind::Updated, id);
+    if (!name.empty())
+      this->_store.set_name(slot, name);
+    if (!desc.empty())
+      this->_store.set_description(slot, desc);
+    if (start || end) {
+      this->move_event(slot, start.value_or(this->_store.start(slot)),
+                       end.value_or(this->_store.end(slot)));
+    }
+    return update_event_in_db(this->_store.to_event(slot));
+  }
+
+  auto event = this->find_event_anywhere(id);
+  if (!event)
     return false;
 
-  auto event_ptr = *it;
   if (!name.empty())
-    event_ptr->set_name(name);
+    event->set_name(name);
   if (!desc.empty())
-    event_ptr->set_description(desc);
-  return update_event_in_db(event_ptr);
+    event->set_description(desc);
+  if (start)
+    event->set_start(*start);
+  if (end)
+    event->set_end(*end);
+  this->_changes.append(ChangeKind::Updated, id);
+  this->adopt_archived_event(*event);
+  return update_event_in_db(*event);
 }
 
-bool Calendar::remove_event_from_db(std::shared_ptr<Event> &event_ptr) {
+void Calendar::adopt_archived_event(const Event &event) {
+  // an archived event was changed, drop the cached copies and bring it into
+  // memory if it now ends inside the window
+  this->_archived_events.erase(event.get_id());
+  this->_archived_ranges.clear();
+  if (!this->is_archived(event.get_end())) {
+    uint32_t slot = this->_store.push(event);
+    this->track_event(slot, this->_now);
+    this->schedule_transitions(slot, this->_now);
+  }
+}
+
+void Calendar::update_events_in_db(std::span<const Event> events,
+                                   const std::vector<bool> &targets,
+                                   std::vector<OpStatus> &status) {
+  trace::Span span("update events");
+  span.set_arg(events.size());
+  if (this->_write_behind) {
+    for (size_t i = 0; i < events.size(); ++i) {
+      if (!targets[i])
+        continue;
+      this->_write_behind->update(events[i]);
+      status[i] = OpStatus::Ok;
+    }
+    return;
+  }
+
+  size_t first = 0;
+  while (!targets[first])
+    ++first;
+
   try {
+    metrics::ScopedTimer timer(metrics::Timer::DbTransaction);
+    trace::Span span("transaction", "sqlite");
+    // one transaction for the whole batch
+    auto &statement = this->update_statement();
     _storage.transaction([&]() {
-      _storage.remove<Event>(event_ptr->get_id());
+      for (size_t i = first; i < events.size(); ++i) {
+        if (!targets[i])
+          continue;
+        try {
+          get<0>(statement) = events[i];
+          _storage.execute(statement);
+          status[i] = OpStatus::Ok;
+        } catch (const std::system_error &e) {
+          metrics::add(metrics::Counter::DbErrors);
+          std::cerr << "Error updating event " << events[i].get_id() << ": "
+                    << e.what() << std::endl;
+          status[i] = OpStatus::Failed;
+        }
+      }
       return true;
     });
+  } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
+    std::cerr << "Error updating events: " << e.what() << std::endl;
+    for (size_t i = 0; i < events.size(); ++i) {
+      if (targets[i])
+        status[i] = OpStatus::Failed;
+    }
+  }
+}
+
+std::vector<OpStatus> Calendar::update_events(std::span<const Event> events) {
+  std::vector<OpStatus> status(events.size(), OpStatus::NotFound);
+  std::vector<bool> targets(events.size());
+  bool any = false;
+  auto lock = this->write_lock();
+  for (size_t i = 0; i < events.size(); ++i) {
+    uint32_t id = events[i].get_id();
+    targets[i] = this->_store.contains(id) ||
+                 this->find_event_anywhere(id).has_value();
+    any = any || targets[i];
+  }
+  if (!any)
+    return status;
+
+  this->update_events_in_db(events, targets, status);
+
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (status[i] != OpStatus::Ok)
+      continue;
+    this->_changes.append(ChangeKind::Updated, events[i].get_id());
+    uint32_t slot = this->_store.find(events[i].get_id());
+    if (slot != EventStore::npos) {
+      this->_store.set_name(slot, events[i].get_name());
+      this->_store.set_description(slot, events[i].get_description());
+      this->move_event(slot, events[i].get_start(), events[i].get_end());
+    } else {
+      this->adopt_archived_event(events[i]);
+    }
+  }
+  return status;
+}
 
-    auto remove_from_vector = [&](auto &vec) {
-      vec.erase(std::remove(vec.begin(), vec.end(), event_ptr), vec.end());
-    };
+bool Calendar::remove_event_from_db(uint32_t id) {
+  trace::Span span("remove event");
+  if (this->_write_behind) {
+    this->_write_behind->remove(id);
+    this->unload_event(id);
+    return true;
+  }
 
-    remove_from_vector(this->_all_events);
-    remove_from_vector(this->_past_events);
-    remove_from_vector(this->_ongoing_events);
-    remove_from_vector(this->_future_events);
+  try {
+    metrics::ScopedTimer timer(metrics::Timer::DbTransaction);
+    trace::Span span("transaction", "sqlite");
+    auto &statement = this->remove_statement();
+    _storage.transaction([&]() {
+      get<0>(statement) = id;
+      _storage.execute(statement);
+      return true;
+    });
 
+    this->unload_event(id);
     return true;
   } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
     std::cerr << "Error removing event: " << e.what() << std::endl;
     return false;
   } catch (...) {
+    metrics::add(metrics::Counter::DbErrors);
     std::cerr << "Unknown error removing event" << std::endl;
     return false;
   }
 }
 
+void Calendar::unload_event(uint32_t id) {
+  // anything not resident is archived, its range queries may hold it
+  bool archived = true;
+  uint32_t slot = this->_store.find(id);
+  if (slot != EventStore::npos) {
+    archived = this->is_archived(this->_store.end(slot));
+    bucket_erase(this->_ongoing_events, this->_ongoing_slots, id);
+    this->_index.erase(this->_store.start(slot), id);
+    this->_store.erase(slot);
+  }
+
+  this->_archived_events.erase(id);
+  if (archived)
+    this->_archived_ranges.clear();
+  this->_changes.append(ChangeKind::Removed, id);
+}
+
+std::optional<Event> Calendar::get_event_by_id(uint32_t id) const {
+  std::shared_lock lock(this->_mutex);
+  return this->find_event_anywhere(id);
+}
+
+std::optional<Event> Calendar::find_event_anywhere(uint32_t id) const {
+  uint32_t slot = this->_store.find(id);
+  if (slot != EventStore::npos)
+    return this->_store.to_event(slot);
+  if (!this->_window_start)
+    return std::nullopt;
+
+  std::lock_guard archive_lock(this->_archive_mutex);
+  if (auto cached = this->_archived_events.get(id))
+    return *cached;
+
+  try {
+    trace::Span span("get archived event", "sqlite");
+    // queued writes have to land before we read behind them
+    if (this->_write_behind)
+      this->_write_behind->flush();
+    auto db_event = this->_storage.get_pointer<Event>(id);
+    if (!db_event)
+      return std::nullopt;
+    db_event->update_members_from_db();
+    this->_archived_events.put(id, *db_event);
+    return std::move(*db_event);
+  } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
+    std::cerr << "Error loading event " << id << ": " << e.what()
+              << std::endl;
+    return std::nullopt;
+  }
+}
+
+std::vector<Event> Calendar::load_archived_range(const time_point &from,
+                                                 const time_point &to) const {
+  std::pair<int64_t, int64_t> key{EventStore::to_us(from),
+                                  EventStore::to_us(to)};
+  std::lock_guard archive_lock(this->_archive_mutex);
+  if (auto cached = this->_archived_ranges.get(key))
+    return *cached;
+
+  std::vector<Event> events;
+  try {
+    trace::Span span("get_all archived", "sqlite");
+    if (this->_write_behind)
+      this->_write_behind->flush();
+    // served by the start/end indexes
+    auto &statement = this->range_statement();
+    get<0>(statement) = key.second;
+    get<1>(statement) = key.first;
+    get<2>(statement) = EventStore::to_us(*this->_window_start);
+    std::vector<Event> db_events = this->_storage.execute(statement);
+    events.reserve(db_events.size());
+    for (auto &ev : db_events) {
+      // archived events that were changed in this session are resident
+      if (this->_store.contains(ev.get_id()))
+        continue;
+      auto cached = this->_archived_events.get(ev.get_id());
+      if (cached) {
+        events.push_back(*cached);
+        continue;
+      }
+      ev.update_members_from_db();
+      this->_archived_events.put(ev.get_id(), ev);
+      events.push_back(std::move(ev));
+    }
+  } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
+    std::cerr << "Error loading archived events: " << e.what() << std::endl;
+    return events;
+  }
+
+  this->_archived_ranges.put(key, events);
+  return events;
+}
+
+std::vector<Event> Calendar::get_events_between(const time_point &from,
+                                                const time_point &to) const {
+  std::shared_lock lock(this->_mutex);
+  std::vector<Event> events;
+  this->_index.for_each_overlapping(from, to, [&](uint32_t id) {
+    events.push_back(this->_store.to_event(this->_store.find(id)));
+  });
+  if (!this->is_archived(from))
+    return events;
+
+  auto archived = this->load_archived_range(from, to);
+  if (archived.empty())
+    return events;
+  events.insert(events.end(), archived.begin(), archived.end());
+  std::sort(events.begin(), events.end(), [](const auto &a, const auto &b) {
+    return a.get_start() < b.get_start() ||
+           (a.get_start() == b.get_start() && a.get_id() < b.get_id());
+  });
+  return events;
+}
+
+namespace {
+struct Boundary {
+  time_point time;
+  bool start;
+  uint32_t event; // index into the events
+};
+
+// Starts and ends of the events in time order, ends first at equal times
+// so that back-to-back events don't touch. Events without a duration take
+// no time and are left out.
+std::vector<Boundary> sorted_boundaries(const std::vector<Event> &events) {
+  std::vector<Boundary> boundaries;
+  boundaries.reserve(2 * events.size());
+  for (uint32_t i = 0; i < events.size(); ++i) {
+    if (events[i].get_end() <= events[i].get_start())
+      continue;
+    boundaries.push_back({events[i].get_start(), true, i});
+    boundaries.push_back({events[i].get_end(), false, i});
+  }
+  std::sort(boundaries.begin(), boundaries.end(),
+            [](const Boundary &a, const Boundary &b) {
+              if (a.time != b.time)
+                return a.time < b.time;
+              if (a.start != b.start)
+                return b.start;
+              return a.event < b.event;
+            });
+  return boundaries;
+}
+} // namespace
+
+std::vector<Conflict> Calendar::find_conflicts(const time_point &from,
+                                               const time_point &to) const {
+  trace::Span span("find conflicts");
+  auto events = this->get_events_between(from, to);
+  // events open at the sweep position, position[] says where they sit
+  std::vector<uint32_t> open;
+  std::vector<uint32_t> position(events.size());
+  std::vector<Conflict> conflicts;
+  for (const Boundary &boundary : sorted_boundaries(events)) {
+    if (!boundary.start) {
+      uint32_t at = position[boundary.event];
+      open[at] = open.back();
+      position[open[at]] = at;
+      open.pop_back();
+      continue;
+    }
+    // everything still open overlaps the event starting here
+    const Event &second = events[boundary.event];
+    for (uint32_t other : open) {
+      const Event &first = events[other];
+      time_point end = std::min(first.get_end(), second.get_end());
+      // both events reach into the range, their overlap may not
+      if (end > from && boundary.time <= to)
+        conflicts.push_back({first, second, boundary.time, end});
+    }
+    position[boundary.event] = static_cast<uint32_t>(open.size());
+    open.push_back(boundary.event);
+  }
+  span.set_arg(conflicts.size());
+  return conflicts;
+}
+
+std::vector<TimeSlot>
+Calendar::free_slots(const time_point &from, const time_point &to,
+                     std::chrono::nanoseconds min_duration) const {
+  trace::Span span("free slots");
+  std::vector<TimeSlot> slots;
+  if (to <= from)
+    return slots;
+  auto events = this->get_events_between(from, to);
+  // start of the current gap while nothing is open
+  time_point gap = from;
+  size_t depth = 0;
+  auto add = [&](time_point end) {
+    end = std::min(end, to);
+    if (end > gap && end - gap >= min_duration)
+      slots.push_back({gap, end});
+  };
+  for (const Boundary &boundary : sorted_boundaries(events)) {
+    if (boundary.start) {
+      if (depth++ == 0)
+        add(boundary.time);
+    } else if (--depth == 0) {
+      gap = std::max(gap, boundary.time);
+    }
+  }
+  add(to);
+  span.set_arg(slots.size());
+  return slots;
+}
+
+bool Calendar::for_each_archived(const std::function<void(const Event &)> &fn,
+                                 size_t page_size) const {
+  std::shared_lock lock(this->_mutex);
+  if (!this->_window_start)
+    return true;
+  int64_t window_us = EventStore::to_us(*this->_window_start);
+  try {
+    trace::Span span("scan archived", "sqlite");
+    {
+      std::lock_guard archive_lock(this->_archive_mutex);
+      if (this->_write_behind)
+        this->_write_behind->flush();
+    }
+    // keyset pagination over the primary key, no OFFSET rescans
+    uint32_t after = 0;
+    size_t scanned = 0;
+    while (true) {
+      std::vector<Event> page;
+      {
+        // a page at a time, fn runs without blocking the other readers
+        std::lock_guard archive_lock(this->_archive_mutex);
+        page = this->_storage.get_all<Event>(
+            where(c(&Event::_end_db) < window_us and c(&Event::_id) > after),
+            order_by(&Event::_id), limit(static_cast<int>(page_size)));
+      }
+      for (auto &ev : page) {
+        after = ev.get_id();
+        // archived events that were changed in this session are resident
+        if (this->_store.contains(ev.get_id()))
+          continue;
+        ev.update_members_from_db();
+        fn(ev);
+      }
+      scanned += page.size();
+      if (page.size() < page_size)
+        break;
+    }
+    span.set_arg(scanned);
+  } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
+    std::cerr << "Error reading archived events: " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+namespace {
+// an event ending within the first microsecond of `from` doesn't overlap
+int64_t from_us(const time_point &from) {
+  return std::chrono::ceil<std::chrono::microseconds>(from)
+      .time_since_epoch()
+      .count();
+}
+} // namespace
+
+size_t Calendar::count_overlapping(const time_point &from,
+                                   const time_point &to) const {
+  std::shared_lock lock(this->_mutex);
+  size_t count =
+      scan::count_overlapping(this->_store.starts(), this->_store.ends(),
+                              from_us(from), EventStore::to_us(to));
+  if (!this->is_archived(from))
+    return count;
+
+  try {
+    trace::Span span("count archived", "sqlite");
+    std::lock_guard archive_lock(this->_archive_mutex);
+    if (this->_write_behind)
+      this->_write_behind->flush();
+    count += static_cast<size_t>(this->_storage.count<Event>(
+        where(c(&Event::_start_db) <= EventStore::to_us(to) and
+              c(&Event::_end_db) >= from_us(from) and
+              c(&Event::_end_db) < EventStore::to_us(*this->_window_start))));
+  } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
+    std::cerr << "Error counting archived events: " << e.what() << std::endl;
+  }
+  return count;
+}
+
+std::vector<Event>
+Calendar::select_overlapping(const time_point &from,
+                             const time_point &to) const {
+  int64_t from_time = from_us(from);
+  int64_t to_time = EventStore::to_us(to);
+  return this->read(
+      [&] {
+        std::vector<uint32_t> slots;
+        scan::select_overlapping(this->_store.starts(), this->_store.ends(),
+                                 from_time, to_time, slots);
+        std::vector<Event> events;
+        events.reserve(slots.size());
+        for (uint32_t slot : slots) {
+          events.push_back(this->_store.to_event(slot));
+        }
+        return events;
+      },
+      [&](const EventSnapshot &snapshot) {
+        std::vector<uint32_t> slots;
+        std::vector<Event> events;
+        snapshot.for_each_page([&](size_t first, auto starts, auto ends) {
+          slots.clear();
+          scan::select_overlapping(starts, ends, from_time, to_time, slots);
+          for (uint32_t slot : slots) {
+            events.push_back(snapshot[first + slot].to_event());
+          }
+        });
+        return events;
+      });
+}
+
+scan::StateCounts Calendar::classify(const time_point &time_p) const {
+  metrics::ScopedTimer timer(metrics::Timer::Classify);
+  trace::Span span("classify");
+  int64_t now = EventStore::to_us(time_p);
+  return this->read(
+      [&] {
+        return scan::classify(this->_store.starts(), this->_store.ends(),
+                              now);
+      },
+      [&](const EventSnapshot &snapshot) {
+        scan::StateCounts counts;
+        snapshot.for_each_page([&](size_t, auto starts, auto ends) {
+          auto page = scan::classify(starts, ends, now);
+          counts.past += page.past;
+          counts.ongoing += page.ongoing;
+          counts.future += page.future;
+        });
+        return counts;
+      });
+}
+
 bool Calendar::remove_event_by_id(uint32_t id) {
-  auto it = std::find_if(
-      this->_all_events.begin(), this->_all_events.end(),
-      [&](const auto &event_ptr) { return event_ptr->get_id() == id; });
-
-  if (it != this->_all_events.end()) {
-    auto event_ptr = *it;
-    if (this->remove_event_from_db(event_ptr)) {
-      std::cout << "Removed event with id: " << event_ptr->get_id()
-                << std::endl;
+  auto lock = this->write_lock();
+  if (!this->_store.contains(id) && !this->find_event_anywhere(id))
+    return false;
+  if (!this->remove_event_from_db(id)) {
+    std::cerr << "Failed to remove event from DB\n";
+    return false;
+  }
+  return true;
+}
+
+void Calendar::remove_events_from_db(std::span<const uint32_t> ids,
+                                     const std::vector<bool> &targets,
+                                     std::vector<OpStatus> &status) {
+  trace::Span span("remove events");
+  span.set_arg(ids.size());
+  if (this->_write_behind) {
+    for (size_t i = 0; i < ids.size(); ++i) {
+      if (!targets[i])
+        continue;
+      this->_write_behind->remove(ids[i]);
+      status[i] = OpStatus::Ok;
+    }
+    return;
+  }
+
+  try {
+    metrics::ScopedTimer timer(metrics::Timer::DbTransaction);
+    trace::Span span("transaction", "sqlite");
+    // one transaction for the whole batch
+    auto &statement = this->remove_statement();
+    _storage.transaction([&]() {
+      for (size_t i = 0; i < ids.size(); ++i) {
+        if (!targets[i])
+          continue;
+        try {
+          get<0>(statement) = ids[i];
+          _storage.execute(statement);
+          status[i] = OpStatus::Ok;
+        } catch (const std::system_error &e) {
+          metrics::add(metrics::Counter::DbErrors);
+          std::cerr << "Error removing event " << ids[i] << ": " << e.what()
+                    << std::endl;
+          status[i] = OpStatus::Failed;
+        }
+      }
       return true;
-    } else {
-      std::cerr << "Failed to remove event from DB\n";
-      return false;
+    });
+  } catch (const std::exception &e) {
+    metrics::add(metrics::Counter::DbErrors);
+    std::cerr << "Error removing events: " << e.what() << std::endl;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      if (targets[i])
+        status[i] = OpStatus::Failed;
+    }
+  }
+}
+
+std::vector<OpStatus>
+Calendar::remove_events(std::span<const uint32_t> ids) {
+  auto lock = this->write_lock();
+  return this->remove_events_locked(ids);
+}
+
+std::vector<OpStatus>
+Calendar::remove_events_locked(std::span<const uint32_t> ids) {
+  std::vector<OpStatus> status(ids.size(), OpStatus::NotFound);
+  std::vector<bool> targets(ids.size());
+  FlatIdMap seen;
+  bool any = false;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    // a repeated id is removed once, later copies report NotFound
+    if (seen.contains(ids[i]))
+      continue;
+    targets[i] = this->_store.contains(ids[i]) ||
+                 this->find_event_anywhere(ids[i]).has_value();
+    if (targets[i]) {
+      seen.set(ids[i], 0);
+      any = true;
     }
+  }
+  if (!any)
+    return status;
+
+  this->remove_events_from_db(ids, targets, status);
+
+  for (size_t i = 0; i < ids.size(); ++i) {
+    if (status[i] == OpStatus::Ok)
+      this->unload_event(ids[i]);
+  }
+  return status;
+}
+
+std::vector<OpStatus> Calendar::remove_events(std::span<const Event> events) {
+  std::vector<uint32_t> ids;
+  ids.reserve(events.size());
+  for (const auto &event : events) {
+    ids.push_back(event.get_id());
+  }
+  return this->remove_events(ids);
+}
+
+size_t Calendar::remove_events_by_ids(std::span<const uint32_t> ids) {
+  auto status = this->remove_events(ids);
+  return static_cast<size_t>(
+      std::count(status.begin(), status.end(), OpStatus::Ok));
+}
+
+size_t Calendar::list(std::ostream &out, const ListOptions &options) const {
+  trace::Span span("list");
+  std::shared_lock lock(this->_mutex);
+  OutputBuffer buffer(out);
+  size_t listed = 0;
+  auto emit = [&](uint32_t slot) {
+    if (listed > 0 && options.format == ListFormat::Text)
+      buffer.buffer() += "--\n";
+    format_event(buffer.buffer(), this->_store.id(slot),
+                 this->_store.start_us(slot), this->_store.end_us(slot),
+                 this->_store.flags(slot) & EventStore::Ongoing,
+                 this->_store.name(slot), this->_store.description(slot),
+                 options.format);
+    buffer.maybe_flush();
+    return ++listed < options.limit;
+  };
+  if (options.limit == 0)
+    return 0;
+
+  bool ranged = options.from || options.to;
+  time_point from = options.from.value_or(time_point::min());
+  time_point to = options.to.value_or(time_point::max());
+  if (options.order == ListOrder::Start && !options.descending) {
+    // already in order, nothing is collected
+    auto visit = [&](uint32_t id) { return emit(this->_store.find(id)); };
+    if (ranged)
+      this->_index.for_each_overlapping_until(from, to, visit);
+    else
+      this->_index.for_each_until(visit);
+    span.set_arg(listed);
+    return listed;
+  }
+
+  std::vector<uint32_t> slots;
+  if (ranged) {
+    this->_index.for_each_overlapping(from, to, [&](uint32_t id) {
+      slots.push_back(this->_store.find(id));
+    });
   } else {
-    std::cout << "Event not found" << std::endl;
-    return false;
+    slots.resize(this->_store.size());
+    for (uint32_t slot = 0; slot < slots.size(); ++slot)
+      slots[slot] = slot;
   }
+
+  const EventStore &store = this->_store;
+  auto key_less = [&](uint32_t a, uint32_t b) {
+    switch (options.order) {
+    case ListOrder::Start:
+      if (store.start_us(a) != store.start_us(b))
+        return store.start_us(a) < store.start_us(b);
+      break;
+    case ListOrder::End:
+      if (store.end_us(a) != store.end_us(b))
+        return store.end_us(a) < store.end_us(b);
+      break;
+    case ListOrder::Name:
+      if (int cmp = store.name(a).compare(store.name(b)))
+        return cmp < 0;
+      break;
+    case ListOrder::Id:
+      break;
+    }
+    return store.id(a) < store.id(b);
+  };
+  auto less = [&](uint32_t a, uint32_t b) {
+    return options.descending ? key_less(b, a) : key_less(a, b);
+  };
+  // only the events that get printed have to be in order
+  if (options.limit < slots.size()) {
+    std::partial_sort(slots.begin(),
+                      slots.begin() + static_cast<ptrdiff_t>(options.limit),
+                      slots.end(), less);
+    slots.resize(options.limit);
+  } else {
+    std::sort(slots.begin(), slots.end(), less);
+  }
+  for (uint32_t slot : slots) {
+    if (!emit(slot))
+      break;
+  }
+  span.set_arg(listed);
+  return listed;
 }
 
-std::ostream &operator<<(std::ostream &os, const Calendar &calendar) {
-  for (size_t i = 0; i < calendar._all_events.size(); ++i) {
-    os << *calendar._all_events[i];
-    if (i < calendar._all_events.size() - 1) {
-      os << "--\n";
+void Calendar::catch_up_text_index() const {
+  if (this->_text_index_built) {
+    std::vector<Change> changes;
+    if (this->_changes.read(this->_text_index_seq, changes)) {
+      for (const Change &change : changes) {
+        if (change.kind == ChangeKind::Started ||
+            change.kind == ChangeKind::Ended)
+          continue;
+        // the store holds the latest state, whatever the change was
+        uint32_t slot = this->_store.find(change.id);
+        if (slot == EventStore::npos)
+          this->_text_index.remove(change.id);
+        else
+          this->_text_index.add(change.id, this->_store.name(slot),
+                                this->_store.description(slot));
+      }
+      this->_text_index_seq = this->_changes.last_seq();
+      return;
     }
+    // fell behind the change log, start over
+  }
+
+  trace::Span span("build text index");
+  this->_text_index.clear();
+  for (uint32_t slot = 0; slot < this->_store.size(); ++slot) {
+    this->_text_index.add(this->_store.id(slot), this->_store.name(slot),
+                          this->_store.description(slot));
+  }
+  this->_text_index_seq = this->_changes.last_seq();
+  this->_text_index_built = true;
+  span.set_arg(this->_store.size());
+}
+
+SearchResult Calendar::search(std::string_view query,
+                              const SearchOptions &options) const {
+  trace::Span span("search");
+  std::shared_lock lock(this->_mutex);
+  std::vector<TextIndex::Match> matches;
+  {
+    std::lock_guard text_lock(this->_text_mutex);
+    this->catch_up_text_index();
+    matches = this->_text_index.search(query);
+  }
+
+  struct Candidate {
+    uint32_t slot;
+    double score;
+  };
+  std::vector<Candidate> candidates;
+  candidates.reserve(matches.size());
+  std::optional<int64_t> from_us, to_us;
+  if (options.from)
+    from_us = EventStore::to_us(*options.from);
+  if (options.to)
+    to_us = EventStore::to_us(*options.to);
+  for (const auto &match : matches) {
+    uint32_t slot = this->_store.find(match.id);
+    if (slot == EventStore::npos)
+      continue;
+    if ((from_us && this->_store.end_us(slot) < *from_us) ||
+        (to_us && this->_store.start_us(slot) > *to_us))
+      continue;
+    candidates.push_back({slot, match.score});
+  }
+
+  const EventStore &store = this->_store;
+  auto less = [&](const Candidate &a, const Candidate &b) {
+    if (!options.by_start && a.score != b.score)
+      return a.score > b.score;
+    if (store.start_us(a.slot) != store.start_us(b.slot))
+      return store.start_us(a.slot) < store.start_us(b.slot);
+    return store.id(a.slot) < store.id(b.slot);
+  };
+  size_t shown = std::min(options.limit, candidates.size());
+  std::partial_sort(candidates.begin(),
+                    candidates.begin() + static_cast<ptrdiff_t>(shown),
+                    candidates.end(), less);
+
+  SearchResult result;
+  result.total = candidates.size();
+  result.hits.reserve(shown);
+  for (size_t i = 0; i < shown; ++i) {
+    result.hits.push_back(
+        {store.to_event(candidates[i].slot), candidates[i].score});
   }
+  span.set_arg(result.total);
+  return result;
+}
+
+std::ostream &operator<<(std::ostream &os, const Calendar &calendar) {
+  // in start order straight from the index
+  calendar.list(os);
   return os;
 }
 
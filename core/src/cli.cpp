@@ -1,13 +1,22 @@
+#include "client.hpp"
+#include "commands.hpp"
 #include "core.hpp"
 #include "db.hpp"
-#include <iomanip> // Required for std::setw
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <filesystem>
+#include <functional>
 #include <iostream>
-#include <map>
 #include <replxx.hxx>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#ifdef TASK_MANAGER_API
+#include "gcal_sync.hpp"
+#endif
+
 using namespace task_manager;
 using namespace replxx;
 
@@ -15,172 +24,199 @@ void trim_leading_ws(std::string &s) {
   s.erase(0, s.find_first_not_of(" \t\n\r\f\v"));
 }
 
-int main() {
-  try {
-    auto storage = init_storage();
-    Calendar calendar(storage);
-
-    Replxx repl;
-    repl.install_window_change_handler();
-
-    std::map<std::string, std::string> commands = {
-        {"add", "Add a new event. Usage: add [event name]"},
-        {"help", "Show this help message."},
-        {"list", "List all events."},
-        {"exit", "Exit the application."}};
-
-    repl.set_completion_callback([&commands](const std::string &context,
-                                             int & /*contextLen*/) {
-      std::vector<Replxx::Completion> completions;
-      for (auto const &[cmd, desc] : commands) {
-        if (cmd.rfind(context, 0) == 0) { // check if cmd starts with context
-          completions.emplace_back(cmd.c_str());
-        }
-      }
-      return completions;
-    });
-
-    while (true) {
-      char const *cinput{nullptr};
+// Fills in the argument of add/rm interactively when it was left out.
+// Returns false if the user backed out with Ctrl+D.
+bool complete_line(Replxx &repl, std::string &line) {
+  std::istringstream iss(line);
+  std::string cmd, rest;
+  iss >> cmd;
+  std::getline(iss, rest);
+  trim_leading_ws(rest);
+  if (!rest.empty()) {
+    return true;
+  }
 
-      do {
-        cinput = repl.input("task_manager> ");
-      } while (cinput != nullptr && std::string(cinput).empty());
+  if (cmd == "add") {
+    char const *name_input = repl.input("  event name> ");
+    if (name_input == nullptr) {
+      std::cout << "\nAdd operation cancelled.\n";
+      return false;
+    }
+    line = cmd + " " + name_input;
+  } else if (cmd == "remove" || cmd == "rm") {
+    char const *id_input = repl.input("  event id> ");
+    if (id_input == nullptr) {
+      std::cout << "\nRemove operation cancelled.\n";
+      return false;
+    }
+    line = cmd + " " + id_input;
+  }
+  return true;
+}
 
-      if (cinput == nullptr) { // Handle Ctrl+D (EOF)
-        break;
+void repl_loop(
+    const std::function<CommandStatus(const std::string &)> &dispatch) {
+  Replxx repl;
+  repl.install_window_change_handler();
+
+  repl.set_completion_callback([](const std::string &context,
+                                  int & /*contextLen*/) {
+    std::vector<Replxx::Completion> completions;
+    for (auto const &[cmd, desc] : command_descriptions()) {
+      if (cmd.rfind(context, 0) == 0) { // check if cmd starts with context
+        completions.emplace_back(cmd.c_str());
       }
+    }
+    return completions;
+  });
 
-      std::string line(cinput);
-
-      std::istringstream iss(line);
-      std::string cmd;
-      iss >> cmd;
-
-      if (cmd == "exit") {
-        break;
-      } else if (cmd == "list" || cmd == "ls") {
-        std::cout << "--- All Events ---\n";
-        if (calendar.get_events().empty()) {
-          std::cout << "No events found. Use 'add' to create one.\n";
-        } else {
-          std::cout << calendar;
-        }
-        std::cout << "------------------\n";
-
-      } else if (cmd == "add") {
-        std::string name;
-        std::getline(iss, name);
-        trim_leading_ws(name);
-
-        // If name is empty, it means the user just typed "add"
-        if (name.empty()) {
-          char const *name_input = repl.input("  event name> ");
-          if (name_input == nullptr) {
-            std::cout << "\nAdd operation cancelled.\n";
-            continue;
-          }
-          name = name_input;
-        }
-
-        // Ensure we have a name before proceeding
-        if (name.empty()) {
-          std::cout << "Event name cannot be empty. Add operation cancelled.\n";
-          continue;
-        }
-
-        auto now = std::chrono::system_clock::now();
-        Event ev(name, now, now + std::chrono::hours(1));
+  while (true) {
+    char const *cinput{nullptr};
 
-        if (calendar.create_event(ev)) {
-          std::cout << "Event '" << name << "' added successfully!\n";
-        } else {
-          std::cout << "Failed to add event.\n";
-        }
+    do {
+      cinput = repl.input("task_manager> ");
+    } while (cinput != nullptr && std::string(cinput).empty());
 
-      } else if (cmd == "remove" || cmd == "rm") {
-        std::string id;
-        std::getline(iss, id);
-        trim_leading_ws(id);
-
-        // If name is empty, it means the user just typed "remove"
-        if (id.empty()) {
-          char const *id_input = repl.input("  event id> ");
-          if (id_input == nullptr) {
-            std::cout << "\nRemove operation cancelled.\n";
-            continue;
-          }
-          id = id_input;
-        }
-
-        // Ensure we have a id before proceeding
-        if (id.empty()) {
-          std::cout
-              << "Event id cannot be empty. Remove operation cancelled.\n";
-          continue;
-        }
+    if (cinput == nullptr) { // Handle Ctrl+D (EOF)
+      break;
+    }
 
-        if (calendar.remove_event_by_id(
-                static_cast<uint32_t>(std::stoul(id)))) {
-          std::cout << "Event with id '" << id << "' removed successfully!\n";
-        } else {
-          std::cout << "Failed to remove event.\n";
-        }
-      } else if (cmd == "update") {
-        uint32_t id = 0;
-        std::string name;
-        std::string desc;
-
-        // Parse remaining input
-        std::string token;
-        while (iss >> token) {
-          if (token == "id" && (iss >> token)) {
-            id = static_cast<uint32_t>(std::stoul(token));
-          } else if (token == "name" && std::getline(iss, token)) {
-            trim_leading_ws(token);
-            name = token;
-          } else if (token == "desc" && std::getline(iss, token)) {
-            trim_leading_ws(token);
-            desc = token;
-          }
-        }
+    std::string line(cinput);
+    if (!complete_line(repl, line)) {
+      continue;
+    }
+    if (dispatch(line) == CommandStatus::Exit) {
+      break;
+    }
+  }
+}
 
-        if (id == 0) {
-          std::cout << "Please specify a valid event id. Update cancelled.\n";
-          continue;
-        }
+#ifdef TASK_MANAGER_API
+// Mirrors the primary Google calendar. The OAuth client secret
+// (gcal_secret.json), the tokens and the sync state live next to the DB;
+// the first run asks for an authorization code.
+CommandStatus gcal_sync(Calendar &calendar) {
+  auto dir = std::filesystem::path(get_user_db_path()).parent_path();
+  GoogleCalendarAPI api((dir / "gcal_secret.json").string(), {}, {},
+                        (dir / "gcal_token.json").string());
+  if (!std::filesystem::exists(api.token_file_path()) && !api.authenticate()) {
+    std::cerr << "Google Calendar authentication failed." << std::endl;
+    return CommandStatus::Failed;
+  }
+  GoogleCalendarSync sync(api, calendar);
+  auto stats = sync.sync();
+  if (!stats) {
+    std::cerr << "Google Calendar sync failed, nothing was applied."
+              << std::endl;
+    return CommandStatus::Failed;
+  }
+  std::cout << (stats->full ? "Full" : "Incremental") << " sync: "
+            << stats->created << " created, " << stats->updated
+            << " updated, " << stats->removed << " removed, "
+            << stats->skipped << " skipped.\n";
+  return CommandStatus::Ok;
+}
+#endif
+
+// Commands that need more than the calendar, the rest go to run_command()
+CommandStatus run_local(Calendar &calendar, const std::string &line) {
+#ifdef TASK_MANAGER_API
+  std::istringstream iss(line);
+  std::string cmd, rest;
+  iss >> cmd >> rest;
+  if (cmd == "gcal-sync" && rest.empty())
+    return gcal_sync(calendar);
+#endif
+  return run_command(calendar, line, std::cout);
+}
 
-        if (name.empty() && desc.empty()) {
-          std::cout << "Nothing to update. Provide 'name' and/or 'desc'.\n";
-          continue;
-        }
+int main(int argc, char **argv) {
+  bool client_mode = false;
+  // a command on the command line runs once instead of the REPL
+  std::string one_shot;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (one_shot.empty() && (arg == "--client" || arg == "-c")) {
+      client_mode = true;
+    } else if (!one_shot.empty() || arg.rfind("-", 0) != 0) {
+      one_shot += one_shot.empty() ? "" : " ";
+      one_shot += arg;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--client] [command...]\n"
+                << "  --client, -c  Talk to a running task_managerd instead "
+                   "of loading the DB.\n"
+                << "  command       Run it and exit, e.g. "
+                   "'list --ndjson > events.ndjson'.\n";
+      return 1;
+    }
+  }
+  if (!one_shot.empty()) {
+    // nothing else reads stdin or writes through stdio
+    std::ios::sync_with_stdio(false);
+  }
+  int exit_code = 0;
 
-        if (calendar.update_event_by_id(id, name, desc)) {
-          std::cout << "Event " << id << " updated successfully.\n";
-        } else {
-          std::cout << "Failed to update event. Event with id " << id
-                    << " not found.\n";
-        }
-      } else if (cmd == "help") {
-        std::cout << "Available commands:\n";
-        // Find the longest command name for alignment
-        size_t max_len = 0;
-        for (auto const &[cmd_name, _] : commands) {
-          if (cmd_name.length() > max_len) {
-            max_len = cmd_name.length();
-          }
+  try {
+    // TASK_MANAGER_TRACE=<file> traces the whole session, load included
+    auto tracing = trace::Session::from_env();
+    trace::name_thread("main");
+    if (client_mode) {
+      auto client = DaemonClient::connect(get_user_socket_path());
+      if (!client) {
+        std::cerr << "No daemon listening on " << get_user_socket_path()
+                  << ", start task_managerd first." << std::endl;
+        return 1;
+      }
+      if (!one_shot.empty()) {
+        auto reply = client->request(one_shot);
+        if (!reply)
+          return 1;
+        std::cout << reply->output << std::flush;
+        return reply->status == CommandStatus::Failed ? 1 : 0;
+      }
+      repl_loop([&client](const std::string &line) {
+        // ending the session is up to us, the daemon keeps running
+        std::istringstream iss(line);
+        std::string cmd;
+        iss >> cmd;
+        if (cmd == "exit") {
+          return CommandStatus::Exit;
         }
-        // Print formatted help
-        for (auto const &[cmd_name, desc] : commands) {
-          std::cout << "  " << std::left << std::setw(max_len + 2) << cmd_name
-                    << desc << "\n";
+        auto reply = client->request(line);
+        if (!reply) {
+          return CommandStatus::Exit;
         }
+        std::cout << reply->output;
+        return reply->status;
+      });
+    } else {
+      auto storage =
+          init_storage(get_user_db_path(), StorageProfile::from_env());
+      // keep only recent history in memory, older events are read on demand
+      auto options = CalendarOptions::from_env();
+      Calendar calendar(storage, options);
+      // add/rm don't wait for the disk if asked, the queue drains on exit
+      if (options.write_behind)
+        calendar.enable_write_behind();
+      // periodic Prometheus dump, if TASK_MANAGER_METRICS_FILE is set
+      auto exporter = metrics::PrometheusFileExporter::from_env();
+
+      if (!one_shot.empty()) {
+        if (run_local(calendar, one_shot) == CommandStatus::Failed)
+          exit_code = 1;
+        std::cout << std::flush;
       } else {
-        std::cout << "Unknown command: '" << cmd
-                  << "'. Type 'help' for a list of commands.\n";
+        repl_loop([&calendar](const std::string &line) {
+          return run_local(calendar, line);
+        });
       }
-    }
 
+      // queued changes that didn't make it to the DB fail the run
+      if (!calendar.flush())
+        exit_code = 1;
+      // clean shutdown, let the next start skip the full load
+      calendar.save_snapshot();
+    }
   } catch (const std::exception &e) {
     std::cerr << "An unhandled exception occurred: " << e.what() << std::endl;
     return 1;
@@ -189,6 +225,7 @@ int main() {
     return 1;
   }
 
-  std::cout << "Exiting.\n";
-  return 0;
+  if (one_shot.empty())
+    std::cout << "Exiting.\n";
+  return exit_code;
 }
@@ -0,0 +1,133 @@
+#include "client.hpp"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace task_manager {
+
+namespace {
+
+// import/export open the file in the daemon, whose working directory isn't
+// ours, so a relative path is resolved here before it goes out
+std::string with_absolute_path(const std::string &line) {
+  std::istringstream iss(line);
+  std::string cmd, path;
+  iss >> cmd;
+  if (cmd != "import" && cmd != "export")
+    return line;
+  std::getline(iss, path);
+  path.erase(0, path.find_first_not_of(" \t\n\r\f\v"));
+  if (path.empty() || std::filesystem::path(path).is_absolute())
+    return line;
+  std::error_code ec;
+  auto absolute = std::filesystem::absolute(path, ec);
+  return ec ? line : cmd + " " + absolute.string();
+}
+
+} // namespace
+
+std::optional<DaemonClient>
+DaemonClient::connect(const std::string &socket_path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path too long: " << socket_path << std::endl;
+    return std::nullopt;
+  }
+  std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return std::nullopt;
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    ::close(fd);
+    return std::nullopt;
+  }
+  return DaemonClient(fd);
+}
+
+DaemonClient::DaemonClient(DaemonClient &&other) noexcept
+    : _fd(other._fd), _in(std::move(other._in)) {
+  other._fd = -1;
+}
+
+DaemonClient &DaemonClient::operator=(DaemonClient &&other) noexcept {
+  if (this != &other) {
+    if (this->_fd >= 0)
+      ::close(this->_fd);
+    this->_fd = other._fd;
+    this->_in = std::move(other._in);
+    other._fd = -1;
+  }
+  return *this;
+}
+
+DaemonClient::~DaemonClient() {
+  if (this->_fd >= 0)
+    ::close(this->_fd);
+}
+
+std::optional<protocol::Reply>
+DaemonClient::request(const std::string &line) {
+  if (this->_fd < 0)
+    return std::nullopt;
+
+  std::string out;
+  protocol::append_frame(out, with_absolute_path(line));
+  size_t sent = 0;
+  while (sent < out.size()) {
+    ssize_t n =
+        ::send(this->_fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      std::cerr << "Lost the connection to the daemon." << std::endl;
+      return std::nullopt;
+    }
+    sent += static_cast<size_t>(n);
+  }
+
+  char chunk[64 * 1024];
+  std::optional<protocol::Reply> reply;
+  while (true) {
+    std::string_view payload;
+    size_t consumed = 0;
+    auto status = protocol::next_frame(this->_in, payload, consumed);
+    if (status == protocol::FrameStatus::Complete) {
+      auto frame = protocol::decode_reply(payload);
+      if (!frame) {
+        std::cerr << "Malformed reply from the daemon." << std::endl;
+        return std::nullopt;
+      }
+      // long outputs come in several frames, the last has the status
+      if (!reply)
+        reply = protocol::Reply{frame->status, {}};
+      reply->status = frame->status;
+      reply->output.append(frame->output);
+      this->_in.erase(0, consumed);
+      if (frame->last)
+        return reply;
+      continue;
+    }
+    if (status == protocol::FrameStatus::Invalid) {
+      std::cerr << "Malformed reply from the daemon." << std::endl;
+      return std::nullopt;
+    }
+
+    ssize_t n = ::recv(this->_fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      std::cerr << "Lost the connection to the daemon." << std::endl;
+      return std::nullopt;
+    }
+    this->_in.append(chunk, static_cast<size_t>(n));
+  }
+}
+
+} // namespace task_manager
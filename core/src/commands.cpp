@@ -0,0 +1,676 @@
+#include "commands.hpp"
+#include "ics.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <charconv>
+#include <iomanip> // Required for std::setw
+#include <sstream>
+#include <vector>
+
+namespace task_manager {
+
+namespace {
+void trim_leading_ws(std::string &s) {
+  s.erase(0, s.find_first_not_of(" \t\n\r\f\v"));
+}
+
+// Digits only: std::stoull takes "-1" and wraps it to the largest value
+template <typename T> std::optional<T> parse_count(const std::string &text) {
+  T value = 0;
+  auto [end, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc() || end != text.data() + text.size())
+    return std::nullopt;
+  return value;
+}
+
+constexpr const char *list_usage =
+    "Usage: list [from [to]] [--limit N] [--sort start|end|name|id] [--desc] "
+    "[--ndjson]\n";
+
+CommandStatus list_events(Calendar &calendar, std::istringstream &iss,
+                          std::ostream &out) {
+  ListOptions options;
+  std::vector<std::string> range;
+  std::string token;
+  while (iss >> token) {
+    if (token == "--limit" && (iss >> token)) {
+      auto limit = parse_count<size_t>(token);
+      if (!limit) {
+        out << "Invalid limit '" << token << "'.\n" << list_usage;
+        return CommandStatus::Failed;
+      }
+      options.limit = *limit;
+    } else if (token == "--sort" && (iss >> token)) {
+      if (token == "start")
+        options.order = ListOrder::Start;
+      else if (token == "end")
+        options.order = ListOrder::End;
+      else if (token == "name")
+        options.order = ListOrder::Name;
+      else if (token == "id")
+        options.order = ListOrder::Id;
+      else {
+        out << list_usage;
+        return CommandStatus::Failed;
+      }
+    } else if (token == "--desc") {
+      options.descending = true;
+    } else if (token == "--ndjson") {
+      options.format = ListFormat::Ndjson;
+    } else if (token.rfind("--", 0) != 0 && range.size() < 2) {
+      range.push_back(token);
+    } else {
+      out << list_usage;
+      return CommandStatus::Failed;
+    }
+  }
+  if (!range.empty()) {
+    options.from = parse_time(range[0]);
+    if (!options.from) {
+      out << list_usage;
+      return CommandStatus::Failed;
+    }
+  }
+  if (range.size() > 1) {
+    options.to = parse_time(range[1]);
+    if (!options.to) {
+      out << list_usage;
+      return CommandStatus::Failed;
+    }
+    if (*options.to < *options.from) {
+      out << "The end of the range is before its start.\n";
+      return CommandStatus::Failed;
+    }
+  }
+
+  // nothing but the events, for piping into other tools
+  if (options.format == ListFormat::Ndjson) {
+    calendar.list(out, options);
+    return CommandStatus::Ok;
+  }
+  out << "--- All Events ---\n";
+  if (calendar.list(out, options) == 0) {
+    if (options.from || options.to)
+      out << "No events in that range.\n";
+    else
+      out << "No events found. Use 'add' to create one.\n";
+  }
+  // only resident events are listed, query counts the archived ones too
+  auto window_start = calendar.get_window_start();
+  if (window_start && (!options.from || *options.from < *window_start)) {
+    out << "(events that ended before the residency window are not "
+           "listed, use 'query')\n";
+  }
+  out << "------------------\n";
+  return CommandStatus::Ok;
+}
+
+CommandStatus query_events(Calendar &calendar, std::istringstream &iss,
+                           std::ostream &out) {
+  std::string from_arg, to_arg;
+  iss >> from_arg >> to_arg;
+  auto from = parse_time(from_arg);
+  auto to = parse_time(to_arg);
+  if (!from || !to) {
+    out << "Usage: query <from> <to>, e.g. query 2025-01-06 "
+           "2025-01-12T23:59\n";
+    return CommandStatus::Failed;
+  }
+  if (*to < *from) {
+    out << "The end of the range is before its start.\n";
+    return CommandStatus::Failed;
+  }
+
+  auto events = calendar.select_overlapping(*from, *to);
+  std::sort(events.begin(), events.end(),
+            [](const Event &a, const Event &b) {
+              return a.get_start() < b.get_start();
+            });
+  // the count also reaches events outside the residency window
+  size_t count = calendar.count_overlapping(*from, *to);
+  out << "--- " << count << " event(s) overlapping ---\n";
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (i > 0)
+      out << "--\n";
+    out << events[i];
+  }
+  if (count > events.size()) {
+    out << "(" << count - events.size() << " archived event(s) not listed)\n";
+  }
+  out << "------------------\n";
+  return CommandStatus::Ok;
+}
+
+constexpr const char *search_usage =
+    "Usage: search <words...> [--from T] [--to T] [--limit N] [--by-start]\n";
+
+CommandStatus search_events(Calendar &calendar, std::istringstream &iss,
+                            std::ostream &out) {
+  SearchOptions options;
+  std::string query, token;
+  while (iss >> token) {
+    if (token == "--from" && (iss >> token)) {
+      options.from = parse_time(token);
+      if (!options.from) {
+        out << search_usage;
+        return CommandStatus::Failed;
+      }
+    } else if (token == "--to" && (iss >> token)) {
+      options.to = parse_time(token);
+      if (!options.to) {
+        out << search_usage;
+        return CommandStatus::Failed;
+      }
+    } else if (token == "--limit" && (iss >> token)) {
+      auto limit = parse_count<size_t>(token);
+      if (!limit) {
+        out << "Invalid limit '" << token << "'.\n" << search_usage;
+        return CommandStatus::Failed;
+      }
+      options.limit = *limit;
+    } else if (token == "--by-start") {
+      options.by_start = true;
+    } else if (token.rfind("--", 0) != 0) {
+      query += token;
+      query += ' ';
+    } else {
+      out << search_usage;
+      return CommandStatus::Failed;
+    }
+  }
+  if (query.empty()) {
+    out << search_usage;
+    return CommandStatus::Failed;
+  }
+  if (options.from && options.to && *options.to < *options.from) {
+    out << "The end of the range is before its start.\n";
+    return CommandStatus::Failed;
+  }
+
+  SearchResult result = calendar.search(query, options);
+  out << "--- showing " << result.hits.size() << " of " << result.total
+      << " match(es) ---\n";
+  for (size_t i = 0; i < result.hits.size(); ++i) {
+    if (i > 0)
+      out << "--\n";
+    out << "Score: " << std::fixed << std::setprecision(2)
+        << result.hits[i].score << std::defaultfloat << "\n"
+        << result.hits[i].event;
+  }
+  // only resident events are indexed
+  auto window_start = calendar.get_window_start();
+  if (window_start && (!options.from || *options.from < *window_start)) {
+    out << "(events that ended before the residency window are not "
+           "searched)\n";
+  }
+  out << "------------------\n";
+  return CommandStatus::Ok;
+}
+
+// "2025.01.06 10:00 - 2025.01.06 11:30"
+std::string format_span(const time_point &start, const time_point &end) {
+  std::string text;
+  format_time(text, EventStore::to_us(start));
+  text += " - ";
+  format_time(text, EventStore::to_us(end));
+  return text;
+}
+
+CommandStatus find_conflicts(Calendar &calendar, std::istringstream &iss,
+                             std::ostream &out) {
+  std::string from_arg, to_arg;
+  iss >> from_arg >> to_arg;
+  auto from = parse_time(from_arg);
+  auto to = parse_time(to_arg);
+  if (!from || !to) {
+    out << "Usage: conflicts <from> <to>, e.g. conflicts 2025-01-06 "
+           "2025-01-12T23:59\n";
+    return CommandStatus::Failed;
+  }
+  if (*to < *from) {
+    out << "The end of the range is before its start.\n";
+    return CommandStatus::Failed;
+  }
+
+  auto conflicts = calendar.find_conflicts(*from, *to);
+  out << "--- " << conflicts.size() << " conflict(s) ---\n";
+  for (size_t i = 0; i < conflicts.size(); ++i) {
+    const Conflict &conflict = conflicts[i];
+    if (i > 0)
+      out << "--\n";
+    out << format_span(conflict.start, conflict.end) << "\n"
+        << "  " << conflict.first.get_id() << ": "
+        << conflict.first.get_name() << "\n"
+        << "  " << conflict.second.get_id() << ": "
+        << conflict.second.get_name() << "\n";
+  }
+  out << "------------------\n";
+  return CommandStatus::Ok;
+}
+
+// "90" (minutes), "45m", "2h"
+std::optional<std::chrono::minutes> parse_minutes(const std::string &text) {
+  size_t used = 0;
+  long long value = std::stoll(text, &used);
+  std::string_view unit = std::string_view(text).substr(used);
+  if (value < 0)
+    return std::nullopt;
+  if (unit.empty() || unit == "m")
+    return std::chrono::minutes(value);
+  if (unit == "h")
+    return std::chrono::hours(value);
+  return std::nullopt;
+}
+
+CommandStatus find_free_slots(Calendar &calendar, std::istringstream &iss,
+                              std::ostream &out) {
+  std::string from_arg, to_arg, min_arg;
+  iss >> from_arg >> to_arg >> min_arg;
+  auto from = parse_time(from_arg);
+  auto to = parse_time(to_arg);
+  auto min_duration = min_arg.empty() ? std::chrono::minutes(0)
+                                      : parse_minutes(min_arg);
+  if (!from || !to || !min_duration) {
+    out << "Usage: free <from> <to> [min length], e.g. free "
+           "2025-01-06T09:00 2025-01-06T17:00 30m\n";
+    return CommandStatus::Failed;
+  }
+  if (*to < *from) {
+    out << "The end of the range is before its start.\n";
+    return CommandStatus::Failed;
+  }
+
+  auto slots = calendar.free_slots(*from, *to, *min_duration);
+  out << "--- " << slots.size() << " free slot(s) ---\n";
+  for (const TimeSlot &slot : slots) {
+    auto length =
+        std::chrono::duration_cast<std::chrono::minutes>(slot.end - slot.start);
+    out << format_span(slot.start, slot.end) << " (" << length.count() / 60
+        << "h " << length.count() % 60 << "m)\n";
+  }
+  out << "------------------\n";
+  return CommandStatus::Ok;
+}
+
+CommandStatus add_event(Calendar &calendar, std::istringstream &iss,
+                        std::ostream &out) {
+  std::string name;
+  std::getline(iss, name);
+  trim_leading_ws(name);
+
+  // Ensure we have a name before proceeding
+  if (name.empty()) {
+    out << "Event name cannot be empty. Add operation cancelled.\n";
+    return CommandStatus::Failed;
+  }
+
+  auto now = std::chrono::system_clock::now();
+  Event ev(name, now, now + std::chrono::hours(1));
+
+  if (calendar.create_event(ev)) {
+    out << "Event '" << name << "' added successfully!\n";
+    return CommandStatus::Ok;
+  }
+  out << "Failed to add event.\n";
+  return CommandStatus::Failed;
+}
+
+CommandStatus remove_event(Calendar &calendar, std::istringstream &iss,
+                           std::ostream &out) {
+  std::string id;
+  std::getline(iss, id);
+  trim_leading_ws(id);
+  id.erase(id.find_last_not_of(" \t\n\r\f\v") + 1);
+
+  // Ensure we have a id before proceeding
+  if (id.empty()) {
+    out << "Event id cannot be empty. Remove operation cancelled.\n";
+    return CommandStatus::Failed;
+  }
+  auto parsed = parse_count<uint32_t>(id);
+  if (!parsed) {
+    out << "Invalid event id '" << id << "'.\nUsage: rm <id>\n";
+    return CommandStatus::Failed;
+  }
+
+  // the batch call tells a missing event from a failed removal
+  uint32_t target = *parsed;
+  switch (calendar.remove_events(std::span<const uint32_t>(&target, 1))[0]) {
+  case OpStatus::Ok:
+    out << "Event with id '" << id << "' removed successfully!\n";
+    return CommandStatus::Ok;
+  case OpStatus::NotFound:
+    out << "Event with id '" << id << "' not found.\n";
+    return CommandStatus::Failed;
+  case OpStatus::Failed:
+    break;
+  }
+  out << "Failed to remove event.\n";
+  return CommandStatus::Failed;
+}
+
+constexpr const char *update_usage =
+    "Usage: update id <id> [name <name>] [desc <description>]\n";
+
+CommandStatus update_event(Calendar &calendar, std::istringstream &iss,
+                           std::ostream &out) {
+  uint32_t id = 0;
+  std::string name;
+  std::string desc;
+
+  // Parse remaining input
+  std::string token;
+  while (iss >> token) {
+    if (token == "id" && (iss >> token)) {
+      auto parsed = parse_count<uint32_t>(token);
+      if (!parsed) {
+        out << "Invalid event id '" << token << "'.\n" << update_usage;
+        return CommandStatus::Failed;
+      }
+      id = *parsed;
+    } else if (token == "name" && std::getline(iss, token)) {
+      trim_leading_ws(token);
+      name = token;
+    } else if (token == "desc" && std::getline(iss, token)) {
+      trim_leading_ws(token);
+      desc = token;
+    }
+  }
+
+  if (id == 0) {
+    out << "Please specify a valid event id. Update cancelled.\n"
+        << update_usage;
+    return CommandStatus::Failed;
+  }
+
+  if (name.empty() && desc.empty()) {
+    out << "Nothing to update. Provide 'name' and/or 'desc'.\n";
+    return CommandStatus::Failed;
+  }
+
+  if (calendar.update_event_by_id(id, name, desc)) {
+    out << "Event " << id << " updated successfully.\n";
+    return CommandStatus::Ok;
+  }
+  out << "Failed to update event. Event with id " << id << " not found.\n";
+  return CommandStatus::Failed;
+}
+
+const char *change_name(ChangeKind kind) {
+  switch (kind) {
+  case ChangeKind::Created:
+    return "created";
+  case ChangeKind::Updated:
+    return "updated";
+  case ChangeKind::Removed:
+    return "removed";
+  case ChangeKind::Started:
+    return "started";
+  case ChangeKind::Ended:
+    return "ended";
+  }
+  return "unknown";
+}
+
+CommandStatus list_changes(Calendar &calendar, std::istringstream &iss,
+                           std::ostream &out) {
+  uint64_t after = 0;
+  std::string token;
+  if (iss >> token) {
+    auto seq = parse_count<uint64_t>(token);
+    if (!seq) {
+      out << "Usage: changes [seq]\n";
+      return CommandStatus::Failed;
+    }
+    after = *seq;
+  }
+
+  // bounded, clients page through with the seq printed at the end
+  constexpr size_t max_changes = 1000;
+  std::vector<Change> changes;
+  if (!calendar.changes_since(after, changes, max_changes)) {
+    out << "Changes after " << after << " are no longer kept, reload with "
+        << "'list' and continue from " << calendar.last_change() << ".\n";
+    return CommandStatus::Failed;
+  }
+  for (const Change &change : changes) {
+    out << change.seq << " " << change_name(change.kind) << " " << change.id
+        << "\n";
+  }
+  uint64_t last = changes.empty() ? after : changes.back().seq;
+  out << "Up to change " << last << " of " << calendar.last_change()
+      << ".\n";
+  return CommandStatus::Ok;
+}
+
+CommandStatus import_events(Calendar &calendar, std::istringstream &iss,
+                            std::ostream &out) {
+  std::string path;
+  std::getline(iss, path);
+  trim_leading_ws(path);
+  if (path.empty()) {
+    out << "Usage: import <file.ics>\n";
+    return CommandStatus::Failed;
+  }
+
+  auto result = import_ics(calendar, path);
+  if (!result) {
+    out << "Failed to read " << path << ".\n";
+    return CommandStatus::Failed;
+  }
+  out << "Imported " << result->imported << " event(s) from " << path
+      << ".\n";
+  if (result->skipped > 0)
+    out << result->skipped << " event(s) without a usable start skipped.\n";
+  if (result->failed > 0) {
+    out << result->failed << " event(s) failed to save.\n";
+    return CommandStatus::Failed;
+  }
+  return CommandStatus::Ok;
+}
+
+CommandStatus export_events(Calendar &calendar, std::istringstream &iss,
+                            std::ostream &out) {
+  std::string path;
+  std::getline(iss, path);
+  trim_leading_ws(path);
+  if (path.empty()) {
+    out << "Usage: export <file.ics>\n";
+    return CommandStatus::Failed;
+  }
+
+  auto written = export_ics(calendar, path);
+  if (!written) {
+    out << "Failed to export to " << path << ".\n";
+    return CommandStatus::Failed;
+  }
+  out << "Exported " << *written << " event(s) to " << path << ".\n";
+  return CommandStatus::Ok;
+}
+
+CommandStatus print_stats(std::istringstream &iss, std::ostream &out) {
+  std::string format;
+  iss >> format;
+  if (format == "prometheus") {
+    metrics::write_prometheus(out, metrics::collect());
+  } else if (format.empty()) {
+    metrics::write_summary(out, metrics::collect());
+  } else {
+    out << "Usage: stats [prometheus]\n";
+    return CommandStatus::Failed;
+  }
+  return CommandStatus::Ok;
+}
+
+CommandStatus control_trace(std::istringstream &iss, std::ostream &out) {
+  std::string action, path;
+  iss >> action;
+  std::getline(iss, path);
+  trim_leading_ws(path);
+  if (action == "on") {
+    trace::set_enabled(true);
+    out << "Tracing on.\n";
+  } else if (action == "off") {
+    trace::set_enabled(false);
+    out << "Tracing off.\n";
+  } else if (action == "dump") {
+    if (path.empty())
+      path = trace::default_path();
+    if (!trace::dump(path)) {
+      out << "Failed to write the trace to " << path << ".\n";
+      return CommandStatus::Failed;
+    }
+    out << "Trace written to " << path << ".\n";
+  } else {
+    out << "Usage: trace on|off|dump [path]\n";
+    return CommandStatus::Failed;
+  }
+  return CommandStatus::Ok;
+}
+
+CommandStatus print_help(std::ostream &out) {
+  out << "Available commands:\n";
+  // Find the longest command name for alignment
+  size_t max_len = 0;
+  for (auto const &[cmd_name, _] : command_descriptions()) {
+    if (cmd_name.length() > max_len) {
+      max_len = cmd_name.length();
+    }
+  }
+  // Print formatted help
+  for (auto const &[cmd_name, desc] : command_descriptions()) {
+    out << "  " << std::left << std::setw(max_len + 2) << cmd_name << desc
+        << "\n";
+  }
+  return CommandStatus::Ok;
+}
+
+// what a command is timed and traced as
+struct CommandKind {
+  const char *name;
+  metrics::Timer timer;
+};
+
+CommandKind command_kind(const std::string &cmd) {
+  if (cmd == "list" || cmd == "ls")
+    return {"list", metrics::Timer::CommandList};
+  if (cmd == "query")
+    return {"query", metrics::Timer::CommandQuery};
+  if (cmd == "search")
+    return {"search", metrics::Timer::CommandSearch};
+  if (cmd == "add")
+    return {"add", metrics::Timer::CommandAdd};
+  if (cmd == "remove" || cmd == "rm")
+    return {"remove", metrics::Timer::CommandRemove};
+  if (cmd == "update")
+    return {"update", metrics::Timer::CommandUpdate};
+  if (cmd == "changes")
+    return {"changes", metrics::Timer::CommandChanges};
+  if (cmd == "stats")
+    return {"stats", metrics::Timer::CommandStats};
+  if (cmd == "conflicts")
+    return {"conflicts", metrics::Timer::CommandOther};
+  if (cmd == "free")
+    return {"free", metrics::Timer::CommandOther};
+  if (cmd == "import")
+    return {"import", metrics::Timer::CommandOther};
+  if (cmd == "export")
+    return {"export", metrics::Timer::CommandOther};
+  if (cmd == "trace")
+    return {"trace", metrics::Timer::CommandOther};
+  return {"other", metrics::Timer::CommandOther};
+}
+
+CommandStatus dispatch(Calendar &calendar, const std::string &cmd,
+                       std::istringstream &iss, std::ostream &out) {
+  try {
+    if (cmd == "exit") {
+      return CommandStatus::Exit;
+    } else if (cmd == "list" || cmd == "ls") {
+      return list_events(calendar, iss, out);
+    } else if (cmd == "query") {
+      return query_events(calendar, iss, out);
+    } else if (cmd == "search") {
+      return search_events(calendar, iss, out);
+    } else if (cmd == "conflicts") {
+      return find_conflicts(calendar, iss, out);
+    } else if (cmd == "free") {
+      return find_free_slots(calendar, iss, out);
+    } else if (cmd == "add") {
+      return add_event(calendar, iss, out);
+    } else if (cmd == "remove" || cmd == "rm") {
+      return remove_event(calendar, iss, out);
+    } else if (cmd == "update") {
+      return update_event(calendar, iss, out);
+    } else if (cmd == "changes") {
+      return list_changes(calendar, iss, out);
+    } else if (cmd == "import") {
+      return import_events(calendar, iss, out);
+    } else if (cmd == "export") {
+      return export_events(calendar, iss, out);
+    } else if (cmd == "stats") {
+      return print_stats(iss, out);
+    } else if (cmd == "trace") {
+      return control_trace(iss, out);
+    } else if (cmd == "help") {
+      return print_help(out);
+    }
+  } catch (const std::exception &e) {
+    // bad numbers from std::stoul and the like
+    out << "Invalid arguments for '" << cmd << "': " << e.what() << "\n";
+    return CommandStatus::Failed;
+  }
+
+  out << "Unknown command: '" << cmd
+      << "'. Type 'help' for a list of commands.\n";
+  return CommandStatus::Failed;
+}
+} // namespace
+
+const std::map<std::string, std::string> &command_descriptions() {
+  static const std::map<std::string, std::string> commands = {
+      {"add", "Add a new event. Usage: add [event name]"},
+      {"changes", "List what changed after a change number. Usage: changes "
+                  "[seq]"},
+      {"conflicts", "List the events overlapping each other. Usage: "
+                    "conflicts <from> <to>"},
+      {"export", "Write every event to an iCalendar file. Usage: export "
+                 "<file.ics>"},
+      {"free", "List the gaps between events, at least as long as given "
+               "(minutes, or 45m, 2h). Usage: free <from> <to> [min length]"},
+      {"help", "Show this help message."},
+      {"import", "Add the events of an iCalendar file. Usage: import "
+                 "<file.ics>"},
+      {"list", "List events, in start order unless sorted otherwise. Usage: "
+               "list [from [to]] [--limit N] [--sort start|end|name|id] "
+               "[--desc] [--ndjson]"},
+      {"query", "Count and list events overlapping a time range. Usage: "
+                "query <from> <to> (YYYY-MM-DD[THH:MM], UTC)"},
+      {"search", "Find events whose name or description contains every "
+                 "word, best match first. Usage: search <words...> [--from "
+                 "T] [--to T] [--limit N] [--by-start]"},
+      {"stats", "Show counters and latencies. Usage: stats [prometheus]"},
+      {"trace", "Record a timeline, Chrome trace format. Usage: trace "
+                "on|off|dump [path]"},
+      {"exit", "Exit the application."}};
+  return commands;
+}
+
+CommandStatus run_command(Calendar &calendar, const std::string &line,
+                          std::ostream &out) {
+  std::istringstream iss(line);
+  std::string cmd;
+  iss >> cmd;
+
+  CommandKind kind = command_kind(cmd);
+  metrics::ScopedTimer timer(kind.timer);
+  trace::Span span(kind.name, "command");
+  CommandStatus status = dispatch(calendar, cmd, iss, out);
+  if (status == CommandStatus::Failed)
+    metrics::add(metrics::Counter::CommandErrors);
+  return status;
+}
+
+} // namespace task_manager
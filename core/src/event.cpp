@@ -1,14 +1,18 @@
 #include "event.hpp"
-#include <format>
+#include "event_format.hpp"
 
 namespace task_manager {
 
 std::ostream &operator<<(std::ostream &os, const Event &event) {
-  os << "Id: " << event.get_id() << "\n"
-     << "Name: " << event.get_name() << "\n"
-     << "Start: " << std::format("{:%Y.%m.%d %H:%M}", event.get_start()) << "\n"
-     << "End: " << std::format("{:%Y.%m.%d %H:%M}", event.get_end()) << "\n"
-     << "Description: " << event.get_description() << "\n";
-  return os;
+  auto to_us = [](const time_point &time_p) {
+    return std::chrono::time_point_cast<std::chrono::microseconds>(time_p)
+        .time_since_epoch()
+        .count();
+  };
+  std::string out;
+  format_event(out, event.get_id(), to_us(event.get_start()),
+               to_us(event.get_end()), event._ongoing, event.get_name(),
+               event.get_description(), ListFormat::Text);
+  return os.write(out.data(), static_cast<std::streamsize>(out.size()));
 }
 } // namespace task_manager
@@ -0,0 +1,148 @@
+#include "event_format.hpp"
+#include <chrono>
+#include <format>
+#include <iterator>
+
+namespace task_manager {
+
+namespace {
+
+inline char *put_digits(char *p, unsigned value, int width) {
+  for (int i = width - 1; i >= 0; --i) {
+    p[i] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  }
+  return p + width;
+}
+
+struct Civil {
+  int year;
+  unsigned month, day, hour, minute, second, micros;
+};
+
+Civil civil(int64_t us) {
+  using namespace std::chrono;
+  sys_time<microseconds> time_p{microseconds(us)};
+  auto day = floor<days>(time_p);
+  year_month_day date{day};
+  hh_mm_ss<microseconds> time{time_p - day};
+  return {static_cast<int>(date.year()),
+          static_cast<unsigned>(date.month()),
+          static_cast<unsigned>(date.day()),
+          static_cast<unsigned>(time.hours().count()),
+          static_cast<unsigned>(time.minutes().count()),
+          static_cast<unsigned>(time.seconds().count()),
+          static_cast<unsigned>(time.subseconds().count())};
+}
+
+// "2025.01.06 10:00", what the listing always printed
+std::string_view text_time(int64_t us, char (&buf)[32]) {
+  Civil c = civil(us);
+  if (c.year < 0 || c.year > 9999) {
+    // at most "-292277.12.31 23:59", the range of int64 microseconds
+    char *end = std::format_to(buf, "{}.{:02}.{:02} {:02}:{:02}", c.year,
+                               c.month, c.day, c.hour, c.minute);
+    return {buf, end};
+  }
+  char *p = put_digits(buf, static_cast<unsigned>(c.year), 4);
+  *p++ = '.';
+  p = put_digits(p, c.month, 2);
+  *p++ = '.';
+  p = put_digits(p, c.day, 2);
+  *p++ = ' ';
+  p = put_digits(p, c.hour, 2);
+  *p++ = ':';
+  p = put_digits(p, c.minute, 2);
+  return {buf, p};
+}
+
+// "2025-01-06T10:00:00Z", with microseconds when there are any
+std::string_view rfc3339_time(int64_t us, char (&buf)[32]) {
+  Civil c = civil(us);
+  if (c.year < 0 || c.year > 9999)
+    c = civil(0); // outside what RFC 3339 can write, not a real event
+  char *p = put_digits(buf, static_cast<unsigned>(c.year), 4);
+  *p++ = '-';
+  p = put_digits(p, c.month, 2);
+  *p++ = '-';
+  p = put_digits(p, c.day, 2);
+  *p++ = 'T';
+  p = put_digits(p, c.hour, 2);
+  *p++ = ':';
+  p = put_digits(p, c.minute, 2);
+  *p++ = ':';
+  p = put_digits(p, c.second, 2);
+  if (c.micros != 0) {
+    *p++ = '.';
+    p = put_digits(p, c.micros, 6);
+  }
+  *p++ = 'Z';
+  return {buf, p};
+}
+
+void append_json_string(std::string &out, std::string_view text) {
+  static constexpr char hex[] = "0123456789abcdef";
+  out.push_back('"');
+  size_t run = 0; // start of the pending unescaped run
+  for (size_t i = 0; i < text.size(); ++i) {
+    auto c = static_cast<unsigned char>(text[i]);
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    out.append(text.data() + run, i - run);
+    run = i + 1;
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      out += "\\u00";
+      out.push_back(hex[c >> 4]);
+      out.push_back(hex[c & 0xF]);
+    }
+  }
+  out.append(text.data() + run, text.size() - run);
+  out.push_back('"');
+}
+
+} // namespace
+
+void format_event(std::string &out, uint32_t id, int64_t start_us,
+                  int64_t end_us, bool ongoing, std::string_view name,
+                  std::string_view description, ListFormat format) {
+  char start_buf[32], end_buf[32];
+  if (format == ListFormat::Text) {
+    std::format_to(std::back_inserter(out),
+                   "Id: {}\nName: {}\nStart: {}\nEnd: {}\nDescription: {}\n",
+                   id, name, text_time(start_us, start_buf),
+                   text_time(end_us, end_buf), description);
+    return;
+  }
+
+  std::format_to(std::back_inserter(out), "{{\"id\":{},\"name\":", id);
+  append_json_string(out, name);
+  out += ",\"description\":";
+  append_json_string(out, description);
+  std::format_to(std::back_inserter(out),
+                 ",\"start\":\"{}\",\"end\":\"{}\",\"ongoing\":{}}}\n",
+                 rfc3339_time(start_us, start_buf),
+                 rfc3339_time(end_us, end_buf), ongoing);
+}
+
+void format_time(std::string &out, int64_t us) {
+  char buf[32];
+  out += text_time(us, buf);
+}
+
+} // namespace task_manager
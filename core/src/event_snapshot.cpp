@@ -0,0 +1,88 @@
+#include "event_snapshot.hpp"
+#include "event_format.hpp"
+#include <algorithm>
+
+namespace task_manager {
+
+Event EventView::to_event() const {
+  Event event(std::string(this->_name), this->get_start(), this->get_end(),
+              this->_id);
+  event.set_description(std::string(this->_description));
+  event._ongoing = this->is_ongoing();
+  return event;
+}
+
+std::ostream &operator<<(std::ostream &os, const EventView &event) {
+  std::string out;
+  format_event(out, event._id, event._start_us, event._end_us,
+               event.is_ongoing(), event._name, event._description,
+               ListFormat::Text);
+  return os.write(out.data(), static_cast<std::streamsize>(out.size()));
+}
+
+EventView EventSnapshot::Page::view(size_t i) const {
+  std::string_view all(this->text);
+  return EventView(this->ids[i], this->starts[i], this->ends[i],
+                   this->flags[i],
+                   all.substr(this->name_off[i], this->name_len[i]),
+                   all.substr(this->desc_off[i], this->desc_len[i]));
+}
+
+std::shared_ptr<const EventSnapshot::Page>
+EventSnapshot::make_page(const EventStore &store, size_t page) {
+  auto copy = std::make_shared<Page>();
+  size_t first = page * page_size;
+  size_t count = std::min(page_size, store.size() - first);
+  copy->version = store.page_version(page);
+  copy->count = static_cast<uint32_t>(count);
+
+  size_t text_bytes = 0;
+  for (size_t i = 0; i < count; ++i) {
+    auto slot = static_cast<uint32_t>(first + i);
+    text_bytes += store.name(slot).size() + store.description(slot).size();
+  }
+  copy->text.reserve(text_bytes);
+
+  for (size_t i = 0; i < count; ++i) {
+    auto slot = static_cast<uint32_t>(first + i);
+    copy->starts[i] = store.start_us(slot);
+    copy->ends[i] = store.end_us(slot);
+    copy->ids[i] = store.id(slot);
+    copy->flags[i] = store.flags(slot);
+    copy->name_off[i] = static_cast<uint32_t>(copy->text.size());
+    copy->name_len[i] = static_cast<uint32_t>(store.name(slot).size());
+    copy->text += store.name(slot);
+    copy->desc_off[i] = static_cast<uint32_t>(copy->text.size());
+    copy->desc_len[i] = static_cast<uint32_t>(store.description(slot).size());
+    copy->text += store.description(slot);
+  }
+  return copy;
+}
+
+std::shared_ptr<const EventSnapshot>
+EventSnapshot::make(const EventStore &store,
+                    const std::shared_ptr<const EventSnapshot> &previous) {
+  auto snapshot = std::make_shared<EventSnapshot>();
+  snapshot->_version = store.version();
+  snapshot->_size = store.size();
+
+  size_t pages = (store.size() + page_size - 1) / page_size;
+  snapshot->_pages.reserve(pages);
+  for (size_t page = 0; page < pages; ++page) {
+    // the page version changes with every mutation inside the page, and a
+    // push or erase changing its count is one of them
+    if (previous && page < previous->_pages.size() &&
+        previous->_pages[page]->version == store.page_version(page)) {
+      snapshot->_pages.push_back(previous->_pages[page]);
+    } else {
+      snapshot->_pages.push_back(make_page(store, page));
+    }
+  }
+  return snapshot;
+}
+
+EventView EventSnapshot::operator[](size_t i) const {
+  return this->_pages[i / page_size]->view(i % page_size);
+}
+
+} // namespace task_manager
@@ -0,0 +1,155 @@
+#include "event_store.hpp"
+#include "event_snapshot.hpp"
+#include <stdexcept>
+
+namespace task_manager {
+
+void EventStore::reserve(size_t n, size_t text_bytes) {
+  this->_starts.reserve(n);
+  this->_ends.reserve(n);
+  this->_ids.reserve(n);
+  this->_flags.reserve(n);
+  this->_names.reserve(n);
+  this->_descriptions.reserve(n);
+  this->_arena.reserve(text_bytes);
+  this->_slots.reserve(n);
+}
+
+void EventStore::clear() {
+  this->_starts.clear();
+  this->_ends.clear();
+  this->_ids.clear();
+  this->_flags.clear();
+  this->_names.clear();
+  this->_descriptions.clear();
+  this->_arena.clear();
+  this->_garbage = 0;
+  this->_slots.clear();
+  // every page reads as changed, later stamps are above anything seen before
+  this->_page_versions.clear();
+  ++this->_version;
+}
+
+EventStore::TextRef EventStore::append_text(std::string_view text) {
+  if (this->_arena.size() + text.size() > UINT32_MAX)
+    throw std::length_error("event text arena is full");
+  TextRef ref{static_cast<uint32_t>(this->_arena.size()),
+              static_cast<uint32_t>(text.size())};
+  this->_arena.append(text);
+  return ref;
+}
+
+uint32_t EventStore::push(uint32_t id, int64_t start_us, int64_t end_us,
+                          uint8_t flags, std::string_view name,
+                          std::string_view description) {
+  auto slot = static_cast<uint32_t>(this->_ids.size());
+  this->_starts.push_back(start_us);
+  this->_ends.push_back(end_us);
+  this->_ids.push_back(id);
+  this->_flags.push_back(flags);
+  this->_names.push_back(this->append_text(name));
+  this->_descriptions.push_back(this->append_text(description));
+  this->_slots.set(id, slot);
+  this->touch(slot);
+  return slot;
+}
+
+uint32_t EventStore::push(const Event &event) {
+  return this->push(event.get_id(), to_us(event.get_start()),
+                    to_us(event.get_end()),
+                    event._ongoing ? uint8_t{Ongoing} : uint8_t{0},
+                    event.get_name(), event.get_description());
+}
+
+void EventStore::erase(uint32_t slot) {
+  this->_garbage += this->_names[slot].length;
+  this->_garbage += this->_descriptions[slot].length;
+  this->_slots.erase(this->_ids[slot]);
+
+  auto last = static_cast<uint32_t>(this->_ids.size() - 1);
+  this->touch(slot);
+  this->touch(last);
+  if (slot != last) {
+    this->_starts[slot] = this->_starts[last];
+    this->_ends[slot] = this->_ends[last];
+    this->_ids[slot] = this->_ids[last];
+    this->_flags[slot] = this->_flags[last];
+    this->_names[slot] = this->_names[last];
+    this->_descriptions[slot] = this->_descriptions[last];
+    this->_slots.set(this->_ids[slot], slot);
+  }
+  this->_starts.pop_back();
+  this->_ends.pop_back();
+  this->_ids.pop_back();
+  this->_flags.pop_back();
+  this->_names.pop_back();
+  this->_descriptions.pop_back();
+
+  this->maybe_compact();
+}
+
+void EventStore::set_name(uint32_t slot, std::string_view name) {
+  // the new text might alias the arena, append before dropping the old one
+  TextRef ref = this->append_text(name);
+  this->_garbage += this->_names[slot].length;
+  this->_names[slot] = ref;
+  this->touch(slot);
+  this->maybe_compact();
+}
+
+void EventStore::set_description(uint32_t slot, std::string_view description) {
+  TextRef ref = this->append_text(description);
+  this->_garbage += this->_descriptions[slot].length;
+  this->_descriptions[slot] = ref;
+  this->touch(slot);
+  this->maybe_compact();
+}
+
+void EventStore::maybe_compact() {
+  // renames and removals only leave holes behind, repack once they are
+  // half of the arena
+  if (this->_garbage < 4096 || this->_garbage * 2 < this->_arena.size())
+    return;
+
+  std::string arena;
+  arena.reserve(this->_arena.size() - this->_garbage);
+  auto move_text = [&](TextRef &ref) {
+    uint32_t offset = static_cast<uint32_t>(arena.size());
+    arena.append(this->_arena, ref.offset, ref.length);
+    ref.offset = offset;
+  };
+  for (size_t slot = 0; slot < this->_ids.size(); ++slot) {
+    move_text(this->_names[slot]);
+    move_text(this->_descriptions[slot]);
+  }
+  this->_arena = std::move(arena);
+  this->_garbage = 0;
+}
+
+Event EventStore::to_event(uint32_t slot) const {
+  Event event(std::string(this->name(slot)), this->start(slot),
+              this->end(slot), this->id(slot));
+  event.set_description(std::string(this->description(slot)));
+  event._ongoing = this->flags(slot) & Flag::Ongoing;
+  return event;
+}
+
+size_t EventStore::memory_usage() const {
+  return this->_starts.capacity() * sizeof(int64_t) +
+         this->_ends.capacity() * sizeof(int64_t) +
+         this->_ids.capacity() * sizeof(uint32_t) +
+         this->_flags.capacity() * sizeof(uint8_t) +
+         (this->_names.capacity() + this->_descriptions.capacity()) *
+             sizeof(TextRef) +
+         this->_arena.capacity();
+}
+
+std::ostream &operator<<(std::ostream &os, const EventRef &event) {
+  const EventStore &store = *event._store;
+  return os << EventView(store.id(event._slot), store.start_us(event._slot),
+                         store.end_us(event._slot), store.flags(event._slot),
+                         store.name(event._slot),
+                         store.description(event._slot));
+}
+
+} // namespace task_manager
@@ -0,0 +1,525 @@
+#include "ics.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace task_manager {
+
+namespace {
+
+constexpr int64_t us_per_second = 1000000;
+constexpr int64_t us_per_day = 86400 * us_per_second;
+// RFC 5545 3.1, without the CRLF
+constexpr size_t max_line_octets = 75;
+
+// next physical line without its line break, advances `pos` past it
+inline std::string_view physical_line(std::string_view text, size_t &pos) {
+  const char *begin = text.data() + pos;
+  size_t rest = text.size() - pos;
+  const void *nl = std::memchr(begin, '\n', rest);
+  size_t len = nl ? static_cast<size_t>(static_cast<const char *>(nl) - begin)
+                  : rest;
+  pos += nl ? len + 1 : len;
+  if (len > 0 && begin[len - 1] == '\r')
+    --len;
+  return {begin, len};
+}
+
+inline bool folded_at(std::string_view text, size_t pos) {
+  return pos < text.size() && (text[pos] == ' ' || text[pos] == '\t');
+}
+
+// names and keywords are case-insensitive, `upper` is written in capitals
+inline bool iequals(std::string_view text, std::string_view upper) {
+  if (text.size() != upper.size())
+    return false;
+  for (size_t i = 0; i < text.size(); ++i) {
+    char c = text[i];
+    if (c >= 'a' && c <= 'z')
+      c = static_cast<char>(c - 'a' + 'A');
+    if (c != upper[i])
+      return false;
+  }
+  return true;
+}
+
+inline bool istarts_with(std::string_view text, std::string_view upper) {
+  return text.size() >= upper.size() &&
+         iequals(text.substr(0, upper.size()), upper);
+}
+
+struct Property {
+  std::string_view name;
+  std::string_view value;
+};
+
+// NAME;PARAM=...;PARAM="quoted:value":VALUE
+bool split_property(std::string_view line, Property &property) {
+  size_t i = 0;
+  while (i < line.size() && line[i] != ';' && line[i] != ':')
+    ++i;
+  property.name = line.substr(0, i);
+  bool quoted = false;
+  for (; i < line.size(); ++i) {
+    if (line[i] == '"')
+      quoted = !quoted;
+    else if (line[i] == ':' && !quoted)
+      break;
+  }
+  if (i == line.size())
+    return false;
+  property.value = line.substr(i + 1);
+  return true;
+}
+
+// TEXT values: \\ \; \, and \n
+void decode_text(std::string_view value, std::string &out) {
+  out.clear();
+  size_t run = 0;
+  for (size_t i = value.find('\\'); i != std::string_view::npos;
+       i = value.find('\\', run)) {
+    out.append(value.data() + run, i - run);
+    run = i + 2;
+    if (i + 1 == value.size())
+      break; // a lone trailing backslash is dropped
+    char c = value[i + 1];
+    out.push_back(c == 'n' || c == 'N' ? '\n' : c);
+  }
+  if (run < value.size())
+    out.append(value.data() + run, value.size() - run);
+}
+
+// "20250106", "20250106T100000" or "20250106T100000Z"
+bool parse_ics_time(std::string_view value, int64_t &us, bool &date_only) {
+  auto digits = [&](size_t pos, size_t len, unsigned &out) {
+    if (pos + len > value.size())
+      return false;
+    out = 0;
+    for (size_t i = pos; i < pos + len; ++i) {
+      unsigned d = static_cast<unsigned char>(value[i]) - unsigned{'0'};
+      if (d > 9)
+        return false;
+      out = out * 10 + d;
+    }
+    return true;
+  };
+
+  unsigned y, mo, d, h = 0, mi = 0, s = 0;
+  if (!digits(0, 4, y) || !digits(4, 2, mo) || !digits(6, 2, d))
+    return false;
+  date_only = value.size() == 8;
+  if (!date_only) {
+    if (value[8] != 'T' || !digits(9, 2, h) || !digits(11, 2, mi) ||
+        !digits(13, 2, s))
+      return false;
+    if (value.size() != 15 && !(value.size() == 16 && value[15] == 'Z'))
+      return false;
+  }
+
+  std::chrono::year_month_day date{std::chrono::year(static_cast<int>(y)),
+                                   std::chrono::month(mo), std::chrono::day(d)};
+  // 60 is a leap second
+  if (!date.ok() || h > 23 || mi > 59 || s > 60)
+    return false;
+  int64_t days = std::chrono::sys_days(date).time_since_epoch().count();
+  us = days * us_per_day + (h * 3600 + mi * 60 + s) * us_per_second;
+  return true;
+}
+
+// "PT1H30M", "P1D", "-P2W"
+bool parse_ics_duration(std::string_view value, int64_t &us) {
+  size_t i = 0;
+  int64_t sign = 1;
+  if (i < value.size() && (value[i] == '+' || value[i] == '-'))
+    sign = value[i++] == '-' ? -1 : 1;
+  if (i >= value.size() || value[i++] != 'P')
+    return false;
+
+  bool time = false, any = false;
+  int64_t seconds = 0;
+  while (i < value.size()) {
+    if (value[i] == 'T') {
+      time = true;
+      ++i;
+      continue;
+    }
+    int64_t n = 0;
+    auto [ptr, ec] =
+        std::from_chars(value.data() + i, value.data() + value.size(), n);
+    if (ec != std::errc() || ptr == value.data() + value.size())
+      return false;
+    i = static_cast<size_t>(ptr - value.data());
+    int64_t unit;
+    switch (value[i++]) {
+    case 'W':
+      unit = time ? 0 : 7 * 86400;
+      break;
+    case 'D':
+      unit = time ? 0 : 86400;
+      break;
+    case 'H':
+      unit = time ? 3600 : 0;
+      break;
+    case 'M':
+      unit = time ? 60 : 0;
+      break;
+    case 'S':
+      unit = time ? 1 : 0;
+      break;
+    default:
+      return false;
+    }
+    if (unit == 0)
+      return false;
+    seconds += n * unit;
+    any = true;
+  }
+  if (!any)
+    return false;
+  us = sign * seconds * us_per_second;
+  return true;
+}
+
+inline char *put_digits(char *p, unsigned value, int width) {
+  for (int i = width - 1; i >= 0; --i) {
+    p[i] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  }
+  return p + width;
+}
+
+// "20250106T100000Z", whole seconds
+std::string_view basic_time(int64_t us, char (&buf)[32]) {
+  using namespace std::chrono;
+  sys_time<microseconds> time_p{microseconds(us)};
+  auto day = floor<days>(time_p);
+  year_month_day date{day};
+  int year = static_cast<int>(date.year());
+  if (year < 0 || year > 9999)
+    return basic_time(0, buf); // not a real event
+  hh_mm_ss<seconds> time{floor<seconds>(time_p - day)};
+  char *p = put_digits(buf, static_cast<unsigned>(year), 4);
+  p = put_digits(p, static_cast<unsigned>(date.month()), 2);
+  p = put_digits(p, static_cast<unsigned>(date.day()), 2);
+  *p++ = 'T';
+  p = put_digits(p, static_cast<unsigned>(time.hours().count()), 2);
+  p = put_digits(p, static_cast<unsigned>(time.minutes().count()), 2);
+  p = put_digits(p, static_cast<unsigned>(time.seconds().count()), 2);
+  *p++ = 'Z';
+  return {buf, p};
+}
+
+// Escapes `text` and folds the line before it passes 75 octets, never in
+// the middle of a UTF-8 sequence.
+void append_text_property(std::string &out, std::string_view name,
+                          std::string_view text) {
+  out += name;
+  size_t line = name.size();
+  for (size_t i = 0; i < text.size(); ++i) {
+    auto c = static_cast<unsigned char>(text[i]);
+    if (c == '\r')
+      continue;
+    char escaped = 0;
+    if (c == '\\' || c == ';' || c == ',')
+      escaped = static_cast<char>(c);
+    else if (c == '\n')
+      escaped = 'n';
+
+    size_t width = escaped ? 2 : 1;
+    if (c >= 0xF0)
+      width = 4;
+    else if (c >= 0xE0)
+      width = 3;
+    else if (c >= 0xC0)
+      width = 2;
+    bool continuation = (c & 0xC0) == 0x80;
+    if (!continuation && line + width > max_line_octets) {
+      out += "\r\n ";
+      line = 1;
+    }
+    if (escaped) {
+      out.push_back('\\');
+      out.push_back(escaped);
+      line += 2;
+    } else {
+      out.push_back(static_cast<char>(c));
+      ++line;
+    }
+  }
+  out += "\r\n";
+}
+
+} // namespace
+
+IcsReader::IcsReader(void *data, size_t length)
+    : _data(data), _length(length),
+      _text(static_cast<const char *>(data), length) {}
+
+IcsReader::~IcsReader() {
+  if (this->_data != nullptr)
+    ::munmap(this->_data, this->_length);
+}
+
+IcsReader::IcsReader(IcsReader &&other) noexcept
+    : _data(other._data), _length(other._length), _text(other._text),
+      _pos(other._pos), _skipped(other._skipped),
+      _unfolded(std::move(other._unfolded)),
+      _summary(std::move(other._summary)),
+      _description(std::move(other._description)) {
+  other._data = nullptr;
+  other._length = 0;
+  other._text = {};
+}
+
+IcsReader &IcsReader::operator=(IcsReader &&other) noexcept {
+  if (this != &other) {
+    if (this->_data != nullptr)
+      ::munmap(this->_data, this->_length);
+    this->_data = other._data;
+    this->_length = other._length;
+    this->_text = other._text;
+    this->_pos = other._pos;
+    this->_skipped = other._skipped;
+    this->_unfolded = std::move(other._unfolded);
+    this->_summary = std::move(other._summary);
+    this->_description = std::move(other._description);
+    other._data = nullptr;
+    other._length = 0;
+    other._text = {};
+  }
+  return *this;
+}
+
+std::optional<IcsReader> IcsReader::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::nullopt;
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    return std::nullopt;
+  }
+  auto length = static_cast<size_t>(st.st_size);
+  if (length == 0) {
+    ::close(fd);
+    return IcsReader(std::string_view());
+  }
+  void *data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return std::nullopt;
+  // read front to back exactly once
+  ::madvise(data, length, MADV_SEQUENTIAL);
+  return IcsReader(data, length);
+}
+
+bool IcsReader::next_line(std::string_view &line) {
+  if (this->_pos >= this->_text.size())
+    return false;
+  line = physical_line(this->_text, this->_pos);
+  if (!folded_at(this->_text, this->_pos))
+    return true;
+  // only folded lines are copied
+  this->_unfolded.assign(line);
+  while (folded_at(this->_text, this->_pos)) {
+    std::string_view more = physical_line(this->_text, this->_pos);
+    this->_unfolded.append(more.substr(1));
+  }
+  line = this->_unfolded;
+  return true;
+}
+
+bool IcsReader::next(IcsEvent &event) {
+  std::string_view line;
+  bool in_event = false;
+  int nested = 0; // VALARMs and the like, their properties aren't ours
+  bool has_start = false, has_end = false, has_duration = false;
+  bool date_only = false, malformed = false;
+  int64_t start_us = 0, end_us = 0, duration_us = 0;
+  Property property;
+
+  while (this->next_line(line)) {
+    if (!in_event) {
+      if (iequals(line, "BEGIN:VEVENT")) {
+        in_event = true;
+        nested = 0;
+        has_start = has_end = has_duration = malformed = false;
+        this->_summary.clear();
+        this->_description.clear();
+      }
+      continue;
+    }
+    if (istarts_with(line, "BEGIN:")) {
+      ++nested;
+      continue;
+    }
+    if (nested > 0) {
+      if (istarts_with(line, "END:"))
+        --nested;
+      continue;
+    }
+    if (iequals(line, "END:VEVENT")) {
+      in_event = false;
+      if (!has_start || malformed) {
+        ++this->_skipped;
+        continue;
+      }
+      if (!has_end) {
+        // RFC 5545 3.6.1: a date lasts the day, a date-time is an instant
+        end_us = has_duration ? start_us + duration_us
+                              : start_us + (date_only ? us_per_day : 0);
+      }
+      event.summary = this->_summary;
+      event.description = this->_description;
+      event.start_us = start_us;
+      event.end_us = std::max(start_us, end_us);
+      return true;
+    }
+
+    if (!split_property(line, property))
+      continue;
+    bool end_date_only;
+    if (iequals(property.name, "SUMMARY")) {
+      decode_text(property.value, this->_summary);
+    } else if (iequals(property.name, "DESCRIPTION")) {
+      decode_text(property.value, this->_description);
+    } else if (iequals(property.name, "DTSTART")) {
+      has_start = true;
+      malformed |= !parse_ics_time(property.value, start_us, date_only);
+    } else if (iequals(property.name, "DTEND")) {
+      has_end = true;
+      malformed |= !parse_ics_time(property.value, end_us, end_date_only);
+    } else if (iequals(property.name, "DURATION")) {
+      has_duration = true;
+      malformed |= !parse_ics_duration(property.value, duration_us);
+    }
+  }
+  // a truncated last VEVENT
+  if (in_event)
+    ++this->_skipped;
+  return false;
+}
+
+IcsWriter::IcsWriter(std::ostream &out) : _buffer(out) {
+  char buf[32];
+  this->_stamp = basic_time(
+      EventStore::to_us(std::chrono::system_clock::now()), buf);
+  this->_buffer.buffer() += "BEGIN:VCALENDAR\r\nVERSION:2.0\r\n"
+                            "PRODID:-//task_manager//task_manager//EN\r\n";
+}
+
+IcsWriter::~IcsWriter() {
+  // flushed by the OutputBuffer right after
+  this->_buffer.buffer() += "END:VCALENDAR\r\n";
+}
+
+void IcsWriter::write(uint32_t id, int64_t start_us, int64_t end_us,
+                      std::string_view name, std::string_view description) {
+  std::string &out = this->_buffer.buffer();
+  char start_buf[32], end_buf[32];
+  std::format_to(std::back_inserter(out),
+                 "BEGIN:VEVENT\r\nUID:{}@task_manager\r\nDTSTAMP:{}\r\n"
+                 "DTSTART:{}\r\nDTEND:{}\r\n",
+                 id, this->_stamp, basic_time(start_us, start_buf),
+                 basic_time(end_us, end_buf));
+  append_text_property(out, "SUMMARY:", name);
+  if (!description.empty())
+    append_text_property(out, "DESCRIPTION:", description);
+  out += "END:VEVENT\r\n";
+  ++this->_written;
+  this->_buffer.maybe_flush();
+}
+
+std::optional<IcsImportResult> import_ics(Calendar &calendar,
+                                          const std::string &path,
+                                          size_t batch_size) {
+  auto reader = IcsReader::open(path);
+  if (!reader) {
+    std::cerr << "Error opening " << path << std::endl;
+    return std::nullopt;
+  }
+  trace::Span span("import ics");
+  batch_size = std::max<size_t>(batch_size, 1);
+
+  IcsImportResult result;
+  std::vector<Event> batch;
+  batch.reserve(batch_size);
+  auto commit = [&]() {
+    for (OpStatus status : calendar.create_events(batch))
+      ++(status == OpStatus::Ok ? result.imported : result.failed);
+    batch.clear();
+  };
+
+  IcsEvent event;
+  while (reader->next(event)) {
+    Event &added = batch.emplace_back(std::string(event.summary),
+                                      EventStore::from_us(event.start_us),
+                                      EventStore::from_us(event.end_us));
+    added.set_description(std::string(event.description));
+    if (batch.size() == batch_size)
+      commit();
+  }
+  if (!batch.empty())
+    commit();
+  result.skipped = reader->skipped();
+  span.set_arg(result.imported);
+  return result;
+}
+
+std::optional<size_t> export_ics(const Calendar &calendar,
+                                 const std::string &path) {
+  trace::Span span("export ics");
+  std::string tmp_path = path + ".tmp";
+  std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cerr << "Error opening " << tmp_path << " for the export"
+              << std::endl;
+    return std::nullopt;
+  }
+
+  size_t written;
+  bool read_ok;
+  {
+    IcsWriter writer(out);
+    // the archive first, it ended before anything resident
+    read_ok = calendar.for_each_archived([&](const Event &event) {
+      writer.write(event.get_id(), event._start_db, event._end_db,
+                   event.get_name(), event.get_description());
+    });
+    auto snapshot = calendar.snapshot();
+    for (EventView event : *snapshot) {
+      writer.write(event.get_id(), EventStore::to_us(event.get_start()),
+                   EventStore::to_us(event.get_end()), event.get_name(),
+                   event.get_description());
+    }
+    written = writer.written();
+  }
+  if (!read_ok || !out.flush()) {
+    if (read_ok)
+      std::cerr << "Error writing " << tmp_path << std::endl;
+    out.close();
+    std::remove(tmp_path.c_str());
+    return std::nullopt;
+  }
+  out.close();
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "Error replacing " << path << std::endl;
+    return std::nullopt;
+  }
+  span.set_arg(written);
+  return written;
+}
+
+} // namespace task_manager
@@ -0,0 +1,216 @@
+#include "interval_index.hpp"
+#include <algorithm>
+
+namespace task_manager {
+
+uint32_t IntervalIndex::next_priority() {
+  // xorshift32, only used to keep the treap balanced
+  uint32_t x = this->_rng_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  this->_rng_state = x;
+  return x;
+}
+
+int32_t IntervalIndex::allocate_node(const time_point &start,
+                                     const time_point &end, uint32_t id) {
+  int32_t n;
+  if (!this->_free_nodes.empty()) {
+    n = this->_free_nodes.back();
+    this->_free_nodes.pop_back();
+  } else {
+    n = static_cast<int32_t>(this->_nodes.size());
+    this->_nodes.emplace_back();
+  }
+
+  Node &node = this->_nodes[n];
+  node.start = start;
+  node.end = end;
+  node.min_end = end;
+  node.max_end = end;
+  node.id = id;
+  node.priority = this->next_priority();
+  node.left = -1;
+  node.right = -1;
+  return n;
+}
+
+void IntervalIndex::free_node(int32_t n) { this->_free_nodes.push_back(n); }
+
+void IntervalIndex::pull(int32_t n) {
+  Node &node = this->_nodes[n];
+  node.min_end = node.end;
+  node.max_end = node.end;
+  for (int32_t child : {node.left, node.right}) {
+    if (child < 0)
+      continue;
+    node.min_end = std::min(node.min_end, this->_nodes[child].min_end);
+    node.max_end = std::max(node.max_end, this->_nodes[child].max_end);
+  }
+}
+
+// l gets every key < (start, id), r the rest
+void IntervalIndex::split(int32_t n, const time_point &start, uint32_t id,
+                          int32_t &l, int32_t &r) {
+  if (n < 0) {
+    l = r = -1;
+    return;
+  }
+  if (this->less(start, id, this->_nodes[n])) {
+    this->split(this->_nodes[n].left, start, id, l, this->_nodes[n].left);
+    r = n;
+  } else {
+    this->split(this->_nodes[n].right, start, id, this->_nodes[n].right, r);
+    l = n;
+  }
+  this->pull(n);
+}
+
+int32_t IntervalIndex::merge(int32_t l, int32_t r) {
+  if (l < 0)
+    return r;
+  if (r < 0)
+    return l;
+  if (this->_nodes[l].priority > this->_nodes[r].priority) {
+    this->_nodes[l].right = this->merge(this->_nodes[l].right, r);
+    this->pull(l);
+    return l;
+  }
+  this->_nodes[r].left = this->merge(l, this->_nodes[r].left);
+  this->pull(r);
+  return r;
+}
+
+void IntervalIndex::insert(const time_point &start, const time_point &end,
+                           uint32_t id) {
+  int32_t n = this->allocate_node(start, end, id);
+  int32_t l, r;
+  this->split(this->_root, start, id, l, r);
+  this->_root = this->merge(this->merge(l, n), r);
+  ++this->_size;
+}
+
+int32_t IntervalIndex::erase_node(int32_t n, const time_point &start,
+                                  uint32_t id, bool &found) {
+  if (n < 0)
+    return n;
+  Node &node = this->_nodes[n];
+  if (node.start == start && node.id == id) {
+    found = true;
+    int32_t merged = this->merge(node.left, node.right);
+    this->free_node(n);
+    return merged;
+  }
+  if (this->less(start, id, node)) {
+    int32_t left = this->erase_node(node.left, start, id, found);
+    this->_nodes[n].left = left;
+  } else {
+    int32_t right = this->erase_node(node.right, start, id, found);
+    this->_nodes[n].right = right;
+  }
+  this->pull(n);
+  return n;
+}
+
+bool IntervalIndex::erase(const time_point &start, uint32_t id) {
+  bool found = false;
+  this->_root = this->erase_node(this->_root, start, id, found);
+  if (found)
+    --this->_size;
+  return found;
+}
+
+void IntervalIndex::clear() {
+  this->_nodes.clear();
+  this->_free_nodes.clear();
+  this->_root = -1;
+  this->_size = 0;
+}
+
+void IntervalIndex::reserve(size_t n) { this->_nodes.reserve(n); }
+
+void IntervalIndex::assign_sorted(std::span<const Entry> entries) {
+  this->clear();
+  this->_nodes.reserve(entries.size());
+  // right spine of the treap so far, each node the right child of the one
+  // below it. A node leaving it has its whole subtree, so it's pulled then.
+  std::vector<int32_t> spine;
+  for (const Entry &entry : entries) {
+    int32_t n = this->allocate_node(entry.start, entry.end, entry.id);
+    int32_t left = -1;
+    while (!spine.empty() &&
+           this->_nodes[spine.back()].priority < this->_nodes[n].priority) {
+      left = spine.back();
+      spine.pop_back();
+      this->pull(left);
+    }
+    this->_nodes[n].left = left;
+    if (!spine.empty())
+      this->_nodes[spine.back()].right = n;
+    spine.push_back(n);
+  }
+  for (auto it = spine.rbegin(); it != spine.rend(); ++it)
+    this->pull(*it);
+  this->_root = spine.empty() ? -1 : spine.front();
+  this->_size = entries.size();
+}
+
+std::vector<IntervalIndex::value_type>
+IntervalIndex::overlapping(const time_point &from, const time_point &to) const {
+  std::vector<value_type> out;
+  this->for_each_overlapping(
+      from, to, [&](value_type id) { out.push_back(id); });
+  return out;
+}
+
+void IntervalIndex::visit_ended_before(int32_t n, const time_point &time_p,
+                                       std::vector<value_type> &out) const {
+  if (n < 0)
+    return;
+  const Node &node = this->_nodes[n];
+  if (node.min_end >= time_p)
+    return;
+  this->visit_ended_before(node.left, time_p, out);
+  // start <= end, so nothing starting at or after time_p has ended before it
+  if (node.start >= time_p)
+    return;
+  if (node.end < time_p)
+    out.push_back(node.id);
+  this->visit_ended_before(node.right, time_p, out);
+}
+
+std::vector<IntervalIndex::value_type>
+IntervalIndex::ended_before(const time_point &time_p) const {
+  std::vector<value_type> out;
+  this->visit_ended_before(this->_root, time_p, out);
+  return out;
+}
+
+std::vector<IntervalIndex::value_type>
+IntervalIndex::starting_after(const time_point &time_p, size_t limit) const {
+  std::vector<value_type> out;
+  std::vector<int32_t> stack;
+
+  // seed the stack with the path to the first start > time_p
+  int32_t n = this->_root;
+  while (n >= 0) {
+    if (this->_nodes[n].start > time_p) {
+      stack.push_back(n);
+      n = this->_nodes[n].left;
+    } else {
+      n = this->_nodes[n].right;
+    }
+  }
+
+  while (!stack.empty() && out.size() < limit) {
+    n = stack.back();
+    stack.pop_back();
+    out.push_back(this->_nodes[n].id);
+    for (n = this->_nodes[n].right; n >= 0; n = this->_nodes[n].left)
+      stack.push_back(n);
+  }
+  return out;
+}
+
+} // namespace task_manager
@@ -0,0 +1,309 @@
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+namespace task_manager::metrics {
+
+namespace {
+
+struct CounterInfo {
+  std::string_view name; // Prometheus name, the summary drops the prefix
+  std::string_view help;
+};
+
+constexpr std::array<CounterInfo, counter_count> counter_info = {{
+    {"task_manager_db_errors_total", "Failed DB operations."},
+    {"task_manager_events_loaded_total", "Events loaded at startup."},
+    {"task_manager_transitions_total", "Events that started or ended."},
+    {"task_manager_write_behind_ops_total",
+     "Operations committed by the write-behind thread."},
+    {"task_manager_command_errors_total", "Commands that failed."},
+}};
+
+struct TimerInfo {
+  std::string_view name;
+  std::string_view label; // command="..." for the commands
+  std::string_view summary;
+  std::string_view help;
+};
+
+constexpr std::string_view command_help = "Time spent running a command.";
+
+// the timers of one metric family have to stay next to each other
+constexpr std::array<TimerInfo, timer_count> timer_info = {{
+    {"task_manager_db_transaction_seconds", "", "db transaction",
+     "Synchronous DB transactions."},
+    {"task_manager_write_behind_commit_seconds", "", "write-behind commit",
+     "Batches committed by the write-behind thread."},
+    {"task_manager_tick_seconds", "", "tick", "Calendar ticks."},
+    {"task_manager_refresh_ongoing_seconds", "", "refresh ongoing",
+     "Full classifications of the ongoing events."},
+    {"task_manager_classify_seconds", "", "classify",
+     "Past/ongoing/future counts."},
+    {"task_manager_load_seconds", "", "load", "Calendar loads."},
+    {"task_manager_command_seconds", "command=\"list\"", "list",
+     command_help},
+    {"task_manager_command_seconds", "command=\"query\"", "query",
+     command_help},
+    {"task_manager_command_seconds", "command=\"add\"", "add", command_help},
+    {"task_manager_command_seconds", "command=\"remove\"", "remove",
+     command_help},
+    {"task_manager_command_seconds", "command=\"update\"", "update",
+     command_help},
+    {"task_manager_command_seconds", "command=\"changes\"", "changes",
+     command_help},
+    {"task_manager_command_seconds", "command=\"stats\"", "stats",
+     command_help},
+    {"task_manager_command_seconds", "command=\"search\"", "search",
+     command_help},
+    {"task_manager_command_seconds", "command=\"other\"", "other commands",
+     command_help},
+}};
+
+// 1.2us, 3.4ms, 1.20s
+std::string format_ns(uint64_t ns) {
+  if (ns < 1000)
+    return std::format("{}ns", ns);
+  if (ns < 1000000)
+    return std::format("{:.1f}us", static_cast<double>(ns) / 1e3);
+  if (ns < 1000000000)
+    return std::format("{:.1f}ms", static_cast<double>(ns) / 1e6);
+  return std::format("{:.2f}s", static_cast<double>(ns) / 1e9);
+}
+
+#ifndef TASK_MANAGER_NO_METRICS
+
+// Owns every shard ever handed out. Leaked on purpose, threads may still
+// exit and release theirs after static destruction started.
+class Registry {
+public:
+  static Registry &instance() {
+    static Registry *registry = new Registry;
+    return *registry;
+  }
+
+  detail::Shard *acquire() {
+    std::lock_guard lock(this->_mutex);
+    if (!this->_free.empty()) {
+      detail::Shard *shard = this->_free.back();
+      this->_free.pop_back();
+      return shard;
+    }
+    this->_shards.push_back(std::make_unique<detail::Shard>());
+    return this->_shards.back().get();
+  }
+
+  void release(detail::Shard *shard) {
+    std::lock_guard lock(this->_mutex);
+    this->_free.push_back(shard);
+  }
+
+  Report collect() {
+    Report report;
+    std::lock_guard lock(this->_mutex);
+    for (const auto &shard : this->_shards) {
+      for (size_t c = 0; c < counter_count; ++c) {
+        report.counters[c] +=
+            shard->counters[c].load(std::memory_order_relaxed);
+      }
+      for (size_t t = 0; t < timer_count; ++t) {
+        const auto &cells = shard->timers[t];
+        Histogram &histogram = report.timers[t];
+        for (size_t b = 0; b < bucket_count; ++b) {
+          uint64_t n = cells.buckets[b].load(std::memory_order_relaxed);
+          histogram.buckets[b] += n;
+          histogram.count += n;
+        }
+        histogram.sum_ns += cells.sum_ns.load(std::memory_order_relaxed);
+        histogram.max_ns = std::max(
+            histogram.max_ns, cells.max_ns.load(std::memory_order_relaxed));
+      }
+    }
+    return report;
+  }
+
+private:
+  std::mutex _mutex;
+  std::vector<std::unique_ptr<detail::Shard>> _shards;
+  std::vector<detail::Shard *> _free;
+};
+
+struct ShardLease {
+  detail::Shard *shard = Registry::instance().acquire();
+  ~ShardLease() { Registry::instance().release(this->shard); }
+};
+
+#endif
+
+} // namespace
+
+#ifndef TASK_MANAGER_NO_METRICS
+
+detail::Shard &detail::local_shard() {
+  thread_local ShardLease lease;
+  return *lease.shard;
+}
+
+Report collect() { return Registry::instance().collect(); }
+
+#else
+
+Report collect() { return {}; }
+
+#endif
+
+uint64_t Histogram::quantile_ns(double q) const {
+  if (this->count == 0)
+    return 0;
+  auto rank = static_cast<uint64_t>(
+      std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(this->count)));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  for (size_t b = 0; b < bucket_count; ++b) {
+    seen += this->buckets[b];
+    if (seen >= rank)
+      return std::min(bucket_max(b), this->max_ns);
+  }
+  return this->max_ns;
+}
+
+void write_summary(std::ostream &out, const Report &report) {
+  if (!enabled) {
+    out << "Metrics were compiled out (TASK_MANAGER_METRICS=OFF).\n";
+    return;
+  }
+  out << "--- Counters ---\n";
+  for (size_t c = 0; c < counter_count; ++c) {
+    std::string_view name = counter_info[c].name;
+    name.remove_prefix(std::string_view("task_manager_").size());
+    name.remove_suffix(std::string_view("_total").size());
+    out << std::format("  {:<20}{}\n", name, report.counters[c]);
+  }
+  out << std::format("--- Latencies ---\n  {:<20}{:>8}{:>10}{:>10}{:>10}"
+                     "{:>10}{:>10}\n",
+                     "", "count", "mean", "p50", "p90", "p99", "max");
+  for (size_t t = 0; t < timer_count; ++t) {
+    const Histogram &histogram = report.timers[t];
+    if (histogram.count == 0)
+      continue;
+    out << std::format("  {:<20}{:>8}{:>10}{:>10}{:>10}{:>10}{:>10}\n",
+                       timer_info[t].summary, histogram.count,
+                       format_ns(histogram.sum_ns / histogram.count),
+                       format_ns(histogram.quantile_ns(0.5)),
+                       format_ns(histogram.quantile_ns(0.9)),
+                       format_ns(histogram.quantile_ns(0.99)),
+                       format_ns(histogram.max_ns));
+  }
+}
+
+void write_prometheus(std::ostream &out, const Report &report) {
+  for (size_t c = 0; c < counter_count; ++c) {
+    out << "# HELP " << counter_info[c].name << " " << counter_info[c].help
+        << "\n# TYPE " << counter_info[c].name << " counter\n"
+        << counter_info[c].name << " " << report.counters[c] << "\n";
+  }
+
+  for (size_t t = 0; t < timer_count; ++t) {
+    const TimerInfo &info = timer_info[t];
+    const Histogram &histogram = report.timers[t];
+    if (t == 0 || timer_info[t - 1].name != info.name) {
+      out << "# HELP " << info.name << " " << info.help << "\n# TYPE "
+          << info.name << " histogram\n";
+    }
+    std::string labels(info.label);
+    std::string sep = labels.empty() ? "" : ",";
+
+    // powers of 4 from ~1us to ~69s, they line up with bucket boundaries
+    size_t b = 0;
+    uint64_t cumulative = 0;
+    for (unsigned shift = 10; shift <= 36; shift += 2) {
+      uint64_t le_ns = uint64_t{1} << shift;
+      while (b < bucket_count && bucket_max(b) < le_ns)
+        cumulative += histogram.buckets[b++];
+      out << std::format("{}_bucket{{{}{}le=\"{:.9g}\"}} {}\n", info.name,
+                         labels, sep, static_cast<double>(le_ns) / 1e9,
+                         cumulative);
+    }
+    out << std::format("{}_bucket{{{}{}le=\"+Inf\"}} {}\n", info.name,
+                       labels, sep, histogram.count);
+    std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    out << std::format("{}_sum{} {:.9f}\n{}_count{} {}\n", info.name, braces,
+                       static_cast<double>(histogram.sum_ns) / 1e9, info.name,
+                       braces, histogram.count);
+  }
+}
+
+bool dump_prometheus(const std::string &path) {
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::trunc);
+    if (!out) {
+      std::cerr << "Error opening " << tmp_path << " for the metrics"
+                << std::endl;
+      return false;
+    }
+    write_prometheus(out, collect());
+    if (!out.flush()) {
+      std::cerr << "Error writing metrics to " << tmp_path << std::endl;
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::cerr << "Error replacing " << path << ": " << ec.message()
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+PrometheusFileExporter::PrometheusFileExporter(std::string path,
+                                               std::chrono::seconds interval)
+    : _path(std::move(path)), _interval(interval) {
+  this->_thread = std::thread([this]() { this->run(); });
+}
+
+PrometheusFileExporter::~PrometheusFileExporter() {
+  {
+    std::lock_guard lock(this->_mutex);
+    this->_stop = true;
+  }
+  this->_wake.notify_one();
+  if (this->_thread.joinable())
+    this->_thread.join();
+}
+
+std::unique_ptr<PrometheusFileExporter> PrometheusFileExporter::from_env() {
+  const char *path = std::getenv("TASK_MANAGER_METRICS_FILE");
+  if (!enabled || path == nullptr || *path == '\0')
+    return nullptr;
+  std::chrono::seconds interval(15);
+  if (const char *seconds = std::getenv("TASK_MANAGER_METRICS_INTERVAL"))
+    interval = std::chrono::seconds(std::max(1, std::atoi(seconds)));
+  return std::make_unique<PrometheusFileExporter>(path, interval);
+}
+
+void PrometheusFileExporter::run() {
+  trace::name_thread("metrics exporter");
+  std::unique_lock lock(this->_mutex);
+  while (true) {
+    bool stopping = this->_wake.wait_for(lock, this->_interval,
+                                         [this]() { return this->_stop; });
+    lock.unlock();
+    dump_prometheus(this->_path);
+    if (stopping)
+      return;
+    lock.lock();
+  }
+}
+
+} // namespace task_manager::metrics
@@ -0,0 +1,143 @@
+#include "parallel_load.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <sqlite3.h>
+#include <thread>
+
+namespace task_manager {
+
+namespace {
+
+// below this many ids per slice another thread costs more than it saves
+constexpr int64_t min_ids_per_thread = 64 * 1024;
+
+// Read-only connection with one prepared statement, closed on scope exit
+class Reader {
+public:
+  explicit Reader(const std::string &db_path) {
+    // each worker owns its connection, SQLite's own locking is not needed
+    int rc = sqlite3_open_v2(db_path.c_str(), &this->_db,
+                             SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                             nullptr);
+    if (rc != SQLITE_OK)
+      this->fail("opening " + db_path);
+  }
+  ~Reader() {
+    sqlite3_finalize(this->_statement);
+    sqlite3_close(this->_db);
+  }
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  bool prepare(const char *sql) {
+    if (this->_ok && sqlite3_prepare_v3(this->_db, sql, -1, 0,
+                                        &this->_statement,
+                                        nullptr) != SQLITE_OK)
+      this->fail("preparing the load");
+    return this->_ok;
+  }
+  inline sqlite3_stmt *statement() { return this->_statement; }
+
+  void fail(const std::string &what) {
+    std::cerr << "Error " << what << ": "
+              << (this->_db ? sqlite3_errmsg(this->_db) : "out of memory")
+              << std::endl;
+    this->_ok = false;
+  }
+
+private:
+  sqlite3 *_db = nullptr;
+  sqlite3_stmt *_statement = nullptr;
+  bool _ok = true;
+};
+
+bool read_chunk(const std::string &db_path, int64_t first_id,
+                int64_t last_id, int64_t min_end_us, EventChunk &chunk) {
+  trace::Span span("read chunk", "sqlite");
+  Reader reader(db_path);
+  // id is the rowid, the range is a seek plus a scan of the table b-tree
+  if (!reader.prepare("SELECT id, name, description, start, \"end\", "
+                      "ongoing FROM events WHERE id BETWEEN ?1 AND ?2 "
+                      "AND \"end\" >= ?3 ORDER BY id"))
+    return false;
+  sqlite3_stmt *statement = reader.statement();
+  sqlite3_bind_int64(statement, 1, first_id);
+  sqlite3_bind_int64(statement, 2, last_id);
+  sqlite3_bind_int64(statement, 3, min_end_us);
+
+  auto append_text = [&](int column) {
+    auto text = reinterpret_cast<const char *>(
+        sqlite3_column_text(statement, column));
+    int bytes = sqlite3_column_bytes(statement, column);
+    if (text != nullptr)
+      chunk.text.append(text, static_cast<size_t>(bytes));
+    chunk.text_ends.push_back(static_cast<uint32_t>(chunk.text.size()));
+  };
+
+  int rc;
+  while ((rc = sqlite3_step(statement)) == SQLITE_ROW) {
+    chunk.ids.push_back(
+        static_cast<uint32_t>(sqlite3_column_int64(statement, 0)));
+    append_text(1);
+    append_text(2);
+    chunk.starts.push_back(sqlite3_column_int64(statement, 3));
+    chunk.ends.push_back(sqlite3_column_int64(statement, 4));
+    chunk.ongoing.push_back(sqlite3_column_int(statement, 5) != 0);
+  }
+  if (rc != SQLITE_DONE) {
+    reader.fail("reading events");
+    return false;
+  }
+  span.set_arg(chunk.size());
+  return true;
+}
+
+} // namespace
+
+std::optional<std::vector<EventChunk>>
+read_events_parallel(const std::string &db_path, int64_t min_end_us,
+                     unsigned threads) {
+  int64_t min_id, max_id;
+  {
+    Reader reader(db_path);
+    if (!reader.prepare("SELECT min(id), max(id) FROM events"))
+      return std::nullopt;
+    if (sqlite3_step(reader.statement()) != SQLITE_ROW) {
+      reader.fail("reading the id range");
+      return std::nullopt;
+    }
+    // an empty table
+    if (sqlite3_column_type(reader.statement(), 0) == SQLITE_NULL)
+      return std::vector<EventChunk>();
+    min_id = sqlite3_column_int64(reader.statement(), 0);
+    max_id = sqlite3_column_int64(reader.statement(), 1);
+  }
+
+  int64_t id_count = max_id - min_id + 1;
+  int64_t slices = std::clamp<int64_t>(id_count / min_ids_per_thread, 1,
+                                       std::max(threads, 1u));
+  int64_t step = (id_count + slices - 1) / slices;
+  std::vector<EventChunk> chunks(
+      static_cast<size_t>((id_count + step - 1) / step));
+  std::atomic<bool> ok{true};
+  std::vector<std::thread> workers;
+  workers.reserve(chunks.size());
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    int64_t first = min_id + static_cast<int64_t>(i) * step;
+    int64_t last = std::min(max_id, first + step - 1);
+    workers.emplace_back([&, i, first, last]() {
+      trace::name_thread("load worker");
+      if (!read_chunk(db_path, first, last, min_end_us, chunks[i]))
+        ok.store(false, std::memory_order_relaxed);
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  if (!ok.load(std::memory_order_relaxed))
+    return std::nullopt;
+  return chunks;
+}
+
+} // namespace task_manager
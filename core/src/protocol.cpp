@@ -0,0 +1,97 @@
+#include "protocol.hpp"
+#include <algorithm>
+
+namespace task_manager::protocol {
+
+namespace {
+void append_header(std::string &buffer, uint32_t size) {
+  for (int i = 0; i < 4; ++i)
+    buffer.push_back(static_cast<char>((size >> (8 * i)) & 0xFF));
+}
+} // namespace
+
+void append_frame(std::string &buffer, std::string_view payload) {
+  buffer.reserve(buffer.size() + header_size + payload.size());
+  append_header(buffer, static_cast<uint32_t>(payload.size()));
+  buffer.append(payload);
+}
+
+FrameStatus next_frame(std::string_view input, std::string_view &payload,
+                       size_t &consumed) {
+  if (input.size() < header_size)
+    return FrameStatus::Incomplete;
+  uint32_t size = 0;
+  for (int i = 0; i < 4; ++i)
+    size |= static_cast<uint32_t>(static_cast<uint8_t>(input[i])) << (8 * i);
+  if (size > max_payload)
+    return FrameStatus::Invalid;
+  if (input.size() - header_size < size)
+    return FrameStatus::Incomplete;
+  payload = input.substr(header_size, size);
+  consumed = header_size + size;
+  return FrameStatus::Complete;
+}
+
+ReplyWriter::ReplyWriter(std::string &buffer, size_t frame_size)
+    : _buffer(buffer),
+      _frame_size(std::clamp<size_t>(frame_size, 1, max_payload - 1)) {}
+
+std::streamsize ReplyWriter::xsputn(const char *data, std::streamsize size) {
+  std::string_view rest(data, static_cast<size_t>(size));
+  while (!rest.empty()) {
+    if (this->_frame_start == no_frame)
+      this->open_frame();
+    size_t used = this->_buffer.size() - this->_frame_start - header_size - 1;
+    std::string_view part = rest.substr(0, this->_frame_size - used);
+    this->_buffer.append(part);
+    rest.remove_prefix(part.size());
+    if (used + part.size() == this->_frame_size)
+      this->seal(static_cast<uint8_t>(CommandStatus::Ok) | continued);
+  }
+  return size;
+}
+
+ReplyWriter::int_type ReplyWriter::overflow(int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  char ch = traits_type::to_char_type(c);
+  this->xsputn(&ch, 1);
+  return c;
+}
+
+void ReplyWriter::finish(CommandStatus status) {
+  if (this->_frame_start == no_frame)
+    this->open_frame();
+  this->seal(static_cast<uint8_t>(status));
+}
+
+// header and status byte are filled in by seal()
+void ReplyWriter::open_frame() {
+  this->_frame_start = this->_buffer.size();
+  this->_buffer.append(header_size + 1, '\0');
+}
+
+void ReplyWriter::seal(uint8_t status_byte) {
+  auto size =
+      static_cast<uint32_t>(this->_buffer.size() - this->_frame_start -
+                            header_size);
+  for (size_t i = 0; i < header_size; ++i)
+    this->_buffer[this->_frame_start + i] =
+        static_cast<char>((size >> (8 * i)) & 0xFF);
+  this->_buffer[this->_frame_start + header_size] =
+      static_cast<char>(status_byte);
+  this->_frame_start = no_frame;
+}
+
+std::optional<ReplyFrame> decode_reply(std::string_view payload) {
+  if (payload.empty())
+    return std::nullopt;
+  auto byte = static_cast<uint8_t>(payload[0]);
+  auto status = static_cast<uint8_t>(byte & ~continued);
+  if (status > static_cast<uint8_t>(CommandStatus::Exit))
+    return std::nullopt;
+  return ReplyFrame{static_cast<CommandStatus>(status),
+                    (byte & continued) == 0, payload.substr(1)};
+}
+
+} // namespace task_manager::protocol
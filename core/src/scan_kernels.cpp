@@ -0,0 +1,263 @@
+#include "scan_kernels.hpp"
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TASK_MANAGER_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace task_manager::scan {
+
+namespace {
+
+// The scalar versions double as the tail loop of the vector ones, hence
+// the `begin` argument.
+
+size_t count_scalar(const int64_t *starts, const int64_t *ends, size_t begin,
+                    size_t n, int64_t from, int64_t to) {
+  size_t count = 0;
+  for (size_t i = begin; i < n; ++i) {
+    count += (starts[i] <= to) & (ends[i] >= from);
+  }
+  return count;
+}
+
+void select_scalar(const int64_t *starts, const int64_t *ends, size_t begin,
+                   size_t n, int64_t from, int64_t to,
+                   std::vector<uint32_t> &out) {
+  for (size_t i = begin; i < n; ++i) {
+    if (starts[i] <= to && ends[i] >= from)
+      out.push_back(static_cast<uint32_t>(i));
+  }
+}
+
+StateCounts classify_scalar(const int64_t *starts, const int64_t *ends,
+                            size_t begin, size_t n, int64_t now,
+                            EventState *states, StateCounts counts) {
+  for (size_t i = begin; i < n; ++i) {
+    // a malformed event with end < start counts as future, in every kernel
+    EventState state = starts[i] > now ? EventState::Future
+                       : ends[i] < now ? EventState::Past
+                                       : EventState::Ongoing;
+    if (states != nullptr)
+      states[i] = state;
+    counts.past += state == EventState::Past;
+    counts.ongoing += state == EventState::Ongoing;
+    counts.future += state == EventState::Future;
+  }
+  return counts;
+}
+
+#ifdef TASK_MANAGER_SCAN_X86
+
+// (future mask << 4 | past mask) of four lanes -> their four state bytes
+constexpr std::array<uint32_t, 256> make_state_lut() {
+  std::array<uint32_t, 256> lut{};
+  for (unsigned m = 0; m < 256; ++m) {
+    uint32_t bytes = 0;
+    for (unsigned k = 0; k < 4; ++k) {
+      EventState state = (m >> (4 + k)) & 1 ? EventState::Future
+                         : (m >> k) & 1     ? EventState::Past
+                                            : EventState::Ongoing;
+      bytes |= static_cast<uint32_t>(state) << (8 * k);
+    }
+    lut[m] = bytes;
+  }
+  return lut;
+}
+constexpr auto state_lut = make_state_lut();
+
+inline void store_states(EventState *states, unsigned past, unsigned future) {
+  uint32_t bytes = state_lut[(future << 4) | past];
+  std::memcpy(states, &bytes, sizeof(bytes));
+}
+
+__attribute__((target("avx2,popcnt"))) size_t
+count_avx2(const int64_t *starts, const int64_t *ends, size_t n, int64_t from,
+           int64_t to) {
+  const __m256i vfrom = _mm256_set1_epi64x(from);
+  const __m256i vto = _mm256_set1_epi64x(to);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i s =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(starts + i));
+    __m256i e =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ends + i));
+    // only signed greater-than exists, so count the misses instead
+    __m256i miss = _mm256_or_si256(_mm256_cmpgt_epi64(s, vto),
+                                   _mm256_cmpgt_epi64(vfrom, e));
+    unsigned mask = _mm256_movemask_pd(_mm256_castsi256_pd(miss));
+    count += 4 - std::popcount(mask);
+  }
+  return count + count_scalar(starts, ends, i, n, from, to);
+}
+
+__attribute__((target("avx2,popcnt"))) void
+select_avx2(const int64_t *starts, const int64_t *ends, size_t n, int64_t from,
+            int64_t to, std::vector<uint32_t> &out) {
+  const __m256i vfrom = _mm256_set1_epi64x(from);
+  const __m256i vto = _mm256_set1_epi64x(to);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i s =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(starts + i));
+    __m256i e =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ends + i));
+    __m256i miss = _mm256_or_si256(_mm256_cmpgt_epi64(s, vto),
+                                   _mm256_cmpgt_epi64(vfrom, e));
+    unsigned hit = ~_mm256_movemask_pd(_mm256_castsi256_pd(miss)) & 0xFu;
+    while (hit != 0) {
+      out.push_back(static_cast<uint32_t>(i + std::countr_zero(hit)));
+      hit &= hit - 1;
+    }
+  }
+  select_scalar(starts, ends, i, n, from, to, out);
+}
+
+__attribute__((target("avx2,popcnt"))) StateCounts
+classify_avx2(const int64_t *starts, const int64_t *ends, size_t n,
+              int64_t now, EventState *states) {
+  const __m256i vnow = _mm256_set1_epi64x(now);
+  StateCounts counts;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i s =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(starts + i));
+    __m256i e =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ends + i));
+    unsigned future = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpgt_epi64(s, vnow)));
+    unsigned past =
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vnow, e))) &
+        ~future;
+    counts.future += std::popcount(future);
+    counts.past += std::popcount(past);
+    counts.ongoing += 4 - std::popcount(future | past);
+    if (states != nullptr)
+      store_states(states + i, past, future);
+  }
+  return classify_scalar(starts, ends, i, n, now, states, counts);
+}
+
+__attribute__((target("avx512f,popcnt"))) size_t
+count_avx512(const int64_t *starts, const int64_t *ends, size_t n,
+             int64_t from, int64_t to) {
+  const __m512i vfrom = _mm512_set1_epi64(from);
+  const __m512i vto = _mm512_set1_epi64(to);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i s = _mm512_loadu_si512(starts + i);
+    __m512i e = _mm512_loadu_si512(ends + i);
+    __mmask8 hit =
+        _mm512_mask_cmpge_epi64_mask(_mm512_cmple_epi64_mask(s, vto), e, vfrom);
+    count += std::popcount(static_cast<unsigned>(hit));
+  }
+  return count + count_scalar(starts, ends, i, n, from, to);
+}
+
+__attribute__((target("avx512f,popcnt"))) void
+select_avx512(const int64_t *starts, const int64_t *ends, size_t n,
+              int64_t from, int64_t to, std::vector<uint32_t> &out) {
+  const __m512i vfrom = _mm512_set1_epi64(from);
+  const __m512i vto = _mm512_set1_epi64(to);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i s = _mm512_loadu_si512(starts + i);
+    __m512i e = _mm512_loadu_si512(ends + i);
+    unsigned hit = _mm512_mask_cmpge_epi64_mask(
+        _mm512_cmple_epi64_mask(s, vto), e, vfrom);
+    while (hit != 0) {
+      out.push_back(static_cast<uint32_t>(i + std::countr_zero(hit)));
+      hit &= hit - 1;
+    }
+  }
+  select_scalar(starts, ends, i, n, from, to, out);
+}
+
+__attribute__((target("avx512f,popcnt"))) StateCounts
+classify_avx512(const int64_t *starts, const int64_t *ends, size_t n,
+                int64_t now, EventState *states) {
+  const __m512i vnow = _mm512_set1_epi64(now);
+  StateCounts counts;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i s = _mm512_loadu_si512(starts + i);
+    __m512i e = _mm512_loadu_si512(ends + i);
+    unsigned future = _mm512_cmpgt_epi64_mask(s, vnow);
+    unsigned past = _mm512_cmplt_epi64_mask(e, vnow) & ~future;
+    counts.future += std::popcount(future);
+    counts.past += std::popcount(past);
+    counts.ongoing += 8 - std::popcount(future | past);
+    if (states != nullptr) {
+      store_states(states + i, past & 0xFu, future & 0xFu);
+      store_states(states + i + 4, past >> 4, future >> 4);
+    }
+  }
+  return classify_scalar(starts, ends, i, n, now, states, counts);
+}
+
+#endif // TASK_MANAGER_SCAN_X86
+
+struct Kernels {
+  size_t (*count)(const int64_t *, const int64_t *, size_t, int64_t, int64_t);
+  void (*select)(const int64_t *, const int64_t *, size_t, int64_t, int64_t,
+                 std::vector<uint32_t> &);
+  StateCounts (*classify)(const int64_t *, const int64_t *, size_t, int64_t,
+                          EventState *);
+  const char *name;
+};
+
+const Kernels &kernels() {
+  // resolved once, the CPU doesn't change under us
+  static const Kernels selected = [] {
+#ifdef TASK_MANAGER_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      return Kernels{count_avx512, select_avx512, classify_avx512, "avx512"};
+    if (__builtin_cpu_supports("avx2"))
+      return Kernels{count_avx2, select_avx2, classify_avx2, "avx2"};
+#endif
+    return Kernels{
+        [](const int64_t *starts, const int64_t *ends, size_t n, int64_t from,
+           int64_t to) { return count_scalar(starts, ends, 0, n, from, to); },
+        [](const int64_t *starts, const int64_t *ends, size_t n, int64_t from,
+           int64_t to, std::vector<uint32_t> &out) {
+          select_scalar(starts, ends, 0, n, from, to, out);
+        },
+        [](const int64_t *starts, const int64_t *ends, size_t n, int64_t now,
+           EventState *states) {
+          return classify_scalar(starts, ends, 0, n, now, states, {});
+        },
+        "scalar"};
+  }();
+  return selected;
+}
+
+} // namespace
+
+size_t count_overlapping(std::span<const int64_t> starts,
+                         std::span<const int64_t> ends, int64_t from,
+                         int64_t to) {
+  return kernels().count(starts.data(), ends.data(), starts.size(), from, to);
+}
+
+void select_overlapping(std::span<const int64_t> starts,
+                        std::span<const int64_t> ends, int64_t from,
+                        int64_t to, std::vector<uint32_t> &out) {
+  kernels().select(starts.data(), ends.data(), starts.size(), from, to, out);
+}
+
+StateCounts classify(std::span<const int64_t> starts,
+                     std::span<const int64_t> ends, int64_t now,
+                     std::span<EventState> states) {
+  return kernels().classify(starts.data(), ends.data(), starts.size(), now,
+                            states.empty() ? nullptr : states.data());
+}
+
+const char *kernel_name() { return kernels().name; }
+
+} // namespace task_manager::scan
@@ -0,0 +1,260 @@
+#include "snapshot.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace task_manager {
+
+namespace {
+constexpr char snapshot_magic[8] = {'T', 'M', 'S', 'N', 'A', 'P', '\0', '\0'};
+
+size_t align8(size_t n) { return (n + 7) & ~size_t{7}; }
+} // namespace
+
+struct Snapshot::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t user_version;
+  int64_t db_size, db_mtime_ns;
+  int64_t wal_size, wal_mtime_ns;
+  int64_t window_start_us;
+  uint32_t has_window;
+  uint32_t next_id;
+  uint64_t count;
+  uint64_t blob_size;
+};
+
+SnapshotStamp make_snapshot_stamp(const std::string &db_path,
+                                  uint32_t user_version) {
+  SnapshotStamp stamp;
+  stamp.user_version = user_version;
+
+  struct stat st;
+  if (::stat(db_path.c_str(), &st) == 0) {
+    stamp.db_size = st.st_size;
+    stamp.db_mtime_ns =
+        st.st_mtim.tv_sec * 1'000'000'000LL + st.st_mtim.tv_nsec;
+  }
+  // an empty log is no log: the last connection deletes it on close, and
+  // the first one recreates it
+  std::string wal_path = db_path + "-wal";
+  if (::stat(wal_path.c_str(), &st) == 0 && st.st_size > 0) {
+    stamp.wal_size = st.st_size;
+    stamp.wal_mtime_ns =
+        st.st_mtim.tv_sec * 1'000'000'000LL + st.st_mtim.tv_nsec;
+  }
+  return stamp;
+}
+
+Snapshot::Snapshot(void *data, size_t length) : _data(data), _length(length) {}
+
+Snapshot::~Snapshot() {
+  if (this->_data != nullptr)
+    ::munmap(this->_data, this->_length);
+}
+
+Snapshot::Snapshot(Snapshot &&other) noexcept
+    : _data(other._data), _length(other._length), _columns(other._columns) {
+  other._data = nullptr;
+  other._length = 0;
+}
+
+Snapshot &Snapshot::operator=(Snapshot &&other) noexcept {
+  if (this != &other) {
+    if (this->_data != nullptr)
+      ::munmap(this->_data, this->_length);
+    this->_data = other._data;
+    this->_length = other._length;
+    this->_columns = other._columns;
+    other._data = nullptr;
+    other._length = 0;
+  }
+  return *this;
+}
+
+std::optional<Snapshot> Snapshot::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::nullopt;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    ::close(fd);
+    return std::nullopt;
+  }
+  size_t length = static_cast<size_t>(st.st_size);
+  void *data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return std::nullopt;
+
+  Snapshot snapshot(data, length);
+  const Header &header = snapshot.header();
+  if (std::memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0 ||
+      header.version != version)
+    return std::nullopt;
+
+  // bounds check before handing out any pointer into the mapping
+  uint64_t n = header.count;
+  size_t offset = sizeof(Header);
+  size_t needed = offset + align8(n * sizeof(int64_t)) * 2 +
+                  align8(n * sizeof(uint32_t)) * 5 + align8(n) +
+                  header.blob_size;
+  if (n > length || needed > length)
+    return std::nullopt;
+
+  auto *base = static_cast<const char *>(data);
+  auto take = [&](size_t bytes) {
+    const char *p = base + offset;
+    offset += align8(bytes);
+    return p;
+  };
+  Columns &columns = snapshot._columns;
+  columns.starts = reinterpret_cast<const int64_t *>(take(n * 8));
+  columns.ends = reinterpret_cast<const int64_t *>(take(n * 8));
+  columns.ids = reinterpret_cast<const uint32_t *>(take(n * 4));
+  columns.name_off = reinterpret_cast<const uint32_t *>(take(n * 4));
+  columns.name_len = reinterpret_cast<const uint32_t *>(take(n * 4));
+  columns.desc_off = reinterpret_cast<const uint32_t *>(take(n * 4));
+  columns.desc_len = reinterpret_cast<const uint32_t *>(take(n * 4));
+  columns.flags = reinterpret_cast<const uint8_t *>(take(n));
+  columns.blob = take(header.blob_size);
+
+  for (size_t i = 0; i < n; ++i) {
+    if (uint64_t{columns.name_off[i]} + columns.name_len[i] >
+            header.blob_size ||
+        uint64_t{columns.desc_off[i]} + columns.desc_len[i] >
+            header.blob_size)
+      return std::nullopt;
+  }
+  return snapshot;
+}
+
+bool Snapshot::write(const std::string &path, const SnapshotStamp &stamp,
+                     std::optional<int64_t> window_start_us, uint32_t next_id,
+                     const EventStore &events) {
+  std::string tmp_path = path + ".tmp";
+  try {
+    size_t n = events.size();
+    Header header{};
+    std::memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+    header.version = version;
+    header.user_version = stamp.user_version;
+    header.db_size = stamp.db_size;
+    header.db_mtime_ns = stamp.db_mtime_ns;
+    header.wal_size = stamp.wal_size;
+    header.wal_mtime_ns = stamp.wal_mtime_ns;
+    header.has_window = window_start_us.has_value();
+    header.window_start_us = window_start_us.value_or(0);
+    header.next_id = next_id;
+    header.count = n;
+
+    // the time, id and flag columns go out as they are, only the strings
+    // are repacked into one blob without the store's garbage
+    std::vector<uint32_t> name_off(n), name_len(n), desc_off(n), desc_len(n);
+    std::string blob;
+    for (uint32_t i = 0; i < n; ++i) {
+      name_off[i] = static_cast<uint32_t>(blob.size());
+      name_len[i] = static_cast<uint32_t>(events.name(i).size());
+      blob += events.name(i);
+      desc_off[i] = static_cast<uint32_t>(blob.size());
+      desc_len[i] = static_cast<uint32_t>(events.description(i).size());
+      blob += events.description(i);
+    }
+    if (blob.size() > UINT32_MAX)
+      return false;
+    header.blob_size = blob.size();
+
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    auto put = [&](const void *data, size_t bytes) {
+      static const char padding[8] = {};
+      out.write(static_cast<const char *>(data),
+                static_cast<std::streamsize>(bytes));
+      out.write(padding, static_cast<std::streamsize>(align8(bytes) - bytes));
+    };
+    put(&header, sizeof(header));
+    put(events.starts().data(), n * 8);
+    put(events.ends().data(), n * 8);
+    put(events.ids().data(), n * 4);
+    put(name_off.data(), n * 4);
+    put(name_len.data(), n * 4);
+    put(desc_off.data(), n * 4);
+    put(desc_len.data(), n * 4);
+    put(events.flag_column().data(), n);
+    put(blob.data(), blob.size());
+    out.close();
+    if (!out)
+      return false;
+
+    std::filesystem::rename(tmp_path, path);
+    return true;
+  } catch (const std::exception &e) {
+    std::cerr << "Error writing snapshot: " << e.what() << std::endl;
+    std::error_code ec;
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+}
+
+const Snapshot::Header &Snapshot::header() const {
+  return *static_cast<const Header *>(this->_data);
+}
+
+SnapshotStamp Snapshot::stamp() const {
+  const Header &header = this->header();
+  SnapshotStamp stamp;
+  stamp.user_version = header.user_version;
+  stamp.db_size = header.db_size;
+  stamp.db_mtime_ns = header.db_mtime_ns;
+  stamp.wal_size = header.wal_size;
+  stamp.wal_mtime_ns = header.wal_mtime_ns;
+  return stamp;
+}
+
+std::optional<int64_t> Snapshot::window_start_us() const {
+  if (!this->header().has_window)
+    return std::nullopt;
+  return this->header().window_start_us;
+}
+
+uint32_t Snapshot::next_id() const { return this->header().next_id; }
+
+size_t Snapshot::size() const {
+  return static_cast<size_t>(this->header().count);
+}
+
+std::span<const int64_t> Snapshot::starts() const {
+  return {this->_columns.starts, this->size()};
+}
+
+std::span<const int64_t> Snapshot::ends() const {
+  return {this->_columns.ends, this->size()};
+}
+
+std::span<const uint32_t> Snapshot::ids() const {
+  return {this->_columns.ids, this->size()};
+}
+
+std::span<const uint8_t> Snapshot::flags() const {
+  return {this->_columns.flags, this->size()};
+}
+
+std::string_view Snapshot::name(size_t i) const {
+  return {this->_columns.blob + this->_columns.name_off[i],
+          this->_columns.name_len[i]};
+}
+
+std::string_view Snapshot::description(size_t i) const {
+  return {this->_columns.blob + this->_columns.desc_off[i],
+          this->_columns.desc_len[i]};
+}
+
+} // namespace task_manager
@@ -0,0 +1,216 @@
+#include "text_index.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace task_manager {
+
+namespace {
+
+constexpr double bm25_k1 = 1.2;
+constexpr double bm25_b = 0.75;
+
+inline bool is_word_byte(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+// Calls fn(word) for every word of `text`, lowercased into `buffer`
+template <typename Fn>
+void for_each_word(std::string_view text, std::string &buffer, Fn &&fn) {
+  size_t i = 0;
+  while (i < text.size()) {
+    while (i < text.size() && !is_word_byte(text[i]))
+      ++i;
+    size_t begin = i;
+    while (i < text.size() && is_word_byte(text[i]))
+      ++i;
+    if (begin == i)
+      break;
+    buffer.assign(text.data() + begin, i - begin);
+    for (char &c : buffer) {
+      if (c >= 'A' && c <= 'Z')
+        c = static_cast<char>(c - 'A' + 'a');
+    }
+    fn(std::string_view(buffer));
+  }
+}
+
+// First position at or after `from` whose id is >= `id`
+template <typename Posting>
+size_t gallop(const std::vector<Posting> &list, size_t from, uint32_t id) {
+  // lists of similar length advance a few entries at a time
+  for (size_t end = std::min(from + 8, list.size()); from < end; ++from) {
+    if (list[from].id >= id)
+      return from;
+  }
+  size_t step = 1;
+  size_t hi = from;
+  while (hi < list.size() && list[hi].id < id) {
+    from = hi + 1;
+    hi += step;
+    step *= 2;
+  }
+  auto end = list.begin() + static_cast<ptrdiff_t>(std::min(hi, list.size()));
+  return static_cast<size_t>(
+      std::lower_bound(list.begin() + static_cast<ptrdiff_t>(from), end, id,
+                       [](const Posting &p, uint32_t v) { return p.id < v; }) -
+      list.begin());
+}
+
+} // namespace
+
+uint32_t TextIndex::intern(std::string_view word) {
+  auto it = this->_words.find(word);
+  if (it != this->_words.end())
+    return it->second;
+  auto id = static_cast<uint32_t>(this->_postings.size());
+  this->_words.emplace(std::string(word), id);
+  this->_postings.emplace_back();
+  return id;
+}
+
+void TextIndex::add(uint32_t id, std::string_view name,
+                    std::string_view description) {
+  this->remove(id);
+
+  // (word, in description) pairs, sorted into counts below
+  std::vector<std::pair<uint32_t, bool>> seen;
+  std::string buffer;
+  for_each_word(name, buffer, [&](std::string_view word) {
+    seen.emplace_back(this->intern(word), false);
+  });
+  size_t name_words = seen.size();
+  for_each_word(description, buffer, [&](std::string_view word) {
+    seen.emplace_back(this->intern(word), true);
+  });
+  auto length = static_cast<uint32_t>(name_words * name_weight +
+                                      (seen.size() - name_words));
+  std::sort(seen.begin(), seen.end());
+
+  std::vector<uint32_t> words;
+  for (size_t i = 0; i < seen.size();) {
+    uint32_t word = seen[i].first;
+    Posting posting{id, 0, 0,
+                    static_cast<uint16_t>(std::min<uint32_t>(length,
+                                                             UINT16_MAX))};
+    for (; i < seen.size() && seen[i].first == word; ++i) {
+      uint8_t &tf = seen[i].second ? posting.description_tf : posting.name_tf;
+      if (tf < UINT8_MAX)
+        ++tf;
+    }
+    auto &list = this->_postings[word];
+    // ids grow, new events land at the end
+    if (list.empty() || list.back().id < id) {
+      list.push_back(posting);
+    } else {
+      list.insert(list.begin() + static_cast<ptrdiff_t>(gallop(list, 0, id)),
+                  posting);
+    }
+    words.push_back(word);
+  }
+
+  this->_doc_slots.set(id, static_cast<uint32_t>(this->_doc_ids.size()));
+  this->_doc_ids.push_back(id);
+  this->_doc_lengths.push_back(length);
+  this->_doc_words.push_back(std::move(words));
+  this->_total_length += length;
+}
+
+void TextIndex::remove(uint32_t id) {
+  uint32_t slot = this->_doc_slots.find(id);
+  if (slot == FlatIdMap::npos)
+    return;
+  for (uint32_t word : this->_doc_words[slot]) {
+    auto &list = this->_postings[word];
+    size_t pos = gallop(list, 0, id);
+    if (pos < list.size() && list[pos].id == id)
+      list.erase(list.begin() + static_cast<ptrdiff_t>(pos));
+  }
+  this->_total_length -= this->_doc_lengths[slot];
+
+  auto last = static_cast<uint32_t>(this->_doc_ids.size() - 1);
+  if (slot != last) {
+    this->_doc_ids[slot] = this->_doc_ids[last];
+    this->_doc_lengths[slot] = this->_doc_lengths[last];
+    this->_doc_words[slot] = std::move(this->_doc_words[last]);
+    this->_doc_slots.set(this->_doc_ids[slot], slot);
+  }
+  this->_doc_ids.pop_back();
+  this->_doc_lengths.pop_back();
+  this->_doc_words.pop_back();
+  this->_doc_slots.erase(id);
+}
+
+void TextIndex::clear() {
+  this->_words.clear();
+  this->_postings.clear();
+  this->_doc_slots.clear();
+  this->_doc_ids.clear();
+  this->_doc_lengths.clear();
+  this->_doc_words.clear();
+  this->_total_length = 0;
+}
+
+std::vector<TextIndex::Match> TextIndex::search(std::string_view query) const {
+  std::vector<const std::vector<Posting> *> lists;
+  std::string buffer;
+  bool missing = false;
+  for_each_word(query, buffer, [&](std::string_view word) {
+    auto it = this->_words.find(word);
+    if (it == this->_words.end() || this->_postings[it->second].empty())
+      missing = true;
+    else
+      lists.push_back(&this->_postings[it->second]);
+  });
+  if (missing || lists.empty())
+    return {};
+  std::sort(lists.begin(), lists.end(), [](const auto *a, const auto *b) {
+    return a->size() < b->size() || (a->size() == b->size() && a < b);
+  });
+  lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+  double docs = static_cast<double>(this->_doc_ids.size());
+  double average_length = static_cast<double>(this->_total_length) / docs;
+  std::vector<double> idf;
+  for (const auto *list : lists) {
+    double df = static_cast<double>(list->size());
+    idf.push_back(std::log(1.0 + (docs - df + 0.5) / (df + 0.5)));
+  }
+  auto term_score = [&](const Posting &posting, size_t term) {
+    double tf = posting.name_tf * double{name_weight} + posting.description_tf;
+    double norm =
+        bm25_k1 * (1 - bm25_b + bm25_b * posting.length / average_length);
+    return idf[term] * tf * (bm25_k1 + 1) / (tf + norm);
+  };
+
+  std::vector<Match> matches;
+  std::vector<size_t> cursors(lists.size(), 0);
+  const auto &shortest = *lists[0];
+  for (size_t i = 0; i < shortest.size();) {
+    uint32_t id = shortest[i].id;
+    bool all = true;
+    for (size_t k = 1; k < lists.size() && all; ++k) {
+      const auto &list = *lists[k];
+      cursors[k] = gallop(list, cursors[k], id);
+      // past the end of a list nothing further can match
+      if (cursors[k] == list.size())
+        return matches;
+      all = list[cursors[k]].id == id;
+      // leapfrog, skip the ids the longer list doesn't have
+      if (!all)
+        i = gallop(shortest, i + 1, list[cursors[k]].id);
+    }
+    if (!all)
+      continue;
+    // scored only once every word matched
+    cursors[0] = i;
+    double score = 0;
+    for (size_t k = 0; k < lists.size(); ++k)
+      score += term_score((*lists[k])[cursors[k]], k);
+    matches.push_back({id, score});
+    ++i;
+  }
+  return matches;
+}
+
+} // namespace task_manager
@@ -0,0 +1,203 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace task_manager::trace {
+
+namespace {
+
+struct Record {
+  std::atomic<const char *> name{nullptr};
+  std::atomic<const char *> category{nullptr};
+  std::atomic<int64_t> start_ns{0};
+  std::atomic<int64_t> dur_ns{0};
+  std::atomic<uint64_t> arg{0};
+};
+
+// Single producer: only the owning thread appends, dump() reads. The
+// records are allocated with the first span, naming a thread is free.
+struct Ring {
+  uint32_t tid = static_cast<uint32_t>(::syscall(SYS_gettid));
+  std::atomic<const char *> thread_name{nullptr};
+  std::unique_ptr<Record[]> records; // published by the first head store
+  std::atomic<uint64_t> head{0};
+};
+
+// Rings outlive their threads, a trace is mostly read after the work is
+// done. Leaked on purpose like the metrics registry.
+class Registry {
+public:
+  static Registry &instance() {
+    static Registry *registry = new Registry;
+    return *registry;
+  }
+
+  Ring *add() {
+    std::lock_guard lock(this->_mutex);
+    this->_rings.push_back(std::make_unique<Ring>());
+    return this->_rings.back().get();
+  }
+
+  template <typename F> void for_each(F &&f) {
+    std::lock_guard lock(this->_mutex);
+    for (const auto &ring : this->_rings)
+      f(*ring);
+  }
+
+private:
+  std::mutex _mutex;
+  std::vector<std::unique_ptr<Ring>> _rings;
+};
+
+Ring &local_ring() {
+  thread_local Ring *ring = Registry::instance().add();
+  return *ring;
+}
+
+struct Copy {
+  const char *name;
+  const char *category;
+  int64_t start_ns;
+  int64_t dur_ns;
+  uint64_t arg;
+};
+
+// seqlock style: copy, then drop whatever the writer may have lapped
+void copy_ring(const Ring &ring, std::vector<Copy> &out) {
+  uint64_t head = ring.head.load(std::memory_order_acquire);
+  if (head == 0)
+    return;
+  uint64_t first = head > ring_capacity ? head - ring_capacity : 0;
+  size_t begin = out.size();
+  for (uint64_t i = first; i < head; ++i) {
+    const Record &r = ring.records[i & (ring_capacity - 1)];
+    out.push_back({r.name.load(std::memory_order_relaxed),
+                   r.category.load(std::memory_order_relaxed),
+                   r.start_ns.load(std::memory_order_relaxed),
+                   r.dur_ns.load(std::memory_order_relaxed),
+                   r.arg.load(std::memory_order_relaxed)});
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t now = ring.head.load(std::memory_order_relaxed);
+  // the slot of record `now` may be half written too
+  uint64_t safe = now >= ring_capacity ? now - ring_capacity + 1 : 0;
+  if (safe > first) {
+    size_t lapped = static_cast<size_t>(std::min(safe, head) - first);
+    out.erase(out.begin() + static_cast<std::ptrdiff_t>(begin),
+              out.begin() + static_cast<std::ptrdiff_t>(begin + lapped));
+  }
+}
+
+// nanoseconds as microseconds with three decimals, the unit of the format
+void write_us(std::ostream &out, int64_t ns) {
+  char fraction[4] = {static_cast<char>('0' + ns / 100 % 10),
+                      static_cast<char>('0' + ns / 10 % 10),
+                      static_cast<char>('0' + ns % 10), '\0'};
+  out << ns / 1000 << "." << fraction;
+}
+
+} // namespace
+
+void detail::record(const char *name, const char *category, int64_t start_ns,
+                    int64_t dur_ns, uint64_t arg) {
+  Ring &ring = local_ring();
+  if (!ring.records)
+    ring.records.reset(new Record[ring_capacity]);
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  Record &r = ring.records[head & (ring_capacity - 1)];
+  r.name.store(name, std::memory_order_relaxed);
+  r.category.store(category, std::memory_order_relaxed);
+  r.start_ns.store(start_ns, std::memory_order_relaxed);
+  r.dur_ns.store(dur_ns, std::memory_order_relaxed);
+  r.arg.store(arg, std::memory_order_relaxed);
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void name_thread(const char *name) {
+  local_ring().thread_name.store(name, std::memory_order_relaxed);
+}
+
+bool dump(const std::string &path) {
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::trunc);
+    if (!out) {
+      std::cerr << "Error opening " << tmp_path << " for the trace"
+                << std::endl;
+      return false;
+    }
+    auto pid = ::getpid();
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::vector<Copy> spans;
+    Registry::instance().for_each([&](const Ring &ring) {
+      if (const char *name =
+              ring.thread_name.load(std::memory_order_relaxed)) {
+        out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":"
+            << "\"thread_name\",\"pid\":" << pid << ",\"tid\":" << ring.tid
+            << ",\"args\":{\"name\":\"" << name << "\"}}";
+        first = false;
+      }
+      spans.clear();
+      copy_ring(ring, spans);
+      for (const Copy &span : spans) {
+        // complete events, microseconds
+        out << (first ? "" : ",") << "\n{\"ph\":\"X\",\"name\":\""
+            << span.name << "\",\"cat\":\"" << span.category
+            << "\",\"pid\":" << pid << ",\"tid\":" << ring.tid
+            << ",\"ts\":";
+        write_us(out, span.start_ns);
+        out << ",\"dur\":";
+        write_us(out, span.dur_ns);
+        if (span.arg != Span::no_arg)
+          out << ",\"args\":{\"n\":" << span.arg << "}";
+        out << "}";
+        first = false;
+      }
+    });
+    out << "\n]}\n";
+    if (!out.flush()) {
+      std::cerr << "Error writing the trace to " << tmp_path << std::endl;
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::cerr << "Error replacing " << path << ": " << ec.message()
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::string default_path() {
+  const char *path = std::getenv("TASK_MANAGER_TRACE");
+  return path && *path ? path : "task_manager_trace.json";
+}
+
+Session::Session(std::string path) : _path(std::move(path)) {
+  set_enabled(true);
+}
+
+Session::~Session() {
+  set_enabled(false);
+  if (dump(this->_path))
+    std::cerr << "Trace written to " << this->_path << std::endl;
+}
+
+std::unique_ptr<Session> Session::from_env() {
+  const char *path = std::getenv("TASK_MANAGER_TRACE");
+  if (path == nullptr || *path == '\0')
+    return nullptr;
+  return std::make_unique<Session>(path);
+}
+
+} // namespace task_manager::trace
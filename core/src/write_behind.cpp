@@ -0,0 +1,179 @@
+#include "write_behind.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <iostream>
+#include <utility>
+
+namespace task_manager {
+
+WriteBehind::WriteBehind(Storage &storage, WriteBehindOptions options)
+    : _storage(storage), _options(options) {
+  this->_thread = std::thread([this]() { this->run(); });
+}
+
+WriteBehind::~WriteBehind() {
+  {
+    std::lock_guard<std::mutex> lock(this->_wake_mutex);
+    this->_stop.store(true);
+  }
+  this->_wake.notify_one();
+  if (this->_thread.joinable())
+    this->_thread.join();
+}
+
+void WriteBehind::enqueue(Op op, bool urgent) {
+  this->_queue.push(std::move(op));
+  size_t pending = this->_pending.fetch_add(1) + 1;
+  if (urgent) {
+    // take the lock so the wakeup can't slip between the worker's check
+    // and its wait
+    {
+      std::lock_guard<std::mutex> lock(this->_wake_mutex);
+      this->_urgent.store(true);
+    }
+    this->_wake.notify_one();
+  } else if (pending == this->_options.max_batch) {
+    // a missed wakeup here only costs max_delay
+    this->_wake.notify_one();
+  }
+}
+
+void WriteBehind::insert(const Event &event) {
+  Op op;
+  op.kind = OpKind::Insert;
+  op.event = event;
+  this->enqueue(std::move(op), false);
+}
+
+void WriteBehind::update(const Event &event) {
+  Op op;
+  op.kind = OpKind::Update;
+  op.event = event;
+  this->enqueue(std::move(op), false);
+}
+
+void WriteBehind::remove(uint32_t id) {
+  Op op;
+  op.kind = OpKind::Remove;
+  op.id = id;
+  this->enqueue(std::move(op), false);
+}
+
+void WriteBehind::flush() {
+  Op op;
+  op.kind = OpKind::Flush;
+  op.barrier = std::make_shared<std::promise<void>>();
+  auto done = op.barrier->get_future();
+  this->enqueue(std::move(op), true);
+  done.wait();
+}
+
+void WriteBehind::run() {
+  trace::name_thread("write-behind");
+  std::vector<Op> batch;
+  batch.reserve(this->_options.max_batch);
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(this->_wake_mutex);
+      this->_wake.wait_for(lock, this->_options.max_delay, [&]() {
+        return this->_stop.load() || this->_urgent.load() ||
+               this->_pending.load() >= this->_options.max_batch;
+      });
+      this->_urgent.store(false);
+    }
+    bool stopping = this->_stop.load();
+
+    Op op;
+    while (this->_queue.pop(op)) {
+      batch.push_back(std::move(op));
+      if (batch.size() >= this->_options.max_batch)
+        this->commit(batch);
+    }
+    if (!batch.empty())
+      this->commit(batch);
+
+    // everything queued before the stop request has been drained
+    if (stopping)
+      break;
+  }
+}
+
+std::vector<uint32_t> WriteBehind::take_failures() {
+  std::lock_guard<std::mutex> lock(this->_failures_mutex);
+  return std::exchange(this->_failures, {});
+}
+
+void WriteBehind::apply(const Op &op) {
+  switch (op.kind) {
+  case OpKind::Insert:
+    // with the id Calendar reserved for it, a taken id is an error
+    this->_storage.insert(op.event,
+                          columns(&Event::_id, &Event::_name,
+                                  &Event::_description, &Event::_start_db,
+                                  &Event::_end_db, &Event::_ongoing));
+    break;
+  case OpKind::Update:
+    this->_storage.update(op.event);
+    break;
+  case OpKind::Remove:
+    this->_storage.remove<Event>(op.id);
+    break;
+  case OpKind::Flush:
+    break;
+  }
+}
+
+void WriteBehind::commit(std::vector<Op> &batch) {
+  metrics::ScopedTimer timer(metrics::Timer::WriteBehindCommit);
+  trace::Span span("write-behind commit", "sqlite");
+  span.set_arg(batch.size());
+  size_t ops = 0;
+  for (auto &op : batch) {
+    if (op.kind != OpKind::Flush)
+      ++ops;
+  }
+  try {
+    this->_storage.transaction([&]() {
+      for (auto &op : batch)
+        this->apply(op);
+      return true;
+    });
+    metrics::add(metrics::Counter::WriteBehindOps, ops);
+  } catch (const std::exception &e) {
+    std::cerr << "Error committing " << ops
+              << " queued operations, retrying them one by one: " << e.what()
+              << std::endl;
+    metrics::add(metrics::Counter::DbErrors);
+    // the whole group was rolled back, don't let one bad operation take
+    // the others down with it
+    for (auto &op : batch) {
+      if (op.kind == OpKind::Flush)
+        continue;
+      try {
+        this->_storage.transaction([&]() {
+          this->apply(op);
+          return true;
+        });
+        metrics::add(metrics::Counter::WriteBehindOps);
+      } catch (const std::exception &e) {
+        uint32_t id = op.kind == OpKind::Remove ? op.id : op.event.get_id();
+        std::cerr << "Error committing the queued change of event " << id
+                  << ": " << e.what() << std::endl;
+        metrics::add(metrics::Counter::DbErrors);
+        this->_failed.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(this->_failures_mutex);
+        this->_failures.push_back(id);
+      }
+    }
+  }
+
+  for (auto &op : batch) {
+    if (op.kind == OpKind::Flush)
+      op.barrier->set_value();
+  }
+  this->_pending.fetch_sub(batch.size());
+  batch.clear();
+}
+
+} // namespace task_manager
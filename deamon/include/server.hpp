@@ -0,0 +1,56 @@
+#pragma once
+#include "calendar.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace task_manager {
+
+// Single-threaded epoll loop serving one resident Calendar over a Unix
+// socket, see protocol.hpp for the framing. Commands run to completion on
+// the loop thread in arrival order, so every client sees the effects of
+// the commands before it. The loop also drives the calendar's start/end
+// transitions by sleeping until the next one is due.
+class Server {
+public:
+  Server(Calendar &calendar, std::string socket_path)
+      : _calendar(calendar), _socket_path(std::move(socket_path)) {}
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+  ~Server();
+
+  // Binds the socket. Fails if another daemon already answers on it, a
+  // stale socket file left by a crash is replaced.
+  bool start();
+  // Serves until SIGINT or SIGTERM.
+  void run();
+
+private:
+  struct Connection {
+    std::string in;
+    std::string out;
+    size_t out_sent = 0;
+    bool closing = false; // flush `out`, then hang up
+    uint32_t events = 0;  // current epoll interest
+  };
+
+  void accept_clients();
+  // false once the connection should be dropped
+  bool read_from(int fd, Connection &connection);
+  bool write_to(int fd, Connection &connection);
+  void handle_frames(Connection &connection);
+  void update_interest(int fd, Connection &connection);
+  void close_connection(int fd);
+  int next_timeout_ms() const;
+
+  Calendar &_calendar;
+  std::string _socket_path;
+  int _listen_fd = -1;
+  int _epoll_fd = -1;
+  int _signal_fd = -1;
+  bool _stopping = false;
+  std::unordered_map<int, Connection> _connections;
+};
+
+} // namespace task_manager
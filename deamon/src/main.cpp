@@ -0,0 +1,50 @@
+#include "core.hpp"
+#include "db.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "server.hpp"
+#include <iostream>
+
+using namespace task_manager;
+
+int main() {
+  int exit_code = 0;
+  try {
+    // written on shutdown, `trace dump` writes one on demand
+    auto tracing = trace::Session::from_env();
+    trace::name_thread("main");
+    auto storage = init_storage(get_user_db_path(), StorageProfile::from_env());
+    auto options = CalendarOptions::from_env();
+    Calendar calendar(storage, options);
+
+    Server server(calendar, get_user_socket_path());
+    if (!server.start()) {
+      return 1;
+    }
+    // after start(): the writer thread has to inherit the blocked
+    // SIGINT/SIGTERM, or they kill the process instead of reaching the loop.
+    // Replies then go out before the commit, the queue is drained on
+    // shutdown and failed commits are undone by the next tick.
+    if (options.write_behind)
+      calendar.enable_write_behind();
+    // same for the exporter thread, if TASK_MANAGER_METRICS_FILE is set
+    auto exporter = metrics::PrometheusFileExporter::from_env();
+    std::cout << "task_managerd: serving " << calendar.resident_size()
+              << " event(s) on " << get_user_socket_path() << std::endl;
+    server.run();
+
+    // same clean shutdown as the CLI, the next start maps the snapshot
+    if (!calendar.flush())
+      exit_code = 1;
+    calendar.save_snapshot();
+  } catch (const std::exception &e) {
+    std::cerr << "An unhandled exception occurred: " << e.what() << std::endl;
+    return 1;
+  } catch (...) {
+    std::cerr << "An unknown exception occurred." << std::endl;
+    return 1;
+  }
+
+  std::cout << "task_managerd: stopped.\n";
+  return exit_code;
+}
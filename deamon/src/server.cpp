@@ -0,0 +1,269 @@
+#include "server.hpp"
+#include "client.hpp"
+#include "commands.hpp"
+#include "protocol.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <ostream>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace task_manager {
+
+namespace {
+// upper bound on a single epoll_wait, keeps the clock checks honest
+constexpr int max_sleep_ms = 60 * 1000;
+// stop reading from a client that doesn't read its replies
+constexpr size_t max_pending_output = 64u << 20;
+} // namespace
+
+Server::~Server() {
+  for (auto &[fd, _] : this->_connections)
+    ::close(fd);
+  if (this->_listen_fd >= 0) {
+    ::close(this->_listen_fd);
+    ::unlink(this->_socket_path.c_str());
+  }
+  if (this->_signal_fd >= 0)
+    ::close(this->_signal_fd);
+  if (this->_epoll_fd >= 0)
+    ::close(this->_epoll_fd);
+}
+
+bool Server::start() {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (this->_socket_path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path too long: " << this->_socket_path << std::endl;
+    return false;
+  }
+  std::memcpy(addr.sun_path, this->_socket_path.c_str(),
+              this->_socket_path.size() + 1);
+
+  if (DaemonClient::connect(this->_socket_path)) {
+    std::cerr << "A daemon is already listening on " << this->_socket_path
+              << std::endl;
+    return false;
+  }
+  // nobody answered, whatever is left there is from a dead daemon
+  ::unlink(this->_socket_path.c_str());
+
+  this->_listen_fd =
+      ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (this->_listen_fd < 0) {
+    std::cerr << "socket: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  // the calendar is private, don't let other users connect
+  mode_t old_mask = ::umask(0077);
+  int bound = ::bind(this->_listen_fd, reinterpret_cast<sockaddr *>(&addr),
+                     sizeof(addr));
+  ::umask(old_mask);
+  if (bound < 0 || ::listen(this->_listen_fd, SOMAXCONN) < 0) {
+    std::cerr << "Failed to listen on " << this->_socket_path << ": "
+              << std::strerror(errno) << std::endl;
+    ::close(this->_listen_fd);
+    this->_listen_fd = -1;
+    return false;
+  }
+
+  // SIGINT/SIGTERM arrive as readable events instead of interrupting us
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  ::sigprocmask(SIG_BLOCK, &signals, nullptr);
+  this->_signal_fd = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  this->_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+  if (this->_signal_fd < 0 || this->_epoll_fd < 0) {
+    std::cerr << "Failed to set up the event loop: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = this->_listen_fd;
+  ::epoll_ctl(this->_epoll_fd, EPOLL_CTL_ADD, this->_listen_fd, &ev);
+  ev.data.fd = this->_signal_fd;
+  ::epoll_ctl(this->_epoll_fd, EPOLL_CTL_ADD, this->_signal_fd, &ev);
+  return true;
+}
+
+void Server::run() {
+  std::array<epoll_event, 64> events;
+  while (!this->_stopping) {
+    int n = ::epoll_wait(this->_epoll_fd, events.data(),
+                         static_cast<int>(events.size()),
+                         this->next_timeout_ms());
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    // cheap when nothing is due
+    this->_calendar.tick();
+
+    for (int i = 0; i < n; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == this->_listen_fd) {
+        this->accept_clients();
+        continue;
+      }
+      if (fd == this->_signal_fd) {
+        this->_stopping = true;
+        continue;
+      }
+      auto it = this->_connections.find(fd);
+      if (it == this->_connections.end())
+        continue;
+      Connection &connection = it->second;
+      bool keep = true;
+      if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        keep = this->read_from(fd, connection);
+      if (keep && !connection.out.empty())
+        keep = this->write_to(fd, connection);
+      if (!keep || (connection.closing && connection.out.empty()))
+        this->close_connection(fd);
+      else
+        this->update_interest(fd, connection);
+    }
+  }
+}
+
+int Server::next_timeout_ms() const {
+  auto wait = this->_calendar.time_until_next_transition();
+  auto ms = std::chrono::ceil<std::chrono::milliseconds>(
+      std::min<std::chrono::nanoseconds>(
+          wait, std::chrono::milliseconds(max_sleep_ms)));
+  return static_cast<int>(ms.count());
+}
+
+void Server::accept_clients() {
+  while (true) {
+    int fd = ::accept4(this->_listen_fd, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        std::cerr << "accept: " << std::strerror(errno) << std::endl;
+      return;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    if (::epoll_ctl(this->_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      ::close(fd);
+      continue;
+    }
+    Connection connection;
+    connection.events = ev.events;
+    this->_connections.emplace(fd, std::move(connection));
+  }
+}
+
+bool Server::read_from(int fd, Connection &connection) {
+  char chunk[64 * 1024];
+  while (connection.out.size() < max_pending_output) {
+    ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return false;
+    }
+    if (n == 0) {
+      // half-closed: answer what was sent, then hang up
+      connection.closing = true;
+      break;
+    }
+    connection.in.append(chunk, static_cast<size_t>(n));
+  }
+  this->handle_frames(connection);
+  return true;
+}
+
+void Server::handle_frames(Connection &connection) {
+  std::string_view input = connection.in;
+  size_t done = 0;
+  while (true) {
+    std::string_view payload;
+    size_t consumed = 0;
+    auto status = protocol::next_frame(input.substr(done), payload, consumed);
+    if (status == protocol::FrameStatus::Incomplete)
+      break;
+    if (status == protocol::FrameStatus::Invalid) {
+      connection.closing = true;
+      done = input.size();
+      break;
+    }
+    done += consumed;
+
+    // the output goes straight into frames in `out`
+    protocol::ReplyWriter writer(connection.out);
+    std::ostream output(&writer);
+    auto result = run_command(this->_calendar, std::string(payload), output);
+    writer.finish(result);
+    if (result == CommandStatus::Exit) {
+      connection.closing = true;
+      done = input.size();
+      break;
+    }
+  }
+  connection.in.erase(0, done);
+}
+
+bool Server::write_to(int fd, Connection &connection) {
+  while (connection.out_sent < connection.out.size()) {
+    ssize_t n = ::send(fd, connection.out.data() + connection.out_sent,
+                       connection.out.size() - connection.out_sent,
+                       MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return true;
+      return false;
+    }
+    connection.out_sent += static_cast<size_t>(n);
+  }
+  connection.out.clear();
+  connection.out_sent = 0;
+  return true;
+}
+
+void Server::update_interest(int fd, Connection &connection) {
+  // level-triggered: stop listening for input we won't read, or the loop
+  // spins on it
+  uint32_t events = 0;
+  if (!connection.closing && connection.out.size() < max_pending_output)
+    events |= EPOLLIN | EPOLLRDHUP;
+  if (!connection.out.empty())
+    events |= EPOLLOUT;
+  if (events == connection.events)
+    return;
+  epoll_event ev{};
+  ev.events = events;
+  ev.data.fd = fd;
+  ::epoll_ctl(this->_epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+  connection.events = events;
+}
+
+void Server::close_connection(int fd) {
+  ::epoll_ctl(this->_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  ::close(fd);
+  this->_connections.erase(fd);
+}
+
+} // namespace task_manager
@@ -0,0 +1,229 @@
+// Readers hammering every query while writers create, update and remove
+// events and a ticker flips their state. Events from a few days ago are
+// seeded first and left outside the residency window, so the queries that
+// reach the DB read an archive too. Built with TASK_MANAGER_TSAN, any race
+// ThreadSanitizer sees fails the run; the readers also check that what they
+// get back is consistent.
+//
+// Usage: calendar_stress [seconds] [--write-behind]
+#include "calendar.hpp"
+#include "ics.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace task_manager;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::atomic<bool> stop{false};
+std::atomic<size_t> failures{0};
+
+// seeded before the run, nobody touches them afterwards
+constexpr size_t archived_events = 300;
+constexpr auto resident_past = 1h;
+
+void fail(const std::string &what) {
+  if (failures++ == 0)
+    std::cerr << "calendar_stress: " << what << std::endl;
+}
+
+// short events around now, so the ticker has transitions to apply
+Event random_event(std::mt19937 &rng, size_t i) {
+  static constexpr std::string_view words[] = {"standup", "review", "lunch",
+                                               "planning", "focus"};
+  std::uniform_int_distribution<int> offset(-2000, 2000);
+  std::uniform_int_distribution<int> length(1, 500);
+  auto start = std::chrono::system_clock::now() +
+               std::chrono::milliseconds(offset(rng));
+  Event event(std::string(words[i % std::size(words)]) + " " +
+                  std::to_string(i),
+              start, start + std::chrono::milliseconds(length(rng)));
+  event.set_description(std::string(words[(i / 5) % std::size(words)]));
+  return event;
+}
+
+void writer(Calendar &calendar, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint32_t> mine;
+  for (size_t i = 0; !stop; ++i) {
+    Event event = random_event(rng, i);
+    if (mine.size() < 200 || i % 3 == 0) {
+      if (calendar.create_event(event))
+        mine.push_back(event.get_id());
+      continue;
+    }
+    uint32_t id = mine[rng() % mine.size()];
+    if (i % 3 == 1) {
+      calendar.update_event_by_id(id, event.get_name(),
+                                  event.get_description(),
+                                  event.get_start(), event.get_end());
+    } else {
+      calendar.remove_event_by_id(id);
+      std::erase(mine, id);
+    }
+  }
+}
+
+// From 60 days back, two hours long every eight hours plus one overlapping
+// each of them
+void seed_archive(Calendar &calendar) {
+  auto base = std::chrono::floor<std::chrono::hours>(
+      std::chrono::system_clock::now() - std::chrono::days(60));
+  for (size_t i = 0; i < archived_events; ++i) {
+    auto start = base + std::chrono::hours(8 * (i / 2)) + 1h * (i % 2);
+    Event event("archived " + std::to_string(i), start, start + 2h);
+    calendar.create_event(event);
+  }
+}
+
+void reader(const Calendar &calendar, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::ostringstream out;
+  auto ics_path = std::filesystem::temp_directory_path() /
+                  ("calendar_stress_" + std::to_string(::getpid()) + "_" +
+                   std::to_string(seed) + ".ics");
+  while (!stop) {
+    auto now = std::chrono::system_clock::now();
+    auto from = now - 1s;
+    auto to = now + 1s;
+
+    auto snapshot = calendar.snapshot();
+    size_t seen = 0;
+    for (EventView view : *snapshot) {
+      if (view.get_end() < view.get_start())
+        fail("snapshot event ends before it starts");
+      ++seen;
+    }
+    if (seen != snapshot->size())
+      fail("snapshot size doesn't match its events");
+
+    for (const Event &event : calendar.get_overlapping_events(from, to)) {
+      if (event.get_start() > to || event.get_end() < from)
+        fail("get_overlapping_events() returned a stranger");
+    }
+    for (const Event &event : calendar.select_overlapping(from, to)) {
+      if (event.get_start() > to || event.get_end() < from)
+        fail("select_overlapping() returned a stranger");
+    }
+    auto future = calendar.get_future_events(now, 10);
+    if (future.size() > 10)
+      fail("get_future_events() ignored the limit");
+    for (size_t i = 1; i < future.size(); ++i) {
+      if (future[i].get_start() < future[i - 1].get_start())
+        fail("get_future_events() out of order");
+    }
+    calendar.get_ongoing_events();
+    calendar.get_ongoing_events(now);
+    calendar.get_past_events(from);
+    calendar.classify(now);
+    calendar.count_overlapping(from, to);
+
+    auto ids = calendar.resident_ids();
+    if (!ids.empty()) {
+      uint32_t id = ids[rng() % ids.size()];
+      // may have been removed since, but never turn into another one
+      if (auto event = calendar.find_event(id); event && event->get_id() != id)
+        fail("find_event() returned another id");
+      if (auto event = calendar.get_event_by_id(id);
+          event && event->get_id() != id)
+        fail("get_event_by_id() returned another id");
+    }
+
+    SearchOptions options;
+    options.limit = 5;
+    calendar.search("review planning", options);
+    out.str({});
+    ListOptions list;
+    list.limit = 20;
+    calendar.list(out, list);
+    std::vector<Change> changes;
+    calendar.changes_since(0, changes, 100);
+
+    // the archive, read from the DB while the writers commit
+    size_t archived = 0;
+    bool read_ok = calendar.for_each_archived([&](const Event &event) {
+      if (event.get_end() >= now - resident_past)
+        fail("for_each_archived() returned a resident event");
+      ++archived;
+    });
+    if (!read_ok || archived != archived_events)
+      fail("for_each_archived() missed archived events");
+    auto exported = export_ics(calendar, ics_path.string());
+    if (!exported || *exported < archived_events)
+      fail("export_ics() missed events");
+
+    auto since = now - std::chrono::days(61);
+    for (const Conflict &conflict : calendar.find_conflicts(since, to)) {
+      if (conflict.start >= conflict.end ||
+          conflict.first.get_start() > conflict.second.get_start())
+        fail("find_conflicts() returned a bogus conflict");
+    }
+    auto slots = calendar.free_slots(since, to);
+    for (size_t i = 0; i < slots.size(); ++i) {
+      if (slots[i].start >= slots[i].end || slots[i].start < since ||
+          slots[i].end > to || (i > 0 && slots[i].start < slots[i - 1].end))
+        fail("free_slots() returned overlapping or stray slots");
+    }
+  }
+  std::filesystem::remove(ics_path);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+  bool write_behind = argc > 2 && std::string_view(argv[2]) == "--write-behind";
+
+  auto db_path = std::filesystem::temp_directory_path() /
+                 ("calendar_stress_" + std::to_string(::getpid()) + ".db");
+  std::filesystem::remove(db_path);
+  int exit_code = 0;
+  {
+    auto storage = init_storage(db_path.string());
+    {
+      Calendar seeding(storage);
+      seed_archive(seeding);
+    }
+    CalendarOptions options;
+    options.resident_past = resident_past;
+    Calendar calendar(storage, options);
+    if (write_behind)
+      calendar.enable_write_behind();
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < 2; ++i)
+      threads.emplace_back([&calendar, i] { writer(calendar, i); });
+    for (unsigned i = 0; i < 4; ++i)
+      threads.emplace_back([&calendar, i] { reader(calendar, 100 + i); });
+    threads.emplace_back([&calendar] {
+      while (!stop) {
+        calendar.tick();
+        std::this_thread::sleep_for(1ms);
+      }
+    });
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &thread : threads)
+      thread.join();
+
+    if (!calendar.flush())
+      exit_code = 1;
+    std::cout << "calendar_stress: " << calendar.resident_size()
+              << " event(s) left, " << failures << " failure(s)" << std::endl;
+  }
+  std::filesystem::remove(db_path);
+  std::filesystem::remove(db_path.string() + "-wal");
+  std::filesystem::remove(db_path.string() + "-shm");
+  return failures ? 1 : exit_code;
+}
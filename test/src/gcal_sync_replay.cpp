@@ -0,0 +1,336 @@
+// GoogleCalendarSync against a local server replaying recorded
+// events.list responses: a paged initial sync, a delta with upserts and
+// deletes, a change that fails to apply, a page that fails to download, an
+// expired sync token and a page trickling in a few bytes at a time. The
+// decoder is also fed that page split at every offset. Exits non-zero if
+// any expectation broke.
+#include "db.hpp"
+#include "events_decoder.hpp"
+#include "gcal_sync.hpp"
+#include "mock_server.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sqlite3.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+
+using task_manager::Calendar;
+using task_manager::bench::MockServer;
+using namespace std::chrono_literals;
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, std::string_view what) {
+  if (!ok) {
+    std::cerr << "gcal_sync_replay: FAILED " << what << std::endl;
+    ++failures;
+  }
+}
+
+// Recorded responses by (syncToken, pageToken) of the request, swapped
+// between the steps of the test
+class Recording {
+public:
+  void set(std::string sync_token, std::string page_token,
+           MockServer::Reply reply) {
+    std::lock_guard lock(_mutex);
+    _replies[{std::move(sync_token), std::move(page_token)}] =
+        std::move(reply);
+  }
+  void clear() {
+    std::lock_guard lock(_mutex);
+    _replies.clear();
+  }
+
+  MockServer::Reply replay(std::string_view target) {
+    std::lock_guard lock(_mutex);
+    auto it = _replies.find({param(target, "syncToken"),
+                             param(target, "pageToken")});
+    if (it == _replies.end())
+      return {404, R"({"error": "not recorded"})"};
+    return it->second;
+  }
+
+private:
+  // the tokens used here need no decoding
+  static std::string param(std::string_view target, std::string_view name) {
+    for (size_t pos = target.find('?'); pos != std::string_view::npos;
+         pos = target.find('&', pos)) {
+      std::string_view rest = target.substr(pos + 1);
+      if (rest.starts_with(name) && rest.substr(name.size()).starts_with('=')) {
+        rest.remove_prefix(name.size() + 1);
+        return std::string(rest.substr(0, rest.find('&')));
+      }
+      ++pos;
+    }
+    return {};
+  }
+
+  std::mutex _mutex;
+  std::map<std::pair<std::string, std::string>, MockServer::Reply> _replies;
+};
+
+std::string rfc3339(std::chrono::system_clock::time_point time_p) {
+  return std::format("{:%Y-%m-%dT%H:%M:%SZ}",
+                     std::chrono::floor<std::chrono::seconds>(time_p));
+}
+
+// Upcoming events, so they stay inside the residency window
+std::string item(std::string_view id, std::string_view summary, int day) {
+  auto start = std::chrono::system_clock::now() + std::chrono::days(day);
+  return std::format(R"({{"id": "{}", "status": "confirmed", "summary": "{}",)"
+                     R"( "start": {{"dateTime": "{}"}},)"
+                     R"( "end": {{"dateTime": "{}"}}}})",
+                     id, summary, rfc3339(start), rfc3339(start + 1h));
+}
+
+std::string cancelled(std::string_view id) {
+  return std::format(R"({{"id": "{}", "status": "cancelled"}})", id);
+}
+
+MockServer::Reply page(std::vector<std::string> items,
+                       std::string_view next_page_token,
+                       std::string_view next_sync_token) {
+  std::string body = R"({"kind": "calendar#events", "items": [)";
+  for (size_t i = 0; i < items.size(); ++i)
+    body += (i ? ", " : "") + items[i];
+  body += "]";
+  if (!next_page_token.empty())
+    body += std::format(R"(, "nextPageToken": "{}")", next_page_token);
+  if (!next_sync_token.empty())
+    body += std::format(R"(, "nextSyncToken": "{}")", next_sync_token);
+  return {200, body + "}"};
+}
+
+std::chrono::sys_days day_at(int day) {
+  return std::chrono::floor<std::chrono::days>(
+      std::chrono::system_clock::now() + std::chrono::days(day));
+}
+
+// Escapes, a surrogate pair, an all-day event and fields the decoder
+// doesn't know, nested in objects and arrays, some with known names
+std::string odd_page(int day) {
+  std::string date = std::format("{:%Y-%m-%d}", day_at(day));
+  std::string next_date = std::format("{:%Y-%m-%d}", day_at(day + 1));
+  std::string start = rfc3339(day_at(day) + 9h);
+  std::string end = rfc3339(day_at(day) + 10h);
+  return R"({"kind": "calendar#events",)"
+         R"( "defaultReminders": [{"method": "popup", "minutes": 10}],)"
+         R"( "items": [{"id": "g", "status": "confirmed",)"
+         R"( "summary": "Caf\u00e9 \"Q3\" \ud83d\ude00 review",)"
+         R"( "description": "line 1\nline 2\t\u0041\/",)"
+         R"( "organizer": {"email": "a@b.c", "self": true, "id": "x"},)"
+         R"( "attendees": [{"email": "d@e.f", "summary": "not it",)"
+         R"( "extra": {"a": [1, -2.5e3, {"b": null}, []]}}, {}],)"
+         R"( "recurrence": ["RRULE:FREQ=WEEKLY"],)"
+         R"( "reminders": {"useDefault": false,)"
+         R"( "overrides": [{"method": "email", "minutes": 30}]},)"
+         R"( "start": {"date": ")" +
+         date + R"("}, "end": {"date": ")" + next_date +
+         R"("}},)"
+         R"( {"id": "h", "summary": "Timed", "start": {"dateTime": ")" +
+         start +
+         R"(", "timeZone": "Europe/Paris", "x": {"date": "1999-01-01"}},)"
+         R"( "end": {"dateTime": ")" +
+         end +
+         R"("}, "conferenceData": {"entryPoints":)"
+         R"( [[], {}, [[{"id": "y"}]]]}}],)"
+         R"( "nextSyncToken": "s5"})";
+}
+
+bool same(const ApiEvent &a, const ApiEvent &b) {
+  return a.id == b.id && a.summary == b.summary &&
+         a.description == b.description && a.start == b.start &&
+         a.end == b.end && a.all_day == b.all_day &&
+         a.cancelled == b.cancelled;
+}
+
+bool same(const EventPage &a, const EventPage &b) {
+  return a.next_page_token == b.next_page_token &&
+         a.next_sync_token == b.next_sync_token &&
+         std::equal(a.items.begin(), a.items.end(), b.items.begin(),
+                    b.items.end(),
+                    [](const auto &x, const auto &y) { return same(x, y); });
+}
+
+// The body in two pieces split at every offset, then byte by byte, has to
+// decode to what the whole body gives
+EventPage decode_splits(std::string_view body) {
+  EventPage whole;
+  EventsPageDecoder decoder(whole);
+  check(decoder.feed(body) && decoder.finish(), "the whole body decodes");
+  bool all_same = true;
+  for (size_t split = 1; split < body.size(); ++split) {
+    EventPage page;
+    EventsPageDecoder split_decoder(page);
+    all_same &= split_decoder.feed(body.substr(0, split)) &&
+                split_decoder.feed(body.substr(split)) &&
+                split_decoder.finish() && same(page, whole);
+  }
+  EventPage page;
+  EventsPageDecoder byte_decoder(page);
+  for (char c : body)
+    all_same &= byte_decoder.feed(std::string_view(&c, 1));
+  all_same &= byte_decoder.finish() && same(page, whole);
+  check(all_same, "a split body decodes like the whole one");
+
+  EventPage cut;
+  EventsPageDecoder cut_decoder(cut);
+  check(!(cut_decoder.feed(body.substr(0, body.size() - 1)) &&
+          cut_decoder.finish()),
+        "a truncated body is rejected");
+  return whole;
+}
+
+// Name of the calendar event mirroring `gcal_id`, empty if there is none
+std::string mirrored(const Calendar &calendar, const std::string &state_path,
+                     const std::string &gcal_id) {
+  std::ifstream f(state_path);
+  auto state = nlohmann::json::parse(f);
+  if (!state["ids"].contains(gcal_id))
+    return {};
+  auto event = calendar.get_event_by_id(state["ids"][gcal_id].get<uint32_t>());
+  return event ? event->get_name() : "<missing>";
+}
+
+} // namespace
+
+int main() {
+  auto dir = std::filesystem::temp_directory_path() /
+             ("gcal_sync_replay_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+  std::string secret_path = (dir / "gcal_secret.json").string();
+  std::string token_path = (dir / "gcal_token.json").string();
+  std::string state_path = (dir / "gcal_sync.json").string();
+  std::string db_path = (dir / "events.db").string();
+  std::ofstream(secret_path) << R"({"installed": {"client_id": "test",)"
+                                R"( "client_secret": "test"}})";
+  std::ofstream(token_path)
+      << R"({"access_token": "test", "refresh_token": "test"})";
+
+  EventPage odd = decode_splits(odd_page(7));
+  // UTF-8 of the escapes in odd_page()
+  const std::string summary = "Caf\xc3\xa9 \"Q3\" \xf0\x9f\x98\x80 review";
+  check(odd.items.size() == 2 && odd.next_sync_token == "s5" &&
+            odd.next_page_token.empty(),
+        "unknown fields don't add items or tokens");
+  if (odd.items.size() == 2) {
+    const ApiEvent &g = odd.items[0];
+    const ApiEvent &h = odd.items[1];
+    check(g.id == "g" && g.summary == summary &&
+              g.description == "line 1\nline 2\tA/",
+          "escapes are decoded");
+    check(g.all_day && g.start == day_at(7) && g.end == day_at(8),
+          "all-day dates are midnight UTC");
+    check(h.id == "h" && h.summary == "Timed" && !h.all_day &&
+              h.start == day_at(7) + 9h && h.end == day_at(7) + 10h,
+          "nested unknown fields don't clobber the item");
+  }
+
+  Recording recording;
+  MockServer server(
+      [&](std::string_view target) { return recording.replay(target); });
+  if (!server.start())
+    return 1;
+  {
+    auto storage = task_manager::init_storage(db_path);
+    Calendar calendar(storage);
+    // one attempt, a failing page fails the sync right away
+    GoogleCalendarAPI api(secret_path,
+                          GoogleApiEndpoints{server.url(),
+                                             server.url() + "/token"},
+                          RetryPolicy{.max_attempts = 1}, token_path);
+    GoogleCalendarSync sync(api, calendar, state_path);
+
+    // initial sync, two pages
+    recording.set("", "", page({item("a", "Alpha", 1), item("b", "Beta", 2)},
+                               "p2", ""));
+    recording.set("", "p2", page({item("c", "Gamma", 3)}, "", "s1"));
+    auto stats = sync.sync();
+    check(stats && stats->full && stats->pages == 2 && stats->created == 3,
+          "initial sync lists both pages");
+    check(sync.sync_token() == "s1", "initial sync stores the token");
+    check(mirrored(calendar, state_path, "a") == "Alpha" &&
+              mirrored(calendar, state_path, "c") == "Gamma",
+          "initial sync mirrors the events");
+
+    // delta: one update, one delete, one new event
+    recording.set("s1", "", page({item("a", "Alpha v2", 1), cancelled("b"),
+                                  item("d", "Delta", 4)},
+                                 "", "s2"));
+    stats = sync.sync();
+    check(stats && !stats->full && stats->updated == 1 &&
+              stats->removed == 1 && stats->created == 1,
+          "delta applies upserts and deletes");
+    check(sync.sync_token() == "s2", "delta advances the token");
+    check(mirrored(calendar, state_path, "a") == "Alpha v2" &&
+              mirrored(calendar, state_path, "b").empty() &&
+              mirrored(calendar, state_path, "d") == "Delta",
+          "delta mirrors the changes");
+
+    // partial failure: another connection holds the write lock, so the new
+    // event can't be saved and the token has to stay
+    recording.set("s2", "", page({item("e", "Epsilon", 5)}, "", "s3"));
+    sqlite3 *blocker = nullptr;
+    sqlite3_open(db_path.c_str(), &blocker);
+    sqlite3_exec(blocker, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr);
+    stats = sync.sync();
+    sqlite3_exec(blocker, "ROLLBACK", nullptr, nullptr, nullptr);
+    sqlite3_close(blocker);
+    check(stats && stats->created == 0, "failed change is not counted");
+    check(sync.sync_token() == "s2", "failed change keeps the token");
+    check(GoogleCalendarSync(api, calendar, state_path).sync_token() == "s2",
+          "failed change keeps the saved token");
+    stats = sync.sync();
+    check(stats && stats->created == 1 && sync.sync_token() == "s3",
+          "retry applies the change and advances the token");
+
+    // a page failing mid-listing applies nothing and keeps the token
+    recording.set("s3", "", page({item("f", "Phi", 6)}, "q2", ""));
+    recording.set("s3", "q2", {500, R"({"error": "backend error"})"});
+    stats = sync.sync();
+    check(!stats, "failed page fails the sync");
+    check(sync.sync_token() == "s3", "failed page keeps the token");
+    check(mirrored(calendar, state_path, "f").empty(),
+          "failed page applies nothing");
+
+    // expired token: full resync, whatever vanished upstream goes
+    recording.clear();
+    recording.set("s3", "", {410, R"({"error": "gone"})"});
+    recording.set("", "", page({item("a", "Alpha v2", 1)}, "p2", ""));
+    recording.set("", "p2", page({item("e", "Epsilon", 5)}, "", "s4"));
+    stats = sync.sync();
+    check(stats && stats->full && stats->pages == 2 && stats->removed == 2,
+          "410 falls back to a full sync");
+    check(sync.sync_token() == "s4", "full resync stores the new token");
+    check(mirrored(calendar, state_path, "c").empty() &&
+              mirrored(calendar, state_path, "d").empty() &&
+              mirrored(calendar, state_path, "e") == "Epsilon",
+          "full resync removes what vanished upstream");
+    check(calendar.resident_size() == 2, "only the listed events remain");
+
+    // a delta arriving 7 bytes at a time, split inside tokens and escapes
+    recording.set("s4", "", {200, odd_page(7), 7});
+    stats = sync.sync();
+    check(stats && stats->created == 2 && stats->skipped == 0 &&
+              sync.sync_token() == "s5",
+          "a trickled page applies");
+    check(mirrored(calendar, state_path, "g") == summary &&
+              mirrored(calendar, state_path, "h") == "Timed",
+          "a trickled page mirrors the events");
+  }
+  std::filesystem::remove_all(dir);
+  if (failures == 0)
+    std::cout << "gcal_sync_replay: all checks passed" << std::endl;
+  return failures == 0 ? 0 : 1;
+}